@@ -0,0 +1,210 @@
+/*
+ * Microbenchmarks for the editing core
+ * - `make bench` builds codein-bench and runs it
+ * - `codein-bench [SIZE...]` picks the file sizes, e.g. `1M 64M 1G`;
+ *   load, search and render use the largest, edits and save use each
+ * - Results are one JSON document on stdout, one object per measurement
+ * - Inputs come from the synthetic corpus (fixed seed), so runs compare
+ * - Temporary files go to $TMPDIR (default /tmp)
+ */
+
+#include "codein.h"
+#include "corpus.h"
+#include "prof.h"
+#include "render.h"
+#include "termout.h"
+
+#include <ncurses.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BENCH_SEED 1
+#define MAX_SIZES 8
+
+static Codein *ed;
+static char tmp_path[1024];
+static char save_path[1024];
+static int first_result = 1;
+
+static const char *cur_profile;
+static uint64_t cur_size;
+
+// bytes: input processed, for throughput; out: terminal bytes written
+static void result(const char *name, int nlines, unsigned long ops, uint64_t ns, double bytes,
+                   uint64_t out)
+{
+    printf("%s\n    {\"name\": \"%s\", \"profile\": \"%s\", \"size\": %llu, \"lines\": %d, "
+           "\"ops\": %lu, \"ns_per_op\": %.1f",
+           first_result ? "" : ",", name, cur_profile, (unsigned long long)cur_size, nlines,
+           ops, ops ? (double)ns / ops : 0.0);
+    if (bytes > 0) printf(", \"mb_per_s\": %.1f", ns ? bytes / 1e6 / (ns / 1e9) : 0.0);
+    if (out > 0) printf(", \"out_bytes_per_op\": %.1f", ops ? (double)out / ops : 0.0);
+    printf("}");
+    first_result = 0;
+}
+
+// write the corpus file and load it; returns the number of lines
+static int make_file(const char *profile, uint64_t size)
+{
+    FILE *f = fopen(tmp_path, "w");
+    if (!f || corpus_generate(f, profile, size, BENCH_SEED) < 0) {
+        perror(tmp_path);
+        exit(1);
+    }
+    fclose(f);
+    cur_profile = profile;
+    cur_size = size;
+    codein_load(ed, tmp_path);
+    return codein_num_lines(ed);
+}
+
+static void bench_load(const char *profile, uint64_t size)
+{
+    int nlines = make_file(profile, size);
+    int reps = 20;
+    uint64_t t0 = prof_now_ns();
+    for (int r = 0; r < reps; ++r) codein_load(ed, tmp_path);
+    result("load_file", nlines, reps, prof_now_ns() - t0, (double)size * reps, 0);
+}
+
+static void bench_edits(const char *profile, uint64_t size)
+{
+    int nlines = make_file(profile, size);
+    int ops = size <= (1 << 20) ? 200 : 40; // an edit costs more the larger the file
+    uint64_t t0;
+
+    codein_goto(ed, nlines / 2, 10);
+    t0 = prof_now_ns();
+    for (int i = 0; i < ops; ++i) codein_insert_char(ed, 'x');
+    result("insert_char", nlines, ops, prof_now_ns() - t0, 0, 0);
+
+    t0 = prof_now_ns();
+    for (int i = 0; i < ops; ++i) codein_backspace(ed);
+    result("backspace", nlines, ops, prof_now_ns() - t0, 0, 0);
+
+    t0 = prof_now_ns();
+    for (int i = 0; i < ops; ++i) codein_newline(ed);
+    result("newline", nlines, ops, prof_now_ns() - t0, 0, 0);
+
+    // undo depth is bounded, so measure one full stack
+    t0 = prof_now_ns();
+    for (int i = 0; i < CODEIN_UNDO_DEPTH; ++i) codein_undo(ed);
+    result("undo", nlines, CODEIN_UNDO_DEPTH, prof_now_ns() - t0, 0, 0);
+
+    t0 = prof_now_ns();
+    for (int i = 0; i < CODEIN_UNDO_DEPTH; ++i) codein_redo(ed);
+    result("redo", nlines, CODEIN_UNDO_DEPTH, prof_now_ns() - t0, 0, 0);
+
+    // the same edit batched: one undo record for all of them
+    codein_goto(ed, nlines / 2, 10);
+    codein_begin_batch(ed);
+    t0 = prof_now_ns();
+    for (int i = 0; i < ops; ++i) codein_insert_char(ed, 'x');
+    uint64_t ns = prof_now_ns() - t0;
+    codein_end_batch(ed);
+    result("insert_char_batched", nlines, ops, ns, 0, 0);
+}
+
+static void bench_search(const char *profile, uint64_t size)
+{
+    int nlines = make_file(profile, size);
+    int reps = 20;
+    uint64_t t0;
+
+    // hit: needle on the last line, found after scanning the whole buffer
+    codein_goto(ed, nlines - 1, 0);
+    codein_insert_char(ed, '#');
+    codein_insert_char(ed, '@');
+    codein_insert_char(ed, '!');
+    t0 = prof_now_ns();
+    for (int r = 0; r < reps; ++r) {
+        codein_goto(ed, 0, 0);
+        codein_search(ed, "#@!");
+    }
+    result("search_hit", nlines, reps, prof_now_ns() - t0, (double)size * reps, 0);
+
+    t0 = prof_now_ns();
+    for (int r = 0; r < reps; ++r) codein_search(ed, "not-in-buffer");
+    result("search_miss", nlines, reps, prof_now_ns() - t0, (double)size * reps, 0);
+}
+
+static void bench_save(const char *profile, uint64_t size)
+{
+    int nlines = make_file(profile, size);
+    int reps = 20;
+    uint64_t t0 = prof_now_ns();
+    for (int r = 0; r < reps; ++r) codein_save(ed, save_path);
+    result("save_file", nlines, reps, prof_now_ns() - t0, (double)size * reps, 0);
+}
+
+// full repaints on an 80x24 terminal whose output is discarded
+static void bench_render(const char *profile, uint64_t size)
+{
+    int nlines = make_file(profile, size);
+    FILE *null_out = fopen("/dev/null", "w");
+    const char *term = getenv("TERM");
+    SCREEN *scr = null_out ? newterm(term && term[0] ? term : "xterm", null_out, stdin) : NULL;
+    if (!scr) {
+        fprintf(stderr, "codein-bench: cannot set up null terminal, skipping render\n");
+        return;
+    }
+    resizeterm(24, 80);
+    term_out_fd = fileno(null_out);
+    int frames = 1000;
+    uint64_t b0 = term_out_bytes();
+    uint64_t t0 = prof_now_ns();
+    for (int i = 0; i < frames; ++i) {
+        // move one line per frame so every frame scrolls
+        codein_goto(ed, i % nlines, 0);
+        draw_screen(ed, "bench");
+    }
+    result("draw_screen", nlines, frames, prof_now_ns() - t0, 0, term_out_bytes() - b0);
+    endwin();
+    delscreen(scr);
+    fclose(null_out);
+}
+
+int main(int argc, char **argv)
+{
+    // default: a small file, then MB-scale ones that show how the core scales
+    uint64_t sizes[MAX_SIZES] = { 32 << 10, 1 << 20, 16 << 20 };
+    int nsizes = 3;
+    if (argc > 1) {
+        for (nsizes = 0; nsizes + 1 < argc; ++nsizes) {
+            if (nsizes == MAX_SIZES || !(sizes[nsizes] = corpus_parse_size(argv[nsizes + 1]))) {
+                fprintf(stderr, "usage: codein-bench [SIZE[K|M|G]...] (at most %d sizes)\n", MAX_SIZES);
+                return 2;
+            }
+        }
+    }
+    uint64_t largest = sizes[0];
+    for (int i = 1; i < nsizes; ++i)
+        if (sizes[i] > largest) largest = sizes[i];
+
+    const char *dir = getenv("TMPDIR");
+    if (!dir || !dir[0]) dir = "/tmp";
+    snprintf(tmp_path, sizeof(tmp_path), "%s/codein-bench-%d.txt", dir, (int)getpid());
+    snprintf(save_path, sizeof(save_path), "%s/codein-bench-%d.out", dir, (int)getpid());
+
+    ed = codein_new();
+    if (!ed) {
+        perror("codein-bench");
+        return 1;
+    }
+    // line-oriented profiles only
+    static const char *const profiles[] = { "code", "csv", "log", "crlf" };
+    printf("{\"benchmark\": \"codein\", \"results\": [");
+    for (int p = 0; p < 4; ++p) bench_load(profiles[p], largest);
+    for (int i = 0; i < nsizes; ++i) bench_edits("code", sizes[i]);
+    for (int p = 0; p < 4; ++p) bench_search(profiles[p], largest);
+    for (int i = 0; i < nsizes; ++i) bench_save("code", sizes[i]);
+    bench_render("code", largest);
+    printf("\n]}\n");
+
+    unlink(tmp_path);
+    unlink(save_path);
+    codein_free(ed);
+    return 0;
+}
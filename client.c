@@ -0,0 +1,165 @@
+/*
+ * Thin terminal client for `codein --attach SOCK`
+ *
+ * Keys go to the server as they are read; the server answers with the
+ * rows of this terminal that changed. Only the search prompt runs here,
+ * so typing a query costs no round trips.
+ */
+
+#include "remote.h"
+
+#include <errno.h>
+#include <ncurses.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static RemoteBuf in, out;
+static int cursor_y = 0, cursor_x = 0;
+
+static int connect_to(const char *sock_path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(sock_path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, sock_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// read a query on the status line; 0 if cancelled
+static int prompt_search(char *buf, int size)
+{
+    int pos = 0;
+    buf[0] = '\0';
+    for (;;) {
+        move(LINES - 1, 0);
+        clrtoeol();
+        attron(A_REVERSE);
+        mvprintw(LINES - 1, 0, "Search: %s", buf);
+        attroff(A_REVERSE);
+        refresh();
+        int ch = getch();
+        if (ch == 27) return 0; // Esc
+        if (ch == '\n' || ch == KEY_ENTER) return 1;
+        if (ch == KEY_BACKSPACE || ch == 127) {
+            if (pos > 0) buf[--pos] = '\0';
+        } else if (ch >= 32 && ch < 127 && pos < size - 1) {
+            buf[pos++] = ch;
+            buf[pos] = '\0';
+        }
+    }
+}
+
+// apply what the server sent; 0 when it said goodbye or went away
+static int handle_server(int fd, char *reason, int size)
+{
+    if (remote_fill(fd, &in) <= 0) {
+        snprintf(reason, size, "connection closed");
+        return 0;
+    }
+    RemoteMsg m;
+    const char *payload;
+    int r;
+    while ((r = remote_next(&in, &m, &payload)) > 0) {
+        if (m.type == MSG_ROW) {
+            int attr = m.b == REMOTE_ATTR_BOLD ? A_BOLD : m.b == REMOTE_ATTR_REVERSE ? A_REVERSE : 0;
+            move(m.a, 0);
+            clrtoeol();
+            attron(attr);
+            mvaddnstr(m.a, 0, payload, m.len);
+            attroff(attr);
+        } else if (m.type == MSG_CURSOR) {
+            cursor_y = m.a;
+            cursor_x = m.b;
+        } else if (m.type == MSG_FLUSH) {
+            move(cursor_y, cursor_x);
+            refresh();
+        } else if (m.type == MSG_BELL) {
+            beep();
+        } else if (m.type == MSG_BYE) {
+            snprintf(reason, size, "%.*s", (int)m.len, payload);
+            return 0;
+        }
+    }
+    if (r < 0) {
+        snprintf(reason, size, "bad message from server");
+        return 0;
+    }
+    return 1;
+}
+
+static int send_key(int fd, uint32_t type, uint32_t a, uint32_t b, const void *data, uint32_t len)
+{
+    if (remote_put(fd, &out, type, a, b, data, len) < 0) return -1;
+    return remote_flush(fd, &out);
+}
+
+int run_client(const char *sock_path)
+{
+    int fd = connect_to(sock_path);
+    if (fd < 0) {
+        perror(sock_path);
+        return 1;
+    }
+    initscr();
+    raw();
+    keypad(stdscr, TRUE);
+    noecho();
+    curs_set(1);
+
+    char reason[256] = "detached";
+    int running = send_key(fd, MSG_HELLO, LINES, COLS, NULL, 0) == 0;
+    while (running) {
+        struct pollfd fds[2] = {
+            { STDIN_FILENO, POLLIN, 0 },
+            { fd, POLLIN, 0 },
+        };
+        // a resize interrupts poll; getch() below then returns KEY_RESIZE
+        int ready = poll(fds, 2, -1);
+        if (ready > 0 && (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) &&
+            !handle_server(fd, reason, sizeof(reason)))
+            break;
+        if (ready > 0 && (fds[0].revents & (POLLHUP | POLLERR))) break;
+        nodelay(stdscr, TRUE);
+        int ch;
+        while (running && (ch = getch()) != ERR) {
+            int rc = 0;
+            if (ch == 17) { // Ctrl-Q
+                running = 0;
+            } else if (ch == KEY_RESIZE) {
+                clear();
+                rc = send_key(fd, MSG_RESIZE, LINES, COLS, NULL, 0);
+            } else if (ch == 6) { // Ctrl-F
+                char query[CODEIN_MAX_SEARCH];
+                nodelay(stdscr, FALSE);
+                if (prompt_search(query, sizeof(query)))
+                    rc = send_key(fd, MSG_SEARCH, 0, 0, query, strlen(query));
+                else
+                    rc = send_key(fd, MSG_RESIZE, LINES, COLS, NULL, 0); // repaint the status line
+                nodelay(stdscr, TRUE);
+            } else {
+                rc = send_key(fd, MSG_KEY, ch, 0, NULL, 0);
+            }
+            if (rc < 0) {
+                snprintf(reason, sizeof(reason), "connection lost");
+                running = 0;
+            }
+        }
+        nodelay(stdscr, FALSE);
+    }
+    endwin();
+    close(fd);
+    fprintf(stderr, "codein: %s\n", reason);
+    return 0;
+}
@@ -0,0 +1,158 @@
+/*
+ * libcodein: the editing core as a library
+ * - A Codein context holds one buffer with its cursor, undo/redo history,
+ *   search state, modified tracking and snapshots; there are no globals
+ *   and no terminal calls
+ * - A context is driven by one thread at a time; only the snapshot
+ *   acquire/read/release functions may be called from other threads
+ * - Lines and columns are 0-based; functions that can fail return -1
+ * - Build with `make libcodein.a`, link with `-lcodein -pthread`
+ */
+
+#ifndef CODEIN_H
+#define CODEIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CODEIN_API_VERSION 1
+#define CODEIN_MAX_SEARCH 256   // bytes of a search query, NUL included
+#define CODEIN_UNDO_DEPTH 32    // edits that can be undone
+
+// how the file is laid out on disk; lines in memory are plain UTF-8
+typedef struct {
+    int encoding;               // ENC_* of encoding.h
+    int bom;                    // starts with a byte order mark
+    int crlf;                   // every line ends in CRLF; mixed files keep their CRs as text
+    int final_newline;          // the last line is terminated
+} CodeinFormat;
+
+typedef struct Codein Codein;
+typedef struct CodeinSnapshot CodeinSnapshot;
+
+Codein *codein_new(void);
+void codein_free(Codein *ed);
+
+// NULL path: empty unnamed buffer; a missing file gives an empty buffer
+// with that name. Returns -1 if the file exists but cannot be read.
+int codein_load(Codein *ed, const char *path);
+int codein_save(Codein *ed, const char *path); // NULL: the loaded file
+const char *codein_filename(const Codein *ed);
+void codein_set_filename(Codein *ed, const char *path);
+int codein_modified(Codein *ed); // differs from the last load/save
+int codein_on_disk(const Codein *ed);
+// ENC_* (encoding.h) the file is decoded from at load and encoded to on save
+int codein_encoding(const Codein *ed);
+// the layout recorded at load and reproduced on save
+const CodeinFormat *codein_format(const Codein *ed);
+// append the complete lines of text that grew the file on disk (follow
+// mode); not an undoable edit. Returns the bytes used: a trailing partial
+// line is left for the next call.
+size_t codein_append(Codein *ed, const char *text, size_t len);
+
+int codein_num_lines(const Codein *ed);
+const char *codein_line(const Codein *ed, int y);
+void codein_cursor(const Codein *ed, int *y, int *x);
+int codein_top_line(const Codein *ed); // first line of the view
+void codein_set_top_line(Codein *ed, int y); // clamped to the buffer
+unsigned long codein_version(const Codein *ed); // bumped on every edit
+
+// rows and columns of the view (0: unbounded); cols wraps typing
+void codein_set_view(Codein *ed, int rows, int cols);
+void codein_set_bell(Codein *ed, void (*bell)(void *arg), void *arg);
+/*
+ * Called after every edit: the text `removed` at byte column x of line y
+ * was replaced by `inserted` ("\n" is a line break). Edits that are not a
+ * single span (undo, redo, replace, load, append) report y = -1: the
+ * whole buffer may have changed.
+ */
+void codein_set_change_hook(Codein *ed,
+                            void (*fn)(void *arg, int y, int x, const char *removed, const char *inserted),
+                            void *arg);
+
+void codein_goto(Codein *ed, int y, int x); // clamped to the buffer
+void codein_move_up(Codein *ed);
+void codein_move_down(Codein *ed);
+void codein_move_left(Codein *ed);
+void codein_move_right(Codein *ed);
+void codein_page_up(Codein *ed);
+void codein_page_down(Codein *ed);
+// clamp the cursor and scroll so that it is within `rows` lines of the top
+void codein_scroll_to_cursor(Codein *ed, int rows);
+
+void codein_insert_char(Codein *ed, int c);
+void codein_backspace(Codein *ed);
+void codein_delete_char(Codein *ed);
+void codein_newline(Codein *ed);
+int codein_replace_all(Codein *ed, const char *from, const char *to);
+
+void codein_undo(Codein *ed);
+void codein_redo(Codein *ed);
+// everything between begin/end is one undo record with the bell muted
+void codein_begin_batch(Codein *ed);
+void codein_end_batch(Codein *ed);
+int codein_in_batch(const Codein *ed);
+
+// move to the next match of `query` (NULL: the previous query); 1 if found
+int codein_search(Codein *ed, const char *query);
+void codein_set_search_wrap(Codein *ed, int wrap);
+
+/*
+ * Snapshots: immutable views of the buffer for background readers.
+ * codein_publish() makes the current content visible; acquire never
+ * blocks and the snapshot stays valid until released, whatever the
+ * owning thread edits meanwhile. codein_reclaim() frees old versions.
+ */
+void codein_publish(Codein *ed);
+void codein_reclaim(Codein *ed);
+CodeinSnapshot *codein_snapshot_acquire(Codein *ed);
+void codein_snapshot_release(CodeinSnapshot *s);
+int codein_snapshot_num_lines(const CodeinSnapshot *s);
+const char *codein_snapshot_line(const CodeinSnapshot *s, int y);
+unsigned long codein_snapshot_version(const CodeinSnapshot *s);
+int codein_snapshot_write(const CodeinSnapshot *s, const char *path);
+// the snapshot was written to the buffer's file
+void codein_mark_saved(Codein *ed, const CodeinSnapshot *s);
+
+/*
+ * Shared-memory export: a snapshot copied into a sealed, read-only memfd
+ * that other processes open through /proc/<pid>/fd/<fd> and mmap.
+ * - The segment starts with a CodeinExportHeader; offsets are from the
+ *   start of the segment
+ * - The text is every line followed by '\n'; the index holds num_lines + 1
+ *   offsets into the text, so line i spans index[i] .. index[i+1] - 1
+ * - Seals forbid writes and resizing, so readers need no locking
+ */
+#define CODEIN_EXPORT_MAGIC "CODEINX1"
+
+typedef struct {
+    char magic[8];
+    uint32_t header_size;       // sizeof(CodeinExportHeader)
+    uint32_t reserved;
+    uint64_t version;           // buffer version of the snapshot
+    uint64_t num_lines;
+    uint64_t index_offset;      // uint64_t[num_lines + 1]
+    uint64_t text_offset;
+    uint64_t text_size;
+} CodeinExportHeader;
+
+// returns the memfd, owned by the caller, or -1
+int codein_snapshot_export(const CodeinSnapshot *s, const char *name);
+
+/*
+ * Memory accounting by category. `requested` is what the core asked
+ * for; `allocated` adds the allocator's rounding and chunk headers.
+ * Snapshots share line text with the buffer, so only their arrays and
+ * retired lines are counted.
+ */
+typedef struct {
+    size_t requested, allocated;
+} CodeinMemUse;
+
+typedef struct {
+    CodeinMemUse line_text, line_index, undo, redo, snapshots;
+} CodeinMem;
+
+void codein_mem(Codein *ed, CodeinMem *m);
+
+#endif
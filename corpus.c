@@ -0,0 +1,221 @@
+/*
+ * Synthetic test corpus
+ *
+ * Every profile is a stream of records from a seeded PRNG. Records are
+ * written until the requested size is reached; the last text record is
+ * cut short but keeps its line ending, and the JSON document is padded
+ * with spaces before its closing brackets so it always parses.
+ */
+
+#include "corpus.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define REC_MAX 8192
+
+const char *const corpus_profiles[] = { "code", "csv", "json", "log", "binary", "crlf", NULL };
+
+typedef struct {
+    FILE *out;
+    uint64_t left;
+    uint64_t rng;
+    uint64_t serial; // record counter, ids and timestamps
+    int err;
+} Gen;
+
+static uint64_t next_rand(Gen *g)
+{
+    // xorshift64*
+    g->rng ^= g->rng >> 12;
+    g->rng ^= g->rng << 25;
+    g->rng ^= g->rng >> 27;
+    return g->rng * 0x2545F4914F6CDD1DULL;
+}
+
+static unsigned pick(Gen *g, unsigned n)
+{
+    return (unsigned)(next_rand(g) >> 33) % n;
+}
+
+static void put(Gen *g, const char *s, size_t n)
+{
+    if (n > g->left) n = g->left;
+    if (n && fwrite(s, 1, n, g->out) != n) g->err = 1;
+    g->left -= n;
+}
+
+/*
+ * Emit one line record (without its ending). If it does not fit, the
+ * record is cut so that the file still ends with `eol`.
+ */
+static void put_line(Gen *g, const char *rec, size_t n, const char *eol)
+{
+    size_t elen = strlen(eol);
+    if (n + elen > g->left) {
+        if (g->left < elen) {
+            put(g, eol + elen - g->left, g->left);
+            return;
+        }
+        n = g->left - elen;
+    }
+    put(g, rec, n);
+    put(g, eol, elen);
+}
+
+static const char *const words[] = {
+    "buffer", "line", "cursor", "index", "value", "count", "node", "state",
+    "result", "offset", "length", "token", "entry", "cache", "block", "frame",
+    "error", "flag", "handle", "queue", "table", "width", "total", "scan",
+};
+#define NWORDS (sizeof(words) / sizeof(words[0]))
+
+static int ident(Gen *g, char *o)
+{
+    const char *a = words[pick(g, NWORDS)], *b = words[pick(g, NWORDS)];
+    return pick(g, 3) ? sprintf(o, "%s_%s", a, b) : sprintf(o, "%s", a);
+}
+
+static int code_record(Gen *g, char *rec)
+{
+    char a[64], b[64];
+    int indent = 4 * pick(g, 4), n = 0;
+    ident(g, a);
+    ident(g, b);
+    n += sprintf(rec, "%*s", indent, "");
+    switch (pick(g, 10)) {
+    case 0: n += sprintf(rec + n, "int %s = %u;", a, pick(g, 1000)); break;
+    case 1: n += sprintf(rec + n, "if (%s > %s) {", a, b); break;
+    case 2: n = sprintf(rec, "%*s}", indent, ""); break;
+    case 3: n += sprintf(rec + n, "return %s;", a); break;
+    case 4: n += sprintf(rec + n, "%s(%s, %u);", a, b, pick(g, 100)); break;
+    case 5: n += sprintf(rec + n, "// update the %s before %s", a, b); break;
+    case 6: n = 0; break;
+    case 7: n += sprintf(rec + n, "for (int i = 0; i < %s; ++i) {", a); break;
+    case 8: n = sprintf(rec, "static void %s(void)", a); break;
+    default: n += sprintf(rec + n, "%s = %s + %u;", a, b, pick(g, 64)); break;
+    }
+    return n;
+}
+
+static int csv_record(Gen *g, char *rec)
+{
+    int n = 0;
+    if (g->serial == 0) {
+        n = sprintf(rec, "id");
+        for (int c = 1; c < 32; ++c) n += sprintf(rec + n, ",%s_%d", words[c % NWORDS], c);
+        return n;
+    }
+    n = sprintf(rec, "%llu", (unsigned long long)g->serial);
+    for (int c = 1; c < 32; ++c) {
+        switch (pick(g, 4)) {
+        case 0: n += sprintf(rec + n, ",%u", pick(g, 100000)); break;
+        case 1: n += sprintf(rec + n, ",%u.%02u", pick(g, 10000), pick(g, 100)); break;
+        case 2: n += sprintf(rec + n, ",%s", words[pick(g, NWORDS)]); break;
+        default:
+            n += sprintf(rec + n, ",\"%s, %s\"", words[pick(g, NWORDS)], words[pick(g, NWORDS)]);
+            break;
+        }
+    }
+    return n;
+}
+
+static const char *const levels[] = { "TRACE", "DEBUG", "INFO", "WARN", "ERROR" };
+
+static int log_record(Gen *g, char *rec)
+{
+    // timestamps advance 0-49 ms per line from 2024-01-01T00:00:00Z
+    static const unsigned weights[] = { 1, 15, 70, 10, 4 };
+    unsigned r = pick(g, 100), lv = 0;
+    while (r >= weights[lv]) r -= weights[lv++];
+    uint64_t ms = g->serial;
+    time_t secs = 1704067200 + (time_t)(ms / 1000);
+    struct tm tm;
+    gmtime_r(&secs, &tm);
+    int n = (int)strftime(rec, 32, "%Y-%m-%dT%H:%M:%S", &tm);
+    return n + sprintf(rec + n, ".%03uZ %-5s [worker-%u] %s %s id=%u latency=%ums",
+                       (unsigned)(ms % 1000), levels[lv], pick(g, 8),
+                       words[pick(g, 4)], pick(g, 2) ? "handled" : "queued",
+                       pick(g, 100000), pick(g, 500));
+}
+
+static void gen_lines(Gen *g, int (*record)(Gen *, char *), const char *eol)
+{
+    char rec[REC_MAX];
+    uint64_t ms = 0;
+    while (g->left && !g->err) {
+        if (record == log_record) {
+            g->serial = ms;
+            ms += pick(g, 50);
+        }
+        int n = record(g, rec);
+        put_line(g, rec, n, eol);
+        if (record != log_record) g->serial++;
+    }
+}
+
+static void gen_json(Gen *g)
+{
+    const char *open = "{\"items\":[", *close = "]}";
+    char rec[REC_MAX];
+    put(g, open, strlen(open));
+    int first = 1;
+    while (g->left && !g->err) {
+        int n = sprintf(rec, "%s{\"id\":%llu,\"name\":\"%s\",\"tags\":[\"%s\",\"%s\"],"
+                        "\"meta\":{\"score\":%u.%u,\"active\":%s}}",
+                        first ? "" : ",", (unsigned long long)g->serial++,
+                        words[pick(g, NWORDS)], words[pick(g, NWORDS)], words[pick(g, NWORDS)],
+                        pick(g, 100), pick(g, 10), pick(g, 2) ? "true" : "false");
+        if ((uint64_t)n + 2 > g->left) {
+            // pad so the document still closes exactly at the size limit
+            while (g->left > 2 && !g->err) put(g, " ", 1);
+            break;
+        }
+        put(g, rec, n);
+        first = 0;
+    }
+    put(g, close, strlen(close));
+}
+
+static void gen_binary(Gen *g)
+{
+    char buf[4096];
+    while (g->left && !g->err) {
+        for (size_t i = 0; i < sizeof(buf); i += 8) {
+            uint64_t r = next_rand(g);
+            memcpy(buf + i, &r, 8);
+            // roughly one byte in ten is NUL, like object files
+            if (pick(g, 10) == 0) buf[i + pick(g, 8)] = '\0';
+        }
+        put(g, buf, sizeof(buf));
+    }
+}
+
+int corpus_generate(FILE *out, const char *profile, uint64_t size, uint64_t seed)
+{
+    Gen g = { out, size, seed * 0x9E3779B97F4A7C15ULL + 1, 0, 0 };
+    if (g.rng == 0) g.rng = 1; // xorshift state must be non-zero
+    if (strcmp(profile, "code") == 0) gen_lines(&g, code_record, "\n");
+    else if (strcmp(profile, "csv") == 0) gen_lines(&g, csv_record, "\n");
+    else if (strcmp(profile, "log") == 0) gen_lines(&g, log_record, "\n");
+    else if (strcmp(profile, "crlf") == 0) gen_lines(&g, code_record, "\r\n");
+    else if (strcmp(profile, "json") == 0) gen_json(&g);
+    else if (strcmp(profile, "binary") == 0) gen_binary(&g);
+    else return -1;
+    return g.err ? -1 : 0;
+}
+
+uint64_t corpus_parse_size(const char *s)
+{
+    char *end;
+    uint64_t n = strtoull(s, &end, 10);
+    switch (toupper((unsigned char)*end)) {
+    case 'K': n <<= 10; end++; break;
+    case 'M': n <<= 20; end++; break;
+    case 'G': n <<= 30; end++; break;
+    }
+    if (toupper((unsigned char)*end) == 'B') end++;
+    return *end || end == s ? 0 : n;
+}
@@ -0,0 +1,22 @@
+/*
+ * Synthetic test corpus
+ * - Reproducible files for benchmarks and scaling tests: the same
+ *   profile, size and seed always produce the same bytes
+ * - Profiles: code, csv, json, log, binary, crlf
+ */
+
+#ifndef CODEIN_CORPUS_H
+#define CODEIN_CORPUS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+extern const char *const corpus_profiles[]; // NULL-terminated
+
+// write exactly `size` bytes of `profile`; returns -1 on unknown profile or I/O error
+int corpus_generate(FILE *out, const char *profile, uint64_t size, uint64_t seed);
+
+// parse sizes like 4096, 64K, 10M, 10G; returns 0 on malformed input
+uint64_t corpus_parse_size(const char *s);
+
+#endif
@@ -0,0 +1,1158 @@
+/*
+ * Editing core: buffer, undo, search and file I/O without terminal calls
+ */
+
+#define _GNU_SOURCE
+#include "editor.h"
+#include "encoding.h"
+#include "prof.h"
+
+#include <fcntl.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#define LOAD_CHUNK (1 << 16) // bytes read per step while loading
+
+static int nblocks_for(int n)
+{
+    return (n + HASH_BLOCK - 1) / HASH_BLOCK;
+}
+
+static uint64_t hash_line(const char *s)
+{
+    // FNV-1a
+    uint64_t h = 1469598103934665603ULL;
+    for (; *s; ++s) {
+        h ^= (unsigned char)*s;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// grow the line and block tables to hold n lines; -1 on allocation failure
+static int reserve_lines(Codein *ed, int n)
+{
+    if (n <= ed->cap) return 0;
+    int ncap = ed->cap ? ed->cap : 1024;
+    while (ncap < n) ncap *= 2;
+    int old_blocks = nblocks_for(ed->cap), nblocks = nblocks_for(ncap);
+    char **nl = realloc(ed->lines, sizeof(char*) * ncap);
+    if (!nl) return -1;
+    ed->lines = nl;
+    uint64_t *nh = realloc(ed->line_hash, sizeof(uint64_t) * ncap);
+    if (!nh) return -1;
+    ed->line_hash = nh;
+    uint64_t *bh = realloc(ed->block_hash, sizeof(uint64_t) * nblocks);
+    if (!bh) return -1;
+    ed->block_hash = bh;
+    uint64_t *sh = realloc(ed->saved_block_hash, sizeof(uint64_t) * nblocks);
+    if (!sh) return -1;
+    ed->saved_block_hash = sh;
+    unsigned char *st = realloc(ed->block_stale, nblocks);
+    if (!st) return -1;
+    memset(st + old_blocks, 1, nblocks - old_blocks);
+    ed->block_stale = st;
+    ed->cap = ncap;
+    return 0;
+}
+
+static void mark_stale_from(Codein *ed, int y, int to_end)
+{
+    ed->version++;
+    int first = y / HASH_BLOCK;
+    int last = to_end ? nblocks_for(ed->cap) - 1 : first;
+    for (int b = first; b <= last; ++b) ed->block_stale[b] = 1;
+}
+
+// store a new line pointer and refresh its hash; caller frees the old one
+static void set_line(Codein *ed, int y, char *s)
+{
+    ed->lines[y] = s;
+    ed->line_hash[y] = hash_line(s);
+    mark_stale_from(ed, y, 0);
+}
+
+static uint64_t compute_block_hash(const uint64_t *hashes, int n, int b)
+{
+    uint64_t h = 0;
+    int end = (b + 1) * HASH_BLOCK;
+    if (end > n) end = n;
+    for (int i = b * HASH_BLOCK; i < end; ++i)
+        h = (h ^ hashes[i]) * 0x100000001b3ULL + i;
+    return h;
+}
+
+static uint64_t get_block_hash(Codein *ed, int b)
+{
+    if (ed->block_stale[b]) {
+        ed->block_hash[b] = compute_block_hash(ed->line_hash, ed->num_lines, b);
+        ed->block_stale[b] = 0;
+    }
+    return ed->block_hash[b];
+}
+
+// remember the current content as what is on disk
+static void mark_saved(Codein *ed)
+{
+    int nblocks = nblocks_for(ed->num_lines);
+    for (int b = 0; b < nblocks; ++b) ed->saved_block_hash[b] = get_block_hash(ed, b);
+    ed->saved_num_lines = ed->num_lines;
+}
+
+// same, for content written from a snapshot while editing went on
+void codein_mark_saved(Codein *ed, const CodeinSnapshot *v)
+{
+    int nblocks = nblocks_for(v->num_lines);
+    for (int b = 0; b < nblocks; ++b)
+        ed->saved_block_hash[b] = compute_block_hash(v->hashes, v->num_lines, b);
+    ed->saved_num_lines = v->num_lines;
+    ed->on_disk = 1;
+}
+
+int codein_changed_blocks(Codein *ed, unsigned char *changed)
+{
+    int nblocks = nblocks_for(ed->num_lines);
+    int saved_blocks = ed->saved_num_lines < 0 ? 0 : nblocks_for(ed->saved_num_lines);
+    int total = nblocks > saved_blocks ? nblocks : saved_blocks;
+    int count = 0;
+    if (changed) memset(changed, 0, total);
+    for (int b = 0; b < total; ++b) {
+        int differs;
+        if (b >= nblocks || b >= saved_blocks) differs = 1;
+        else if ((b + 1) * HASH_BLOCK > ed->num_lines || (b + 1) * HASH_BLOCK > ed->saved_num_lines)
+            // partial last block: a differing line count is a change
+            differs = ed->num_lines != ed->saved_num_lines
+                   || get_block_hash(ed, b) != ed->saved_block_hash[b];
+        else differs = get_block_hash(ed, b) != ed->saved_block_hash[b];
+        if (!differs) continue;
+        count++;
+        if (!changed) break;
+        changed[b] = 1;
+    }
+    return count;
+}
+
+int codein_modified(Codein *ed)
+{
+    if (ed->saved_num_lines != ed->num_lines) return 1;
+    return codein_changed_blocks(ed, NULL) > 0;
+}
+
+// free a line that left the live buffer once no snapshot can see it
+static void retire_line(Codein *ed, char *ln)
+{
+    CodeinSnapshot *v = ed->newest_version;
+    if (!v) {
+        free(ln);
+        return;
+    }
+    if (v->nretired == v->retired_cap) {
+        int ncap = v->retired_cap ? v->retired_cap * 2 : 64;
+        char **nr = realloc(v->retired, sizeof(char*) * ncap);
+        if (!nr) return; // leak rather than free a line a reader may hold
+        v->retired = nr;
+        v->retired_cap = ncap;
+    }
+    v->retired[v->nretired++] = ln;
+}
+
+static void free_version(CodeinSnapshot *v)
+{
+    for (int i = 0; i < v->nretired; ++i) free(v->retired[i]);
+    free(v->retired);
+    free(v->lines);
+    free(v->hashes);
+    free(v);
+}
+
+// free versions, oldest first, that are no longer current or referenced
+void codein_reclaim(Codein *ed)
+{
+    CodeinSnapshot *cur = atomic_load(&ed->current_version);
+    while (ed->oldest_version && ed->oldest_version != cur) {
+        // a reader between loading the pointer and taking its reference
+        // is visible here; check it before the reference count
+        if (atomic_load(&ed->readers_entering) != 0) return;
+        if (atomic_load(&ed->oldest_version->refs) != 0) return;
+        CodeinSnapshot *v = ed->oldest_version;
+        ed->oldest_version = v->next;
+        free_version(v);
+    }
+}
+
+// make the live buffer visible to snapshot readers; owning thread only
+void codein_publish(Codein *ed)
+{
+    PROF_SCOPE(PROF_PUBLISH);
+    if (ed->newest_version && ed->newest_version->version == ed->version) return;
+    CodeinSnapshot *v = calloc(1, sizeof(*v));
+    if (!v) return;
+    v->lines = malloc(sizeof(char*) * ed->num_lines);
+    v->hashes = malloc(sizeof(uint64_t) * ed->num_lines);
+    if (!v->lines || !v->hashes) {
+        free(v->lines);
+        free(v->hashes);
+        free(v);
+        return;
+    }
+    memcpy(v->lines, ed->lines, sizeof(char*) * ed->num_lines);
+    memcpy(v->hashes, ed->line_hash, sizeof(uint64_t) * ed->num_lines);
+    v->num_lines = ed->num_lines;
+    v->version = ed->version;
+    v->format = ed->format;
+    atomic_init(&v->refs, 1);
+    CodeinSnapshot *old = atomic_exchange(&ed->current_version, v);
+    if (ed->newest_version) ed->newest_version->next = v;
+    else ed->oldest_version = v;
+    ed->newest_version = v;
+    if (old) atomic_fetch_sub(&old->refs, 1);
+    codein_reclaim(ed);
+}
+
+// take a reference to the current version; safe from any thread, never blocks
+CodeinSnapshot *codein_snapshot_acquire(Codein *ed)
+{
+    atomic_fetch_add(&ed->readers_entering, 1);
+    CodeinSnapshot *v = atomic_load(&ed->current_version);
+    if (v) atomic_fetch_add(&v->refs, 1);
+    atomic_fetch_sub(&ed->readers_entering, 1);
+    return v;
+}
+
+void codein_snapshot_release(CodeinSnapshot *v)
+{
+    if (v) atomic_fetch_sub(&v->refs, 1);
+}
+
+int codein_snapshot_num_lines(const CodeinSnapshot *v)
+{
+    return v->num_lines;
+}
+
+const char *codein_snapshot_line(const CodeinSnapshot *v, int y)
+{
+    return y >= 0 && y < v->num_lines ? v->lines[y] : NULL;
+}
+
+unsigned long codein_snapshot_version(const CodeinSnapshot *v)
+{
+    return v->version;
+}
+
+static void bell(Codein *ed)
+{
+    if (ed->batch_depth == 0 && ed->bell) ed->bell(ed->bell_arg);
+}
+
+static void changed(Codein *ed, int y, int x, const char *removed, const char *inserted)
+{
+    if (ed->change) ed->change(ed->change_arg, y, x, removed, inserted);
+}
+
+void codein_begin_batch(Codein *ed)
+{
+    if (ed->batch_depth++ == 0) ed->batch_undo_pushed = 0;
+}
+
+void codein_end_batch(Codein *ed)
+{
+    ed->batch_depth--;
+}
+
+int codein_in_batch(const Codein *ed)
+{
+    return ed->batch_depth > 0;
+}
+
+static void free_snapshot(UndoSnapshot *s)
+{
+    if (!s->lines) return;
+    for (int i = 0; i < s->num_lines; ++i) free(s->lines[i]);
+    free(s->lines);
+    free(s->hashes);
+    s->lines = NULL;
+    s->hashes = NULL;
+    s->num_lines = 0;
+}
+
+// copy the live buffer into a snapshot; returns -1 on allocation failure
+static int capture_snapshot(Codein *ed, UndoSnapshot *s)
+{
+    s->num_lines = ed->num_lines;
+    s->lines = malloc(sizeof(char*) * s->num_lines);
+    s->hashes = malloc(sizeof(uint64_t) * s->num_lines);
+    if (!s->lines || !s->hashes) {
+        free(s->lines);
+        free(s->hashes);
+        s->lines = NULL;
+        s->hashes = NULL;
+        s->num_lines = 0;
+        return -1;
+    }
+    for (int i = 0; i < s->num_lines; ++i) s->lines[i] = strdup(ed->lines[i]);
+    memcpy(s->hashes, ed->line_hash, sizeof(uint64_t) * s->num_lines);
+    s->cur_x = ed->cur_x; s->cur_y = ed->cur_y; s->top_line = ed->top_line;
+    return 0;
+}
+
+// replace the live buffer with a snapshot's contents, consuming the snapshot
+static void restore_snapshot(Codein *ed, UndoSnapshot *s)
+{
+    if (reserve_lines(ed, s->num_lines) < 0) return;
+    // free current buffer
+    for (int i = 0; i < ed->num_lines; ++i) retire_line(ed, ed->lines[i]);
+    // copy snapshot into current buffer
+    for (int i = 0; i < s->num_lines; ++i) ed->lines[i] = s->lines[i];
+    memcpy(ed->line_hash, s->hashes, sizeof(uint64_t) * s->num_lines);
+    ed->num_lines = s->num_lines;
+    ed->cur_x = s->cur_x; ed->cur_y = s->cur_y; ed->top_line = s->top_line;
+    mark_stale_from(ed, 0, 1);
+    // line pointers now belong to the buffer, only drop the arrays
+    free(s->lines);
+    free(s->hashes);
+    s->lines = NULL;
+    s->hashes = NULL;
+    s->num_lines = 0;
+}
+
+static void push_undo(Codein *ed)
+{
+    PROF_SCOPE(PROF_PUSH_UNDO);
+    if (ed->batch_depth > 0) {
+        // one record for the whole batch, taken before its first edit
+        if (ed->batch_undo_pushed) return;
+        ed->batch_undo_pushed = 1;
+    }
+    if (ed->undo_count == UNDO_DEPTH) {
+        // drop oldest
+        free_snapshot(&ed->undo_stack[0]);
+        memmove(&ed->undo_stack[0], &ed->undo_stack[1], sizeof(UndoSnapshot) * (UNDO_DEPTH - 1));
+        ed->undo_count--;
+    }
+    if (capture_snapshot(ed, &ed->undo_stack[ed->undo_count]) < 0) return;
+    ed->undo_count++;
+    // clear redo stack on new action
+    for (int i = 0; i < ed->redo_count; ++i) free_snapshot(&ed->redo_stack[i]);
+    ed->redo_count = 0;
+}
+
+void codein_undo(Codein *ed)
+{
+    PROF_SCOPE(PROF_UNDO);
+    if (ed->undo_count == 0) {
+        bell(ed);
+        return;
+    }
+    // get last snapshot
+    UndoSnapshot *s = &ed->undo_stack[ed->undo_count - 1];
+    // save current state to redo stack
+    if (ed->redo_count == UNDO_DEPTH) {
+        // redo stack full, drop oldest
+        free_snapshot(&ed->redo_stack[0]);
+        memmove(&ed->redo_stack[0], &ed->redo_stack[1], sizeof(UndoSnapshot) * (UNDO_DEPTH - 1));
+        ed->redo_count--;
+    }
+    if (capture_snapshot(ed, &ed->redo_stack[ed->redo_count]) == 0) ed->redo_count++;
+    restore_snapshot(ed, s);
+    // remove snapshot from stack
+    ed->undo_count--;
+    changed(ed, -1, 0, NULL, NULL);
+}
+
+void codein_redo(Codein *ed)
+{
+    PROF_SCOPE(PROF_REDO);
+    if (ed->redo_count == 0) {
+        bell(ed);
+        return;
+    }
+    // get last snapshot from redo stack
+    UndoSnapshot *r = &ed->redo_stack[ed->redo_count - 1];
+    // save current state to undo stack
+    if (ed->undo_count == UNDO_DEPTH) {
+        // undo stack full, drop oldest
+        free_snapshot(&ed->undo_stack[0]);
+        memmove(&ed->undo_stack[0], &ed->undo_stack[1], sizeof(UndoSnapshot) * (UNDO_DEPTH - 1));
+        ed->undo_count--;
+    }
+    if (capture_snapshot(ed, &ed->undo_stack[ed->undo_count]) == 0) ed->undo_count++;
+    restore_snapshot(ed, r);
+    // remove snapshot from redo stack
+    ed->redo_count--;
+    changed(ed, -1, 0, NULL, NULL);
+}
+
+static void mem_add(CodeinMemUse *u, const void *p, size_t requested)
+{
+    if (!p) return;
+    u->requested += requested;
+    // glibc keeps one size_t header in front of every chunk
+    u->allocated += malloc_usable_size((void *)p) + sizeof(size_t);
+}
+
+static void mem_add_lines(CodeinMemUse *u, char *const *src, int n)
+{
+    for (int i = 0; i < n; ++i) mem_add(u, src[i], strlen(src[i]) + 1);
+}
+
+static void mem_add_stack(CodeinMemUse *u, const UndoSnapshot *stack, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        const UndoSnapshot *s = &stack[i];
+        mem_add_lines(u, s->lines, s->num_lines);
+        mem_add(u, s->lines, sizeof(char*) * s->num_lines);
+        mem_add(u, s->hashes, sizeof(uint64_t) * s->num_lines);
+    }
+}
+
+// walk every allocation the context owns; owning thread only
+void codein_mem(Codein *ed, CodeinMem *m)
+{
+    memset(m, 0, sizeof(*m));
+    mem_add_lines(&m->line_text, ed->lines, ed->num_lines);
+    int nblocks = nblocks_for(ed->cap);
+    mem_add(&m->line_index, ed, sizeof(*ed));
+    mem_add(&m->line_index, ed->lines, sizeof(char*) * ed->cap);
+    mem_add(&m->line_index, ed->line_hash, sizeof(uint64_t) * ed->cap);
+    mem_add(&m->line_index, ed->block_hash, sizeof(uint64_t) * nblocks);
+    mem_add(&m->line_index, ed->saved_block_hash, sizeof(uint64_t) * nblocks);
+    mem_add(&m->line_index, ed->block_stale, nblocks);
+    mem_add_stack(&m->undo, ed->undo_stack, ed->undo_count);
+    mem_add_stack(&m->redo, ed->redo_stack, ed->redo_count);
+    for (CodeinSnapshot *v = ed->oldest_version; v; v = v->next) {
+        mem_add(&m->snapshots, v, sizeof(*v));
+        mem_add(&m->snapshots, v->lines, sizeof(char*) * v->num_lines);
+        mem_add(&m->snapshots, v->hashes, sizeof(uint64_t) * v->num_lines);
+        mem_add(&m->snapshots, v->retired, sizeof(char*) * v->retired_cap);
+        mem_add_lines(&m->snapshots, v->retired, v->nretired);
+    }
+}
+
+static void search_forward(Codein *ed)
+{
+    PROF_SCOPE(PROF_SEARCH);
+    ed->search_failed = 1;
+    if (!ed->search_query[0]) {
+        bell(ed);
+        return;
+    }
+    int start_y = ed->cur_y, start_x = ed->cur_x + 1;
+    int len = strlen(ed->lines[start_y]);
+    if (start_x > len) start_x = len; // the cursor may sit past the last character
+    // search from current position forward
+    for (int y = start_y; y < ed->num_lines; ++y) {
+        char *line = ed->lines[y];
+        int search_from = (y == start_y) ? start_x : 0;
+        char *p = strstr(line + search_from, ed->search_query);
+        if (p) {
+            ed->cur_y = y;
+            ed->cur_x = p - line;
+            ed->search_failed = 0;
+            return;
+        }
+    }
+    // wrap around: search from beginning, up to the start line's text before the cursor
+    for (int y = 0; ed->search_wrap && y <= start_y; ++y) {
+        char *line = ed->lines[y];
+        char *p = strstr(line, ed->search_query);
+        if (p) {
+            ed->cur_y = y;
+            ed->cur_x = p - line;
+            ed->search_failed = 0;
+            return;
+        }
+    }
+    bell(ed); // not found
+}
+
+int codein_search(Codein *ed, const char *query)
+{
+    if (query) {
+        strncpy(ed->search_query, query, MAX_SEARCH - 1);
+        ed->search_query[MAX_SEARCH - 1] = '\0';
+    }
+    search_forward(ed);
+    return !ed->search_failed;
+}
+
+void codein_set_search_wrap(Codein *ed, int wrap)
+{
+    ed->search_wrap = wrap;
+}
+
+// drop the buffer, its history and cursor before loading something else
+static void clear_buffer(Codein *ed)
+{
+    for (int i = 0; i < ed->num_lines; ++i) retire_line(ed, ed->lines[i]);
+    ed->num_lines = 0;
+    for (int i = 0; i < ed->undo_count; ++i) free_snapshot(&ed->undo_stack[i]);
+    for (int i = 0; i < ed->redo_count; ++i) free_snapshot(&ed->redo_stack[i]);
+    ed->undo_count = ed->redo_count = 0;
+    ed->cur_x = ed->cur_y = ed->top_line = 0;
+    ed->filename[0] = '\0';
+    ed->on_disk = 0;
+    ed->format = (FileFormat){ .encoding = ENC_UTF8, .final_newline = 1 };
+    mark_stale_from(ed, 0, 1);
+}
+
+// a buffer always has at least one line
+static void empty_buffer(Codein *ed)
+{
+    set_line(ed, 0, strdup(""));
+    ed->num_lines = 1;
+    mark_saved(ed);
+}
+
+// append n bytes to a growable buffer; -1 on allocation failure
+static int append_bytes(char **buf, size_t *len, size_t *cap, const char *s, size_t n)
+{
+    if (*len + n > *cap) {
+        size_t ncap = *cap ? *cap : 256;
+        while (ncap < *len + n) ncap *= 2;
+        char *nb = realloc(*buf, ncap);
+        if (!nb) return -1;
+        *buf = nb;
+        *cap = ncap;
+    }
+    memcpy(*buf + *len, s, n);
+    *len += n;
+    return 0;
+}
+
+// line endings seen while loading
+typedef struct {
+    int terminated;             // lines ending in a newline
+    int *cr;                    // those of them with a CR before it
+    int ncr, cr_cap;
+} LoadEol;
+
+// append one line of the file; len excludes the newline
+static int load_line(Codein *ed, const char *s, size_t len)
+{
+    if (reserve_lines(ed, ed->num_lines + 1) < 0) return -1;
+    char *ln = strndup(s, len);
+    if (!ln) return -1;
+    set_line(ed, ed->num_lines, ln);
+    ed->num_lines++;
+    return 0;
+}
+
+// a line that ended in a newline: a CR before it is stripped and noted
+static int load_terminated(Codein *ed, const char *s, size_t len, LoadEol *eol)
+{
+    eol->terminated++;
+    if (len > 0 && s[len - 1] == '\r') {
+        if (eol->ncr == eol->cr_cap) {
+            int ncap = eol->cr_cap ? eol->cr_cap * 2 : 1024;
+            int *nc = realloc(eol->cr, sizeof(int) * ncap);
+            if (!nc) return -1;
+            eol->cr = nc;
+            eol->cr_cap = ncap;
+        }
+        eol->cr[eol->ncr++] = ed->num_lines;
+        len--;
+    }
+    return load_line(ed, s, len);
+}
+
+// CRLF only if every line had it; otherwise the CRs go back into the text
+static int settle_eol(Codein *ed, const LoadEol *eol)
+{
+    ed->format.crlf = eol->terminated > 0 && eol->ncr == eol->terminated;
+    if (ed->format.crlf) return 0;
+    for (int i = 0; i < eol->ncr; ++i) {
+        int y = eol->cr[i];
+        size_t len = strlen(ed->lines[y]);
+        char *ln = malloc(len + 2);
+        if (!ln) return -1;
+        memcpy(ln, ed->lines[y], len);
+        memcpy(ln + len, "\r", 2);
+        retire_line(ed, ed->lines[y]);
+        set_line(ed, y, ln);
+    }
+    return 0;
+}
+
+/*
+ * Read the file a chunk at a time. UTF-8 is validated and split into
+ * lines in place; other encodings are decoded into a second buffer
+ * first. The encoding is sniffed from the first chunk. Text that fails
+ * to validate as UTF-8 is reloaded from the start as Windows-1252, or,
+ * if the stream cannot seek back, only its remainder is decoded so.
+ * Line endings are kept as found: CRLF for the file when every line has
+ * it, and a CR left in the text of each line that has one otherwise.
+ */
+static int load_stream(Codein *ed, FILE *f)
+{
+    unsigned char *raw = malloc(LOAD_CHUNK + 4);
+    char *out = malloc(LOAD_CHUNK * 3 + 12);
+    char *part = NULL; // a line continued from the previous chunk
+    size_t plen = 0, pcap = 0, carry = 0;
+    LoadEol eol = {0};
+    int status = raw && out ? 0 : -1, first = 1, force = -1;
+    while (status == 0) {
+        size_t n = fread(raw + carry, 1, LOAD_CHUNK, f);
+        int eof = n == 0;
+        n += carry;
+        if (n == 0) break;
+        size_t skip = 0, used = n, tlen;
+        if (first) {
+            size_t bom;
+            ed->format.encoding = enc_sniff(raw, n, &bom);
+            if (force >= 0) ed->format.encoding = force;
+            else skip = bom;
+            ed->format.bom = skip > 0;
+            first = 0;
+        }
+        const char *text = (const char *)raw + skip;
+        if (ed->format.encoding == ENC_UTF8) {
+            if (!eof) used = utf8_cut((const char *)raw, n);
+            tlen = used - skip;
+            if (!utf8_valid(text, tlen)) {
+                if (fseek(f, 0, SEEK_SET) == 0) {
+                    for (int i = 0; i < ed->num_lines; ++i) retire_line(ed, ed->lines[i]);
+                    ed->num_lines = 0;
+                    mark_stale_from(ed, 0, 1);
+                    plen = carry = 0;
+                    eol.terminated = eol.ncr = 0;
+                    first = 1;
+                    force = ENC_CP1252;
+                    continue;
+                }
+                ed->format.encoding = ENC_CP1252;
+            }
+        }
+        if (ed->format.encoding != ENC_UTF8) {
+            used = skip + enc_decode(ed->format.encoding, raw + skip, n - skip, out, &tlen);
+            if (eof) used = n; // an odd byte at the very end is dropped
+            text = out;
+        }
+        const char *p = text, *end = text + tlen, *nl;
+        while (status == 0 && (nl = memchr(p, '\n', end - p)) != NULL) {
+            if (plen) {
+                status = append_bytes(&part, &plen, &pcap, p, nl - p);
+                if (status == 0) status = load_terminated(ed, part, plen, &eol);
+                plen = 0;
+            } else {
+                status = load_terminated(ed, p, nl - p, &eol);
+            }
+            p = nl + 1;
+        }
+        if (status == 0 && p < end) status = append_bytes(&part, &plen, &pcap, p, end - p);
+        carry = n - used;
+        memmove(raw, raw + used, carry);
+        if (eof) break;
+    }
+    // an empty file has no line to terminate
+    ed->format.final_newline = eol.terminated > 0 && !plen;
+    if (status == 0 && plen) status = load_line(ed, part, plen);
+    if (status == 0) status = settle_eol(ed, &eol);
+    if (ferror(f)) status = -1;
+    free(eol.cr);
+    free(part);
+    free(out);
+    free(raw);
+    return status;
+}
+
+static int load_file(Codein *ed, const char *path)
+{
+    FILE *f;
+    clear_buffer(ed);
+    if (!path) {
+        empty_buffer(ed);
+        return 0;
+    }
+    codein_set_filename(ed, path);
+    f = fopen(path, "r");
+    if (!f) {
+        empty_buffer(ed);
+        return 0;
+    }
+    int status = load_stream(ed, f);
+    fclose(f);
+    if (ed->num_lines == 0) empty_buffer(ed); // an empty file
+    else mark_saved(ed);
+    ed->on_disk = 1;
+    return status;
+}
+
+int codein_load(Codein *ed, const char *path)
+{
+    int status = load_file(ed, path);
+    changed(ed, -1, 0, NULL, NULL);
+    return status;
+}
+
+size_t codein_append(Codein *ed, const char *text, size_t len)
+{
+    int unmodified = ed->on_disk && !codein_modified(ed);
+    // the first line read continues the last one when that is unterminated:
+    // the file ended without a newline or was empty, or the buffer is new
+    // and holds only its placeholder line. "\n" on disk is one real line.
+    int join = ed->on_disk ? !ed->format.final_newline : ed->num_lines == 1 && !ed->lines[0][0];
+    size_t used = 0;
+    const char *nl;
+    while ((nl = memchr(text + used, '\n', len - used)) != NULL) {
+        size_t n = nl - (text + used);
+        if (n > 0 && text[used + n - 1] == '\r' && ed->format.crlf) n--;
+        char *ln;
+        if (join) {
+            const char *last = ed->lines[ed->num_lines - 1];
+            size_t llen = strlen(last);
+            ln = malloc(llen + n + 1);
+            if (ln) {
+                memcpy(ln, last, llen);
+                memcpy(ln + llen, text + used, n);
+                ln[llen + n] = '\0';
+            }
+        } else {
+            ln = strndup(text + used, n);
+        }
+        if (!ln) break;
+        if (join) {
+            retire_line(ed, ed->lines[ed->num_lines - 1]);
+            set_line(ed, ed->num_lines - 1, ln);
+            join = 0;
+        } else if (reserve_lines(ed, ed->num_lines + 1) == 0) {
+            set_line(ed, ed->num_lines, ln);
+            ed->num_lines++;
+        } else {
+            free(ln);
+            break;
+        }
+        used = nl - text + 1;
+    }
+    if (used) ed->format.final_newline = 1;
+    // what was read is on disk, so an unmodified buffer stays unmodified
+    if (used && unmodified) mark_saved(ed);
+    if (used) changed(ed, -1, 0, NULL, NULL);
+    return used;
+}
+
+static int write_lines(const char *p, char *const *src, int n, const FileFormat *fmt)
+{
+    FILE *f = fopen(p, "w");
+    if (!f) return -1;
+    int enc = fmt->encoding, status = fmt->bom ? enc_write_bom(f, enc) : 0;
+    const char *eol = fmt->crlf ? "\r\n" : "\n";
+    for (int i = 0; i < n && status == 0; ++i) {
+        // the last line is left unterminated if it was in the file
+        const char *end = i < n - 1 || fmt->final_newline ? eol : "";
+        if (enc == ENC_UTF8) fprintf(f, "%s%s", src[i], end);
+        else if (enc_write(f, enc, src[i], strlen(src[i])) < 0 || enc_write(f, enc, end, strlen(end)) < 0) status = -1;
+    }
+    if (fclose(f) != 0) return -1;
+    return status;
+}
+
+int codein_snapshot_write(const CodeinSnapshot *s, const char *path)
+{
+    return write_lines(path, s->lines, s->num_lines, &s->format);
+}
+
+int codein_snapshot_export(const CodeinSnapshot *s, const char *name)
+{
+    uint64_t text_size = 0;
+    for (int i = 0; i < s->num_lines; ++i) text_size += strlen(s->lines[i]) + 1;
+    CodeinExportHeader h = { .header_size = sizeof(h), .version = s->version, .num_lines = s->num_lines };
+    memcpy(h.magic, CODEIN_EXPORT_MAGIC, sizeof(h.magic));
+    h.index_offset = sizeof(h);
+    h.text_offset = h.index_offset + sizeof(uint64_t) * (s->num_lines + 1);
+    h.text_size = text_size;
+    size_t size = h.text_offset + text_size;
+
+    int fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) return -1;
+    char *p = MAP_FAILED;
+    if (ftruncate(fd, size) == 0) p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    memcpy(p, &h, sizeof(h));
+    uint64_t *index = (uint64_t *)(p + h.index_offset);
+    char *text = p + h.text_offset;
+    uint64_t off = 0;
+    for (int i = 0; i < s->num_lines; ++i) {
+        size_t len = strlen(s->lines[i]);
+        index[i] = off;
+        memcpy(text + off, s->lines[i], len);
+        text[off + len] = '\n';
+        off += len + 1;
+    }
+    index[s->num_lines] = off;
+    munmap(p, size);
+    // no writable mapping is left, so the write seal can be applied
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// synchronous save of the live buffer; a NULL path saves to filename
+int codein_save(Codein *ed, const char *path)
+{
+    const char *p = path ? path : ed->filename;
+    if (!p || p[0] == '\0') return -1;
+    if (write_lines(p, ed->lines, ed->num_lines, &ed->format) < 0) return -1;
+    if (p == ed->filename || strcmp(p, ed->filename) == 0) {
+        mark_saved(ed);
+        ed->on_disk = 1;
+    }
+    return 0;
+}
+
+const char *codein_filename(const Codein *ed)
+{
+    return ed->filename;
+}
+
+void codein_set_filename(Codein *ed, const char *path)
+{
+    strncpy(ed->filename, path, sizeof(ed->filename) - 1);
+    ed->filename[sizeof(ed->filename) - 1] = '\0';
+}
+
+int codein_on_disk(const Codein *ed)
+{
+    return ed->on_disk;
+}
+
+int codein_encoding(const Codein *ed)
+{
+    return ed->format.encoding;
+}
+
+const CodeinFormat *codein_format(const Codein *ed)
+{
+    return &ed->format;
+}
+
+void codein_insert_char(Codein *ed, int c)
+{
+    PROF_SCOPE(PROF_INSERT_CHAR);
+    // record undo before mutating
+    push_undo(ed);
+    // wrap to newline when reaching screen width
+    if (ed->view_cols > 0 && ed->cur_x >= ed->view_cols - 1) {
+        codein_newline(ed);
+        return;
+    }
+    char *ln = ed->lines[ed->cur_y];
+    int len = strlen(ln);
+    if (len + 2 >= MAX_COL) return;
+    char *newl = malloc(len + 2);
+    if (!newl) return;
+    memcpy(newl, ln, ed->cur_x);
+    newl[ed->cur_x] = (char)c;
+    memcpy(newl + ed->cur_x + 1, ln + ed->cur_x, len - ed->cur_x + 1);
+    retire_line(ed, ed->lines[ed->cur_y]);
+    set_line(ed, ed->cur_y, newl);
+    ed->cur_x++;
+    char typed[2] = { (char)c, '\0' };
+    changed(ed, ed->cur_y, ed->cur_x - 1, "", typed);
+}
+
+void codein_backspace(Codein *ed)
+{
+    PROF_SCOPE(PROF_BACKSPACE);
+    push_undo(ed);
+    int y = ed->cur_y;
+    if (ed->cur_x > 0) {
+        // lines may be shared with snapshots, so copy instead of memmove
+        char *ln = ed->lines[y];
+        int len = strlen(ln);
+        // a whole character: half a sequence would not survive the save
+        int from = utf8_prev(ln, ed->cur_x), n = ed->cur_x - from;
+        char *newl = malloc(len - n + 1);
+        if (!newl) return;
+        char gone[5];
+        memcpy(gone, ln + from, n);
+        gone[n] = '\0';
+        memcpy(newl, ln, from);
+        memcpy(newl + from, ln + ed->cur_x, len - ed->cur_x + 1);
+        retire_line(ed, ln);
+        set_line(ed, y, newl);
+        ed->cur_x = from;
+        changed(ed, y, ed->cur_x, gone, "");
+    } else if (y > 0) {
+        int prev_len = strlen(ed->lines[y-1]);
+        int cur_len = strlen(ed->lines[y]);
+        if (prev_len + cur_len + 1 >= MAX_COL) return;
+        char *newl = malloc(prev_len + cur_len + 1);
+        if (!newl) return;
+        strcpy(newl, ed->lines[y-1]);
+        strcat(newl, ed->lines[y]);
+        retire_line(ed, ed->lines[y-1]);
+        set_line(ed, y-1, newl);
+        retire_line(ed, ed->lines[y]);
+        // shift lines up
+        memmove(&ed->lines[y], &ed->lines[y+1], sizeof(char*) * (ed->num_lines - 1 - y));
+        memmove(&ed->line_hash[y], &ed->line_hash[y+1], sizeof(uint64_t) * (ed->num_lines - 1 - y));
+        mark_stale_from(ed, y, 1);
+        ed->num_lines--;
+        ed->cur_y--;
+        ed->cur_x = prev_len;
+        changed(ed, y - 1, prev_len, "\n", "");
+    }
+}
+
+void codein_newline(Codein *ed)
+{
+    PROF_SCOPE(PROF_NEWLINE);
+    push_undo(ed);
+    if (reserve_lines(ed, ed->num_lines + 1) < 0) return;
+    int y = ed->cur_y;
+    char *ln = ed->lines[y];
+    // split at cur_x
+    char *left = malloc(ed->cur_x + 1);
+    char *right = strdup(ln + ed->cur_x);
+    if (!left || !right) {
+        free(left);
+        free(right);
+        return;
+    }
+    memcpy(left, ln, ed->cur_x);
+    left[ed->cur_x] = '\0';
+    retire_line(ed, ln);
+    set_line(ed, y, left);
+    // insert right as new line
+    memmove(&ed->lines[y+2], &ed->lines[y+1], sizeof(char*) * (ed->num_lines - y - 1));
+    memmove(&ed->line_hash[y+2], &ed->line_hash[y+1], sizeof(uint64_t) * (ed->num_lines - y - 1));
+    set_line(ed, y+1, right);
+    mark_stale_from(ed, y + 1, 1);
+    ed->num_lines++;
+    ed->cur_y++;
+    ed->cur_x = 0;
+    changed(ed, y, (int)strlen(left), "", "\n");
+}
+
+// forward delete: the character under the cursor, or join the next line
+void codein_delete_char(Codein *ed)
+{
+    PROF_SCOPE(PROF_DELETE_CHAR);
+    int len = strlen(ed->lines[ed->cur_y]);
+    if (ed->cur_x < len) {
+        ed->cur_x = utf8_next(ed->lines[ed->cur_y], ed->cur_x);
+        codein_backspace(ed);
+    } else if (ed->cur_y < ed->num_lines - 1) {
+        ed->cur_y++;
+        ed->cur_x = 0;
+        codein_backspace(ed);
+    } else {
+        bell(ed);
+    }
+}
+
+// clamp and move the cursor to line y, column x
+void codein_goto(Codein *ed, int y, int x)
+{
+    if (y >= ed->num_lines) y = ed->num_lines - 1;
+    if (y < 0) y = 0;
+    const char *ln = ed->lines[y];
+    int l = strlen(ln);
+    if (x > l) x = l;
+    if (x < 0) x = 0;
+    // inside a multibyte character: back to its start
+    if (x < l && (ln[x] & 0xc0) == 0x80 && utf8_next(ln, utf8_prev(ln, x)) > x) x = utf8_prev(ln, x);
+    ed->cur_y = y;
+    ed->cur_x = x;
+}
+
+void codein_move_up(Codein *ed)
+{
+    if (ed->cur_y > 0) codein_goto(ed, ed->cur_y - 1, ed->cur_x);
+}
+
+void codein_move_down(Codein *ed)
+{
+    if (ed->cur_y < ed->num_lines - 1) codein_goto(ed, ed->cur_y + 1, ed->cur_x);
+}
+
+void codein_move_left(Codein *ed)
+{
+    if (ed->cur_x > 0) ed->cur_x = utf8_prev(ed->lines[ed->cur_y], ed->cur_x);
+    else if (ed->cur_y > 0) {
+        ed->cur_y--;
+        ed->cur_x = strlen(ed->lines[ed->cur_y]);
+    }
+}
+
+void codein_move_right(Codein *ed)
+{
+    int l = strlen(ed->lines[ed->cur_y]);
+    if (ed->cur_x < l) ed->cur_x = utf8_next(ed->lines[ed->cur_y], ed->cur_x);
+    else if (ed->cur_y < ed->num_lines - 1) {
+        ed->cur_y++;
+        ed->cur_x = 0;
+    }
+}
+
+// replace every occurrence of `from` as one undo step; returns the count
+int codein_replace_all(Codein *ed, const char *from, const char *to)
+{
+    int flen = strlen(from), tlen = strlen(to), total = 0;
+    if (flen == 0) return 0;
+    for (int y = 0; y < ed->num_lines; ++y) {
+        const char *ln = ed->lines[y];
+        int hits = 0;
+        for (const char *p = strstr(ln, from); p; p = strstr(p + flen, from)) hits++;
+        if (hits == 0) continue;
+        int nlen = strlen(ln) + hits * (tlen - flen);
+        if (nlen + 1 >= MAX_COL) continue;
+        char *newl = malloc(nlen + 1), *o = newl;
+        if (!newl) continue;
+        if (total == 0) push_undo(ed);
+        const char *p, *s = ln;
+        while ((p = strstr(s, from))) {
+            memcpy(o, s, p - s);
+            o += p - s;
+            memcpy(o, to, tlen);
+            o += tlen;
+            s = p + flen;
+        }
+        strcpy(o, s);
+        retire_line(ed, ed->lines[y]);
+        set_line(ed, y, newl);
+        total += hits;
+    }
+    codein_goto(ed, ed->cur_y, ed->cur_x);
+    if (total) changed(ed, -1, 0, NULL, NULL);
+    return total;
+}
+
+void codein_page_up(Codein *ed)
+{
+    int visible = ed->view_rows;
+    if (visible <= 0) visible = 1;
+    if (ed->cur_y == 0) {
+        ed->top_line = 0;
+        return;
+    }
+    if (ed->cur_y - visible < 0) ed->cur_y = 0;
+    else ed->cur_y -= visible;
+    if (ed->top_line > ed->cur_y) ed->top_line = ed->cur_y;
+    int l = strlen(ed->lines[ed->cur_y]);
+    if (ed->cur_x > l) ed->cur_x = l;
+}
+
+void codein_page_down(Codein *ed)
+{
+    int visible = ed->view_rows;
+    if (visible <= 0) visible = 1;
+    if (ed->cur_y >= ed->num_lines - 1) {
+        ed->top_line = ed->num_lines > visible ? ed->num_lines - visible : 0;
+        return;
+    }
+    if (ed->cur_y + visible >= ed->num_lines - 1) ed->cur_y = ed->num_lines - 1;
+    else ed->cur_y += visible;
+    int desired_top = ed->cur_y - visible + 1;
+    if (desired_top < 0) desired_top = 0;
+    ed->top_line = desired_top;
+    int l = strlen(ed->lines[ed->cur_y]);
+    if (ed->cur_x > l) ed->cur_x = l;
+}
+
+void codein_scroll_to_cursor(Codein *ed, int rows)
+{
+    int visible = rows > 0 ? rows : 1;
+    if (ed->cur_y >= ed->num_lines) ed->cur_y = ed->num_lines - 1;
+    if (ed->cur_y < 0) ed->cur_y = 0;
+    if (ed->cur_x < 0) ed->cur_x = 0;
+    if (ed->cur_y < ed->top_line) ed->top_line = ed->cur_y;
+    else if (ed->cur_y >= ed->top_line + visible) ed->top_line = ed->cur_y - visible + 1;
+}
+
+int codein_num_lines(const Codein *ed)
+{
+    return ed->num_lines;
+}
+
+const char *codein_line(const Codein *ed, int y)
+{
+    return y >= 0 && y < ed->num_lines ? ed->lines[y] : NULL;
+}
+
+void codein_cursor(const Codein *ed, int *y, int *x)
+{
+    if (y) *y = ed->cur_y;
+    if (x) *x = ed->cur_x;
+}
+
+int codein_top_line(const Codein *ed)
+{
+    return ed->top_line;
+}
+
+void codein_set_top_line(Codein *ed, int y)
+{
+    if (y >= ed->num_lines) y = ed->num_lines - 1;
+    ed->top_line = y > 0 ? y : 0;
+}
+
+unsigned long codein_version(const Codein *ed)
+{
+    return ed->version;
+}
+
+void codein_set_view(Codein *ed, int rows, int cols)
+{
+    ed->view_rows = rows;
+    ed->view_cols = cols;
+}
+
+void codein_set_bell(Codein *ed, void (*fn)(void *arg), void *arg)
+{
+    ed->bell = fn;
+    ed->bell_arg = arg;
+}
+
+void codein_set_change_hook(Codein *ed,
+                            void (*fn)(void *arg, int y, int x, const char *removed, const char *inserted),
+                            void *arg)
+{
+    ed->change = fn;
+    ed->change_arg = arg;
+}
+
+Codein *codein_new(void)
+{
+    Codein *ed = calloc(1, sizeof(*ed));
+    if (!ed) return NULL;
+    ed->search_wrap = 1;
+    ed->saved_num_lines = -1;
+    ed->format.final_newline = 1;
+    if (reserve_lines(ed, 1) < 0) {
+        codein_free(ed);
+        return NULL;
+    }
+    empty_buffer(ed);
+    return ed;
+}
+
+// readers must have released every snapshot
+void codein_free(Codein *ed)
+{
+    if (!ed) return;
+    for (int i = 0; i < ed->num_lines; ++i) retire_line(ed, ed->lines[i]);
+    for (int i = 0; i < ed->undo_count; ++i) free_snapshot(&ed->undo_stack[i]);
+    for (int i = 0; i < ed->redo_count; ++i) free_snapshot(&ed->redo_stack[i]);
+    while (ed->oldest_version) {
+        CodeinSnapshot *v = ed->oldest_version;
+        ed->oldest_version = v->next;
+        free_version(v);
+    }
+    free(ed->lines);
+    free(ed->line_hash);
+    free(ed->block_hash);
+    free(ed->block_stale);
+    free(ed->saved_block_hash);
+    free(ed);
+}
@@ -0,0 +1,109 @@
+/*
+ * Editing core internals of libcodein
+ * - Context and snapshot layouts, for the library's own sources only;
+ *   the front ends and tools go through codein.h
+ * - Line strings are never modified in place: an edit allocates a new
+ *   line and retires the old one, so snapshots can share them
+ */
+
+#ifndef CODEIN_EDITOR_H
+#define CODEIN_EDITOR_H
+
+#include "codein.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define MAX_COL 4096
+#define MAX_SEARCH CODEIN_MAX_SEARCH
+
+#define UNDO_DEPTH CODEIN_UNDO_DEPTH
+
+#define HASH_BLOCK 64 // lines per modified-tracking block
+
+typedef CodeinFormat FileFormat;
+
+/*
+ * After a batch of edits the owning thread publishes a snapshot holding
+ * its own copy of the line pointer array. Readers take a reference to
+ * the current one without locking and read it while editing goes on.
+ * Retired lines and old snapshots are freed by the owning thread once no
+ * reader can still reach them.
+ */
+struct CodeinSnapshot {
+    atomic_int refs;            // readers, plus one while current
+    unsigned long version;
+    FileFormat format;          // as in Codein, for writing the snapshot
+    int num_lines;
+    char **lines;               // shared with the live buffer, read-only
+    uint64_t *hashes;
+    char **retired;             // lines dropped while this was the newest version
+    int nretired, retired_cap;
+    struct CodeinSnapshot *next; // next newer version
+};
+
+typedef struct {
+    char **lines;
+    uint64_t *hashes;
+    int num_lines;
+    int cur_x, cur_y, top_line;
+} UndoSnapshot;
+
+struct Codein {
+    char **lines;
+    uint64_t *line_hash;        // FNV-1a of every line
+    int num_lines;
+    int cap;                    // capacity of lines, line_hash and the block tables
+    char filename[1024];
+
+    int cur_x;                  // column index
+    int cur_y;                  // line index
+    int top_line;               // first visible line
+
+    char search_query[MAX_SEARCH];
+    int search_failed;          // last search found nothing
+    int search_wrap;            // search may wrap to the top
+
+    int view_rows;              // text rows; 0 means unbounded (headless)
+    int view_cols;
+    void (*bell)(void *arg);
+    void *bell_arg;
+    void (*change)(void *arg, int y, int x, const char *removed, const char *inserted);
+    void *change_arg;
+
+    unsigned long version;      // bumped on every edit
+    int on_disk;                // saved baseline matches an existing file
+    FileFormat format;          // recorded at load, reproduced on save
+
+    /*
+     * Modified tracking: lines are grouped into blocks of HASH_BLOCK and
+     * each block hash is recomputed lazily when one of its lines changes.
+     * Comparing block hashes against the ones taken at load/save tells
+     * whether (and where) the buffer differs from disk.
+     */
+    uint64_t *block_hash;
+    unsigned char *block_stale;
+    uint64_t *saved_block_hash;
+    int saved_num_lines;        // -1: no baseline recorded yet
+
+    int batch_depth;
+    int batch_undo_pushed;
+
+    UndoSnapshot undo_stack[UNDO_DEPTH];
+    int undo_count;
+    UndoSnapshot redo_stack[UNDO_DEPTH];
+    int redo_count;
+
+    _Atomic(CodeinSnapshot *) current_version;
+    CodeinSnapshot *oldest_version, *newest_version;
+    atomic_int readers_entering;
+};
+
+/*
+ * Fill `changed` (one entry per HASH_BLOCK lines of the longer of the
+ * buffer and the saved content; may be NULL) with the blocks that differ
+ * from the saved content and return how many differ.
+ */
+int codein_changed_blocks(Codein *ed, unsigned char *changed);
+
+#endif
@@ -0,0 +1,282 @@
+/*
+ * Text encodings
+ *
+ * The validator skips ASCII by ORing four 16-byte loads and testing the
+ * sign bits with one movemask (SSE2; eight bytes in a word elsewhere),
+ * then 16 bytes at a time. Where a high bit shows up, sequences are
+ * walked to the end of those 16 bytes, rejecting overlong forms,
+ * surrogates and code points past U+10FFFF, and skipping resumes. Text
+ * with an accent here and there so stays on the vector path; a fully
+ * masked classifier was slower in practice, as it pays for every class
+ * on every block. Decoders write U+FFFD for what cannot be decoded and
+ * never fail.
+ */
+
+#include "encoding.h"
+
+#include <stdint.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define SNIFF_BYTES 4096
+#define WRITE_BUF 4096
+
+// Windows-1252 0x80-0x9f; the five unassigned bytes map to C1 controls
+static const uint16_t cp1252_high[32] = {
+    0x20ac, 0x0081, 0x201a, 0x0192, 0x201e, 0x2026, 0x2020, 0x2021,
+    0x02c6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008d, 0x017d, 0x008f,
+    0x0090, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014,
+    0x02dc, 0x2122, 0x0161, 0x203a, 0x0153, 0x009d, 0x017e, 0x0178,
+};
+
+int enc_sniff(const unsigned char *s, size_t n, size_t *bom)
+{
+    *bom = 0;
+    if (n >= 3 && s[0] == 0xef && s[1] == 0xbb && s[2] == 0xbf) {
+        *bom = 3;
+        return ENC_UTF8;
+    }
+    if (n >= 2 && s[0] == 0xff && s[1] == 0xfe) {
+        *bom = 2;
+        return ENC_UTF16LE;
+    }
+    if (n >= 2 && s[0] == 0xfe && s[1] == 0xff) {
+        *bom = 2;
+        return ENC_UTF16BE;
+    }
+    // BOM-less UTF-16 text is mostly ASCII: NULs at every other byte
+    size_t even = 0, odd = 0, m = n < SNIFF_BYTES ? n & ~(size_t)1 : SNIFF_BYTES;
+    for (size_t i = 0; i < m; i += 2) {
+        even += !s[i];
+        odd += !s[i + 1];
+    }
+    if (m >= 4 && odd * 4 >= m && even * 16 < m) return ENC_UTF16LE;
+    if (m >= 4 && even * 4 >= m && odd * 16 < m) return ENC_UTF16BE;
+    return ENC_UTF8;
+}
+
+const char *enc_name(int enc)
+{
+    static const char *const names[] = { "UTF-8", "UTF-16LE", "UTF-16BE", "Windows-1252" };
+    return enc >= 0 && enc <= ENC_CP1252 ? names[enc] : "UTF-8";
+}
+
+// length of the valid sequence at s, 0 if it is invalid or cut short
+static int utf8_seq(const unsigned char *s, size_t n)
+{
+    unsigned c = s[0];
+    if (c < 0x80) return 1;
+    if (c < 0xc2 || c > 0xf4) return 0;
+    size_t len = c < 0xe0 ? 2 : c < 0xf0 ? 3 : 4;
+    if (n < len) return 0;
+    for (size_t i = 1; i < len; ++i)
+        if ((s[i] & 0xc0) != 0x80) return 0;
+    if ((c == 0xe0 && s[1] < 0xa0) || (c == 0xf0 && s[1] < 0x90)) return 0; // overlong
+    if (c == 0xed && s[1] > 0x9f) return 0; // surrogate
+    if (c == 0xf4 && s[1] > 0x8f) return 0; // past U+10FFFF
+    return len;
+}
+
+// index of the first 16 bytes from i holding a non-ASCII byte
+static size_t skip_ascii(const unsigned char *s, size_t i, size_t n)
+{
+#ifdef __SSE2__
+    for (; i + 64 <= n; i += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(s + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(s + i + 32));
+        __m128i d = _mm_loadu_si128((const __m128i *)(s + i + 48));
+        if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)))) break;
+    }
+    for (; i + 16 <= n; i += 16)
+        if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)(s + i)))) break;
+#else
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, s + i, 8);
+        if (w & 0x8080808080808080ULL) break;
+    }
+#endif
+    return i;
+}
+
+int utf8_valid(const char *str, size_t n)
+{
+    const unsigned char *s = (const unsigned char *)str;
+    size_t i = 0;
+    while (i < n) {
+        i = skip_ascii(s, i, n);
+        // walk sequences to the end of these 16 bytes, then skip again
+        size_t end = i + 16 < n ? i + 16 : n;
+        while (i < end) {
+            int len = utf8_seq(s + i, n - i);
+            if (!len) return 0;
+            i += len;
+        }
+    }
+    return 1;
+}
+
+size_t utf8_cut(const char *str, size_t n)
+{
+    const unsigned char *s = (const unsigned char *)str;
+    for (size_t k = 1; k <= 3 && k <= n; ++k) {
+        unsigned c = s[n - k];
+        if ((c & 0xc0) == 0x80) continue;
+        size_t len = c < 0xc0 ? 1 : c < 0xe0 ? 2 : c < 0xf0 ? 3 : 4;
+        return len > k ? n - k : n;
+    }
+    return n;
+}
+
+// bytes in the sequence a lead byte starts
+static int utf8_lead_len(unsigned c)
+{
+    return c < 0xc0 ? 1 : c < 0xe0 ? 2 : c < 0xf0 ? 3 : 4;
+}
+
+int utf8_prev(const char *str, int x)
+{
+    const unsigned char *s = (const unsigned char *)str;
+    if (x <= 0) return 0;
+    int i = x - 1;
+    while (i > 0 && x - i < 4 && (s[i] & 0xc0) == 0x80) i--;
+    return i + utf8_lead_len(s[i]) >= x && s[i] >= 0xc0 ? i : x - 1;
+}
+
+int utf8_next(const char *str, int x)
+{
+    const unsigned char *s = (const unsigned char *)str;
+    if (!s[x]) return x;
+    int len = utf8_lead_len(s[x]), i = 1;
+    while (i < len && (s[x + i] & 0xc0) == 0x80) i++;
+    return i == len ? x + len : x + 1;
+}
+
+static size_t put_utf8(char *out, uint32_t cp)
+{
+    if (cp < 0x80) {
+        out[0] = cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = 0xc0 | cp >> 6;
+        out[1] = 0x80 | (cp & 0x3f);
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = 0xe0 | cp >> 12;
+        out[1] = 0x80 | (cp >> 6 & 0x3f);
+        out[2] = 0x80 | (cp & 0x3f);
+        return 3;
+    }
+    out[0] = 0xf0 | cp >> 18;
+    out[1] = 0x80 | (cp >> 12 & 0x3f);
+    out[2] = 0x80 | (cp >> 6 & 0x3f);
+    out[3] = 0x80 | (cp & 0x3f);
+    return 4;
+}
+
+size_t enc_decode(int enc, const unsigned char *in, size_t n, char *out, size_t *out_len)
+{
+    size_t i = 0, o = 0;
+    if (enc == ENC_CP1252) {
+        for (; i < n; ++i) {
+            unsigned c = in[i];
+            if (c < 0x80) out[o++] = c;
+            else o += put_utf8(out + o, c < 0xa0 ? cp1252_high[c - 0x80] : c);
+        }
+    } else if (enc == ENC_UTF16LE || enc == ENC_UTF16BE) {
+        int be = enc == ENC_UTF16BE;
+        while (i + 2 <= n) {
+            uint32_t u = be ? in[i] << 8 | in[i + 1] : in[i + 1] << 8 | in[i];
+            if (u >= 0xd800 && u < 0xdc00) {
+                if (i + 4 > n) break; // the low half is in the next chunk
+                uint32_t lo = be ? in[i + 2] << 8 | in[i + 3] : in[i + 3] << 8 | in[i + 2];
+                if (lo >= 0xdc00 && lo < 0xe000) {
+                    o += put_utf8(out + o, 0x10000 + ((u - 0xd800) << 10) + (lo - 0xdc00));
+                    i += 4;
+                    continue;
+                }
+                u = 0xfffd;
+            } else if (u >= 0xdc00 && u < 0xe000) {
+                u = 0xfffd;
+            }
+            o += put_utf8(out + o, u);
+            i += 2;
+        }
+    } else {
+        memcpy(out, in, n);
+        o = i = n;
+    }
+    *out_len = o;
+    return i;
+}
+
+// next code point of UTF-8 text; a byte that starts no valid sequence is -1
+static int32_t next_cp(const unsigned char *s, size_t n, size_t *i)
+{
+    int len = utf8_seq(s + *i, n - *i);
+    const unsigned char *p = s + *i;
+    if (!len) {
+        (*i)++;
+        return -1;
+    }
+    *i += len;
+    if (len == 1) return p[0];
+    if (len == 2) return (p[0] & 0x1f) << 6 | (p[1] & 0x3f);
+    if (len == 3) return (p[0] & 0x0f) << 12 | (p[1] & 0x3f) << 6 | (p[2] & 0x3f);
+    return (p[0] & 0x07) << 18 | (p[1] & 0x3f) << 12 | (p[2] & 0x3f) << 6 | (p[3] & 0x3f);
+}
+
+static int to_cp1252(int32_t cp)
+{
+    if (cp < 0) return '?';
+    if (cp < 0x80 || (cp >= 0xa0 && cp <= 0xff)) return cp;
+    for (int i = 0; i < 32; ++i)
+        if (cp1252_high[i] == cp) return 0x80 + i;
+    return '?';
+}
+
+int enc_write(FILE *f, int enc, const char *str, size_t n)
+{
+    if (enc == ENC_UTF8) return fwrite(str, 1, n, f) == n ? 0 : -1;
+    const unsigned char *s = (const unsigned char *)str;
+    unsigned char buf[WRITE_BUF];
+    size_t i = 0, o = 0;
+    while (i < n) {
+        if (o + 4 > sizeof(buf)) {
+            if (fwrite(buf, 1, o, f) != o) return -1;
+            o = 0;
+        }
+        int32_t cp = next_cp(s, n, &i);
+        if (enc == ENC_CP1252) {
+            buf[o++] = to_cp1252(cp);
+            continue;
+        }
+        if (cp < 0) cp = '?';
+        uint32_t u[2] = { cp, 0 };
+        int units = 1;
+        if (cp >= 0x10000) {
+            u[0] = 0xd800 + ((cp - 0x10000) >> 10);
+            u[1] = 0xdc00 + ((cp - 0x10000) & 0x3ff);
+            units = 2;
+        }
+        for (int k = 0; k < units; ++k) {
+            buf[o++] = enc == ENC_UTF16BE ? u[k] >> 8 : u[k] & 0xff;
+            buf[o++] = enc == ENC_UTF16BE ? u[k] & 0xff : u[k] >> 8;
+        }
+    }
+    return fwrite(buf, 1, o, f) == o ? 0 : -1;
+}
+
+int enc_write_bom(FILE *f, int enc)
+{
+    static const unsigned char utf8[] = { 0xef, 0xbb, 0xbf }, le[] = { 0xff, 0xfe }, be[] = { 0xfe, 0xff };
+    if (enc == ENC_UTF8) return fwrite(utf8, 1, 3, f) == 3 ? 0 : -1;
+    if (enc == ENC_UTF16LE) return fwrite(le, 1, 2, f) == 2 ? 0 : -1;
+    if (enc == ENC_UTF16BE) return fwrite(be, 1, 2, f) == 2 ? 0 : -1;
+    return 0;
+}
@@ -0,0 +1,41 @@
+/*
+ * Text encodings of files on disk
+ * - Buffers always hold UTF-8: a file in another encoding is decoded
+ *   while it loads and encoded back to it when saved
+ * - Detection: a byte order mark, else the NUL pattern of UTF-16, else
+ *   UTF-8 if the whole file validates, else Windows-1252 (Latin-1 plus
+ *   the printable characters Windows puts in 0x80-0x9f)
+ * - Validation skips ASCII a vector at a time, so plain UTF-8 files pay
+ *   about one compare per 64 bytes
+ */
+
+#ifndef CODEIN_ENCODING_H
+#define CODEIN_ENCODING_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+enum { ENC_UTF8, ENC_UTF16LE, ENC_UTF16BE, ENC_CP1252 };
+
+// guess from the first bytes of a file; *bom is set to the BOM length.
+// ENC_UTF8 without a BOM only means "not recognizably anything else".
+int enc_sniff(const unsigned char *s, size_t n, size_t *bom);
+const char *enc_name(int enc);
+
+int utf8_valid(const char *s, size_t n);
+// length of s up to its last complete sequence (0-3 bytes shorter)
+size_t utf8_cut(const char *s, size_t n);
+// byte columns of the character before / after column x of a line, so
+// the cursor never lands inside a sequence; a stray byte counts as one
+int utf8_prev(const char *s, int x);
+int utf8_next(const char *s, int x);
+
+// decode `in` to UTF-8 at `out`, which has room for 3 * n bytes; returns
+// the bytes of `in` used: a split code unit or surrogate pair is left over
+size_t enc_decode(int enc, const unsigned char *in, size_t n, char *out, size_t *out_len);
+// write UTF-8 text encoded as enc; characters it cannot hold become '?'.
+// -1 on a write error.
+int enc_write(FILE *f, int enc, const char *s, size_t n);
+int enc_write_bom(FILE *f, int enc); // for files that had one
+
+#endif
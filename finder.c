@@ -0,0 +1,968 @@
+/*
+ * Project file finder
+ *
+ * A walk is a set of directory tasks sharing one Walk record, which
+ * counts the directories not yet read and carries the cancel token; what
+ * a replaced walk still finds is dropped. Ignore rules form a tree that
+ * follows the directories holding a .gitignore. A task holds the rules in
+ * force for its entries, and git's precedence is the order they are
+ * tried in: the deepest file first and, within a file, the last line.
+ *
+ * The list (paths, a hash of them, tombstones for removed files) belongs
+ * to the UI thread; workers only append to the found batch, and inotify
+ * events are read and applied by finder_update() on the UI thread.
+ */
+
+#define _GNU_SOURCE
+#include "finder.h"
+#include "pool.h"
+#include "render.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <ncurses.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define IGNORE_MAX_BYTES (1 << 20)
+#define DELIVER_BATCH 4096      // paths handed over at once from a large directory
+#define EVENT_BUF 65536
+#define NO_MATCH INT_MIN
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | \
+                    IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK)
+
+typedef struct {
+    char *pattern;
+    int negate, dir_only, anchored;
+} IgnoreRule;
+
+typedef struct Ignore Ignore;
+struct Ignore {
+    Ignore *parent;
+    atomic_int refs;
+    char *base;                 // directory of the .gitignore, relative to the root
+    size_t baselen;
+    IgnoreRule *rules;
+    int nrules;
+};
+
+typedef struct {
+    atomic_int refs;            // the finder and every queued task
+    atomic_int dirs;            // directory tasks not finished
+    CancelToken *tok;
+} Walk;
+
+typedef struct {
+    char *dir;                  // relative to the root; NULL for a free slot
+    Ignore *ig;                 // rules for its entries
+} Watch;
+
+struct Finder {
+    char *root;
+    void (*notify)(void);
+    atomic_int notified;        // notify() ran and finder_update() has not yet
+
+    pthread_mutex_t lock;       // guards the fields down to the list
+    pthread_cond_t drained;
+    Walk *walk;                 // the current walk; set only on the UI thread
+    int walks;                  // walks not yet freed
+    char **found;               // paths found since the last update
+    int nfound, found_cap;
+    int ino_fd;                 // replaced only on the UI thread
+    Watch *watches;             // indexed by watch descriptor
+    int nwatches;
+    int watch_failed;
+
+    // the list, UI thread only
+    char **files;
+    unsigned char *dead;
+    int nfiles, files_cap, live;
+    int *slots;                 // open-addressed hash of files: index + 1, 0 empty
+    int nslots;
+    unsigned long resets;       // bumped when files go away or come back
+    int stale;                  // a .gitignore changed or events were lost
+};
+
+typedef struct {
+    Finder *f;
+    Walk *w;
+    char *dir;
+    Ignore *ig;
+} ScanTask;
+
+static Ignore *ignore_ref(Ignore *ig)
+{
+    if (ig) atomic_fetch_add(&ig->refs, 1);
+    return ig;
+}
+
+static void ignore_unref(Ignore *ig)
+{
+    while (ig && atomic_fetch_sub(&ig->refs, 1) == 1) {
+        Ignore *parent = ig->parent;
+        for (int i = 0; i < ig->nrules; ++i) free(ig->rules[i].pattern);
+        free(ig->rules);
+        free(ig->base);
+        free(ig);
+        ig = parent;
+    }
+}
+
+// one .gitignore line; 0 if it holds no pattern. Escapes stay for glob_match.
+static int parse_rule(char *line, IgnoreRule *r)
+{
+    size_t n = strlen(line);
+    if (n && line[n - 1] == '\r') line[--n] = '\0';
+    while (n && line[n - 1] == ' ' && !(n >= 2 && line[n - 2] == '\\')) line[--n] = '\0';
+    if (!n || line[0] == '#') return 0;
+    memset(r, 0, sizeof(*r));
+    if (line[0] == '!') {
+        r->negate = 1;
+        line++;
+        n--;
+    }
+    if (n && line[n - 1] == '/') {
+        r->dir_only = 1;
+        line[--n] = '\0';
+    }
+    if (!n) return 0;
+    // a slash anywhere but at the end ties the pattern to the .gitignore's directory
+    r->anchored = strchr(line, '/') != NULL;
+    if (line[0] == '/') line++;
+    r->pattern = strdup(line);
+    return r->pattern != NULL;
+}
+
+// the rules of dirfd's .gitignore on top of parent's; parent itself if there are none
+static Ignore *ignore_load(int dirfd, const char *dir, Ignore *parent)
+{
+    int fd = openat(dirfd, ".gitignore", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return ignore_ref(parent);
+    struct stat st;
+    char *text = NULL;
+    ssize_t len = -1;
+    if (fstat(fd, &st) == 0 && st.st_size < IGNORE_MAX_BYTES && (text = malloc(st.st_size + 1)))
+        len = read(fd, text, st.st_size);
+    close(fd);
+    Ignore *ig = len > 0 ? calloc(1, sizeof(*ig)) : NULL;
+    if (!ig) {
+        free(text);
+        return ignore_ref(parent);
+    }
+    text[len] = '\0';
+    int cap = 0;
+    for (char *line = text, *next; line; line = next) {
+        next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+        IgnoreRule r;
+        if (!parse_rule(line, &r)) continue;
+        if (ig->nrules == cap) {
+            int ncap = cap ? cap * 2 : 16;
+            IgnoreRule *nr = realloc(ig->rules, sizeof(IgnoreRule) * ncap);
+            if (!nr) {
+                free(r.pattern);
+                break;
+            }
+            ig->rules = nr;
+            cap = ncap;
+        }
+        ig->rules[ig->nrules++] = r;
+    }
+    free(text);
+    if (!ig->nrules || !(ig->base = strdup(dir))) {
+        ig->parent = NULL;
+        atomic_init(&ig->refs, 1);
+        ignore_unref(ig);
+        return ignore_ref(parent);
+    }
+    ig->baselen = strlen(dir);
+    ig->parent = ignore_ref(parent);
+    atomic_init(&ig->refs, 1);
+    return ig;
+}
+
+// [...] at p against c: the pattern after it, NULL if the class is not closed
+static const char *match_class(const char *p, int c, int *in)
+{
+    int negate = p[1] == '!' || p[1] == '^';
+    p += negate ? 2 : 1;
+    *in = 0;
+    for (int first = 1; *p && (first || *p != ']'); first = 0) {
+        if (*p == '\\' && p[1]) p++;
+        int lo = (unsigned char)*p++, hi = lo;
+        if (p[0] == '-' && p[1] && p[1] != ']') {
+            p++;
+            if (*p == '\\' && p[1]) p++;
+            hi = (unsigned char)*p++;
+        }
+        if (c >= lo && c <= hi) *in = 1;
+    }
+    if (!*p) return NULL;
+    *in ^= negate;
+    return p + 1;
+}
+
+// shell glob over a relative path: `*`, `?` and classes stop at '/', `**` does not
+static int glob_match(const char *p, const char *s)
+{
+    while (*p) {
+        if (*p == '*') {
+            int deep = p[1] == '*';
+            p += deep ? 2 : 1;
+            if (deep && *p == '/' && glob_match(p + 1, s)) return 1; // "**/" can match no directory
+            for (;; ++s) {
+                if (glob_match(p, s)) return 1;
+                if (!*s || (!deep && *s == '/')) return 0;
+            }
+        }
+        if (!*s) return 0;
+        const char *end;
+        int in;
+        if (*p == '?') {
+            if (*s == '/') return 0;
+            p++;
+        } else if (*p == '[' && (end = match_class(p, (unsigned char)*s, &in))) {
+            if (!in || *s == '/') return 0;
+            p = end;
+        } else {
+            if (*p == '\\' && p[1]) p++;
+            if (*p++ != *s) return 0;
+        }
+        s++;
+    }
+    return !*s;
+}
+
+static int ignored(const Ignore *ig, const char *rel, int is_dir)
+{
+    const char *slash = strrchr(rel, '/'), *name = slash ? slash + 1 : rel;
+    for (; ig; ig = ig->parent) {
+        const char *sub = rel + ig->baselen + (ig->baselen > 0);
+        for (int i = ig->nrules - 1; i >= 0; --i) {
+            const IgnoreRule *r = &ig->rules[i];
+            if (r->dir_only && !is_dir) continue;
+            if (glob_match(r->pattern, r->anchored ? sub : name)) return !r->negate;
+        }
+    }
+    return 0;
+}
+
+static unsigned hash_path(const char *s)
+{
+    unsigned h = 2166136261u;
+    while (*s) h = (h ^ (unsigned char)*s++) * 16777619u;
+    return h;
+}
+
+// the slot holding path, or the empty slot it would take
+static int *find_slot(Finder *f, const char *path)
+{
+    unsigned mask = f->nslots - 1;
+    for (unsigned i = hash_path(path) & mask;; i = (i + 1) & mask) {
+        int *s = &f->slots[i];
+        if (!*s || strcmp(f->files[*s - 1], path) == 0) return s;
+    }
+}
+
+static int grow_hash(Finder *f)
+{
+    int n = f->nslots ? f->nslots * 2 : 1024;
+    int *slots = calloc(n, sizeof(int));
+    if (!slots) return -1;
+    free(f->slots);
+    f->slots = slots;
+    f->nslots = n;
+    for (int i = 0; i < f->nfiles; ++i) *find_slot(f, f->files[i]) = i + 1;
+    return 0;
+}
+
+// takes path; a removed file that comes back keeps its old entry
+static void add_file(Finder *f, char *path)
+{
+    if (f->nfiles * 2 >= f->nslots && grow_hash(f) < 0) {
+        free(path);
+        return;
+    }
+    int *slot = find_slot(f, path);
+    if (*slot) {
+        int i = *slot - 1;
+        if (f->dead[i]) {
+            f->dead[i] = 0;
+            f->live++;
+            f->resets++; // behind what the picker ranked
+        }
+        free(path);
+        return;
+    }
+    if (f->nfiles == f->files_cap) {
+        int ncap = f->files_cap ? f->files_cap * 2 : 4096;
+        char **nf = realloc(f->files, sizeof(char *) * ncap);
+        if (nf) f->files = nf;
+        unsigned char *nd = nf ? realloc(f->dead, ncap) : NULL;
+        if (!nd) {
+            free(path);
+            return;
+        }
+        f->dead = nd;
+        f->files_cap = ncap;
+    }
+    f->files[f->nfiles] = path;
+    f->dead[f->nfiles] = 0;
+    *slot = ++f->nfiles;
+    f->live++;
+}
+
+static int remove_file(Finder *f, const char *path)
+{
+    int i = f->nslots ? *find_slot(f, path) - 1 : -1;
+    if (i < 0 || f->dead[i]) return 0;
+    f->dead[i] = 1;
+    f->live--;
+    f->resets++;
+    return 1;
+}
+
+// every file under dir
+static void remove_tree(Finder *f, const char *dir)
+{
+    size_t n = strlen(dir);
+    for (int i = 0; i < f->nfiles; ++i) {
+        if (f->dead[i] || strncmp(f->files[i], dir, n) != 0 || f->files[i][n] != '/') continue;
+        f->dead[i] = 1;
+        f->live--;
+    }
+    f->resets++;
+}
+
+static void clear_list(Finder *f)
+{
+    for (int i = 0; i < f->nfiles; ++i) free(f->files[i]);
+    f->nfiles = f->live = 0;
+    if (f->slots) memset(f->slots, 0, sizeof(int) * f->nslots);
+    f->resets++;
+}
+
+static void notify(Finder *f)
+{
+    if (!atomic_exchange(&f->notified, 1)) f->notify();
+}
+
+static void walk_unref(Finder *f, Walk *w)
+{
+    if (!w || atomic_fetch_sub(&w->refs, 1) != 1) return;
+    cancel_token_unref(w->tok);
+    free(w);
+    pthread_mutex_lock(&f->lock);
+    if (--f->walks == 0) pthread_cond_signal(&f->drained);
+    pthread_mutex_unlock(&f->lock);
+}
+
+// watch dir for changes; ig goes with it for the entries that appear later
+static void add_watch(Finder *f, Walk *w, const char *path, const char *dir, Ignore *ig)
+{
+    pthread_mutex_lock(&f->lock);
+    int wd = f->walk == w && f->ino_fd >= 0 ? inotify_add_watch(f->ino_fd, path, WATCH_MASK) : -2;
+    if (wd >= f->nwatches) {
+        int n = wd + 1 > f->nwatches * 2 ? wd + 1 : f->nwatches * 2;
+        Watch *nw = realloc(f->watches, sizeof(Watch) * n);
+        if (nw) {
+            memset(nw + f->nwatches, 0, sizeof(Watch) * (n - f->nwatches));
+            f->watches = nw;
+            f->nwatches = n;
+        } else {
+            inotify_rm_watch(f->ino_fd, wd);
+            wd = -1;
+        }
+    }
+    char *copy = wd >= 0 ? strdup(dir) : NULL;
+    if (copy) {
+        // the same directory again (moved back, or rescanned): descriptors are per inode
+        Watch *wa = &f->watches[wd];
+        free(wa->dir);
+        ignore_unref(wa->ig);
+        wa->dir = copy;
+        wa->ig = ignore_ref(ig);
+    } else if (wd != -2) {
+        f->watch_failed = 1; // most often the inotify watch limit
+    }
+    pthread_mutex_unlock(&f->lock);
+}
+
+// hand paths to the UI thread; they are dropped if the walk was replaced
+static void deliver(Finder *f, Walk *w, char **paths, int n)
+{
+    pthread_mutex_lock(&f->lock);
+    int keep = f->walk == w;
+    if (keep && f->nfound + n > f->found_cap) {
+        int ncap = f->found_cap ? f->found_cap * 2 : DELIVER_BATCH;
+        while (ncap < f->nfound + n) ncap *= 2;
+        char **nf = realloc(f->found, sizeof(char *) * ncap);
+        if (nf) {
+            f->found = nf;
+            f->found_cap = ncap;
+        } else {
+            keep = 0;
+        }
+    }
+    if (keep) {
+        memcpy(f->found + f->nfound, paths, sizeof(char *) * n);
+        f->nfound += n;
+    }
+    pthread_mutex_unlock(&f->lock);
+    if (keep) notify(f);
+    else
+        for (int i = 0; i < n; ++i) free(paths[i]);
+}
+
+// 'd' for a directory, 'f' for a file or a link to one, 0 for anything else;
+// linked directories are not entered, as they can form cycles
+static int entry_kind(int dirfd, const struct dirent *e)
+{
+    struct stat st;
+    if (e->d_type == DT_DIR) return 'd';
+    if (e->d_type == DT_REG) return 'f';
+    if (e->d_type != DT_LNK && e->d_type != DT_UNKNOWN) return 0;
+    if (fstatat(dirfd, e->d_name, &st, e->d_type == DT_LNK ? 0 : AT_SYMLINK_NOFOLLOW) < 0) return 0;
+    if (S_ISREG(st.st_mode)) return 'f';
+    return S_ISDIR(st.st_mode) && e->d_type == DT_UNKNOWN ? 'd' : 0;
+}
+
+static void scan_task(void *arg, CancelToken *tok);
+
+// queue dir for reading as part of walk w
+static void submit_scan(Finder *f, Walk *w, const char *dir, Ignore *ig)
+{
+    ScanTask *t = malloc(sizeof(*t));
+    char *copy = strdup(dir);
+    if (!t || !copy) {
+        free(t);
+        free(copy);
+        return;
+    }
+    t->f = f;
+    t->w = w;
+    t->dir = copy;
+    t->ig = ignore_ref(ig);
+    atomic_fetch_add(&w->refs, 1);
+    atomic_fetch_add(&w->dirs, 1);
+    // the submitting worker's own deque: it runs them newest first, thieves oldest first
+    if (pool_submit(POOL_INTERACTIVE, w->tok, scan_task, t) < 0) scan_task(t, w->tok); // read it here
+}
+
+static void scan_dir(ScanTask *t, CancelToken *tok)
+{
+    Finder *f = t->f;
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s%s%s", f->root, t->dir[0] ? "/" : "", t->dir) >= (int)sizeof(path))
+        return;
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR *d = fd >= 0 ? fdopendir(fd) : NULL;
+    if (!d) {
+        if (fd >= 0) close(fd);
+        return;
+    }
+    Ignore *ig = ignore_load(fd, t->dir, t->ig);
+    add_watch(f, t->w, path, t->dir, ig);
+    char **batch = NULL, rel[PATH_MAX];
+    int n = 0, cap = 0;
+    struct dirent *e;
+    while ((e = readdir(d)) && !task_cancelled(tok)) {
+        const char *name = e->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || strcmp(name, ".git") == 0) continue;
+        int kind = entry_kind(fd, e);
+        if (!kind) continue;
+        if (snprintf(rel, sizeof(rel), "%s%s%s", t->dir, t->dir[0] ? "/" : "", name) >= (int)sizeof(rel))
+            continue;
+        if (ignored(ig, rel, kind == 'd')) continue;
+        if (kind == 'd') {
+            submit_scan(f, t->w, rel, ig);
+            continue;
+        }
+        if (n == cap) {
+            int ncap = cap ? cap * 2 : 64;
+            char **nb = realloc(batch, sizeof(char *) * ncap);
+            if (!nb) break;
+            batch = nb;
+            cap = ncap;
+        }
+        if ((batch[n] = strdup(rel))) n++;
+        if (n == DELIVER_BATCH) {
+            deliver(f, t->w, batch, n);
+            n = 0;
+        }
+    }
+    closedir(d);
+    ignore_unref(ig);
+    if (n) deliver(f, t->w, batch, n);
+    free(batch);
+}
+
+static void scan_task(void *arg, CancelToken *tok)
+{
+    ScanTask *t = arg;
+    Finder *f = t->f;
+    Walk *w = t->w;
+    if (!task_cancelled(tok)) scan_dir(t, tok);
+    ignore_unref(t->ig);
+    free(t->dir);
+    free(t);
+    // the last directory of the walk: the picker stops showing "scanning"
+    if (atomic_fetch_sub(&w->dirs, 1) == 1 && !task_cancelled(tok)) notify(f);
+    walk_unref(f, w);
+}
+
+// drop the list and every watch, and walk the tree again
+static int start_walk(Finder *f)
+{
+    Walk *w = calloc(1, sizeof(*w));
+    if (!w || !(w->tok = cancel_token_new())) {
+        free(w);
+        return -1;
+    }
+    atomic_init(&w->refs, 1);
+    atomic_init(&w->dirs, 0);
+    pthread_mutex_lock(&f->lock);
+    Walk *old = f->walk;
+    f->walk = w;
+    f->walks++;
+    if (old) cancel_token_cancel(old->tok);
+    for (int i = 0; i < f->nfound; ++i) free(f->found[i]);
+    f->nfound = 0;
+    for (int i = 0; i < f->nwatches; ++i) {
+        free(f->watches[i].dir);
+        ignore_unref(f->watches[i].ig);
+    }
+    free(f->watches);
+    f->watches = NULL;
+    f->nwatches = 0;
+    if (f->ino_fd >= 0) close(f->ino_fd);
+    f->ino_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    f->watch_failed = f->ino_fd < 0;
+    pthread_mutex_unlock(&f->lock);
+    walk_unref(f, old);
+    clear_list(f);
+    f->stale = 0;
+    submit_scan(f, w, "", NULL);
+    return 0;
+}
+
+void finder_project_root(const char *dir, char *root, size_t size)
+{
+    char path[PATH_MAX], git[PATH_MAX + 8];
+    struct stat st;
+    snprintf(root, size, "%s", dir);
+    if (!realpath(dir, path)) return;
+    for (;;) {
+        snprintf(git, sizeof(git), "%s/.git", path);
+        if (stat(git, &st) == 0) {
+            snprintf(root, size, "%s", path);
+            return;
+        }
+        char *slash = strrchr(path, '/');
+        if (!slash || slash == path) return;
+        *slash = '\0';
+    }
+}
+
+Finder *finder_start(const char *root, void (*notify)(void))
+{
+    Finder *f = calloc(1, sizeof(*f));
+    if (!f || !(f->root = strdup(root))) {
+        free(f);
+        return NULL;
+    }
+    f->notify = notify;
+    f->ino_fd = -1;
+    atomic_init(&f->notified, 0);
+    pthread_mutex_init(&f->lock, NULL);
+    pthread_cond_init(&f->drained, NULL);
+    if (start_walk(f) < 0) {
+        finder_free(f);
+        return NULL;
+    }
+    return f;
+}
+
+void finder_free(Finder *f)
+{
+    if (!f) return;
+    pthread_mutex_lock(&f->lock);
+    Walk *w = f->walk;
+    f->walk = NULL;
+    if (w) cancel_token_cancel(w->tok);
+    pthread_mutex_unlock(&f->lock);
+    walk_unref(f, w);
+    // queued tasks still run, cancelled, and hold f until they finish
+    pthread_mutex_lock(&f->lock);
+    while (f->walks > 0) pthread_cond_wait(&f->drained, &f->lock);
+    pthread_mutex_unlock(&f->lock);
+    for (int i = 0; i < f->nfound; ++i) free(f->found[i]);
+    free(f->found);
+    for (int i = 0; i < f->nwatches; ++i) {
+        free(f->watches[i].dir);
+        ignore_unref(f->watches[i].ig);
+    }
+    free(f->watches);
+    if (f->ino_fd >= 0) close(f->ino_fd);
+    clear_list(f);
+    free(f->files);
+    free(f->dead);
+    free(f->slots);
+    free(f->root);
+    pthread_mutex_destroy(&f->lock);
+    pthread_cond_destroy(&f->drained);
+    free(f);
+}
+
+const char *finder_root(const Finder *f)
+{
+    return f->root;
+}
+
+int finder_fd(const Finder *f)
+{
+    return f->ino_fd;
+}
+
+// watches under dir, which moved away; the kernel then reports them ignored
+static void unwatch_tree(Finder *f, const char *dir)
+{
+    size_t n = strlen(dir);
+    pthread_mutex_lock(&f->lock);
+    for (int i = 0; i < f->nwatches; ++i) {
+        const char *d = f->watches[i].dir;
+        if (d && strncmp(d, dir, n) == 0 && (!d[n] || d[n] == '/')) inotify_rm_watch(f->ino_fd, i);
+    }
+    pthread_mutex_unlock(&f->lock);
+}
+
+static int apply_event(Finder *f, const struct inotify_event *e)
+{
+    if (e->mask & IN_Q_OVERFLOW) {
+        f->stale = 1;
+        return 0;
+    }
+    char rel[PATH_MAX];
+    Ignore *ig = NULL;
+    int known = 0;
+    pthread_mutex_lock(&f->lock);
+    Watch *w = e->wd >= 0 && e->wd < f->nwatches && f->watches[e->wd].dir ? &f->watches[e->wd] : NULL;
+    if (w && (e->mask & IN_IGNORED)) {
+        free(w->dir);
+        ignore_unref(w->ig);
+        w->dir = NULL;
+        w->ig = NULL;
+    } else if (w && e->len) {
+        known = snprintf(rel, sizeof(rel), "%s%s%s", w->dir, w->dir[0] ? "/" : "", e->name) < (int)sizeof(rel);
+        ig = ignore_ref(w->ig);
+    }
+    pthread_mutex_unlock(&f->lock);
+
+    int is_dir = (e->mask & IN_ISDIR) != 0, changed = 0;
+    if (!known) {
+        // not a directory entry, or one we no longer watch
+    } else if (strcmp(e->name, ".gitignore") == 0) {
+        f->stale = 1;
+    } else if (strcmp(e->name, ".git") == 0 || ignored(ig, rel, is_dir)) {
+        // never listed
+    } else if (e->mask & (IN_CREATE | IN_MOVED_TO)) {
+        char path[PATH_MAX + 256];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", f->root, rel);
+        if (is_dir) {
+            submit_scan(f, f->walk, rel, ig);
+        } else if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+            char *copy = strdup(rel);
+            if (copy) add_file(f, copy);
+            changed = 1;
+        }
+    } else if (e->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        if (is_dir) {
+            remove_tree(f, rel);
+            if (e->mask & IN_MOVED_FROM) unwatch_tree(f, rel);
+            changed = 1;
+        } else {
+            changed = remove_file(f, rel);
+        }
+    }
+    ignore_unref(ig);
+    return changed;
+}
+
+int finder_update(Finder *f)
+{
+    atomic_store(&f->notified, 0);
+    // inotify first: a directory created since it was read is queued again
+    char buf[EVENT_BUF] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int changed = 0;
+    ssize_t n;
+    while (f->ino_fd >= 0 && (n = read(f->ino_fd, buf, sizeof(buf))) > 0) {
+        const struct inotify_event *e;
+        for (char *p = buf; p < buf + n; p += sizeof(*e) + e->len) {
+            e = (const struct inotify_event *)p;
+            changed |= apply_event(f, e);
+        }
+    }
+    if (f->stale) {
+        start_walk(f);
+        return 1;
+    }
+    pthread_mutex_lock(&f->lock);
+    char **found = f->found;
+    int nfound = f->nfound;
+    f->found = NULL;
+    f->nfound = f->found_cap = 0;
+    pthread_mutex_unlock(&f->lock);
+    for (int i = 0; i < nfound; ++i) add_file(f, found[i]);
+    free(found);
+    return changed || nfound > 0;
+}
+
+void finder_refresh(Finder *f)
+{
+    pthread_mutex_lock(&f->lock);
+    int failed = f->watch_failed;
+    pthread_mutex_unlock(&f->lock);
+    if (f->stale || (failed && !finder_scanning(f))) start_walk(f);
+}
+
+int finder_scanning(Finder *f)
+{
+    return f->walk && atomic_load(&f->walk->dirs) > 0;
+}
+
+int finder_count(const Finder *f)
+{
+    return f->live;
+}
+
+int finder_entries(const Finder *f)
+{
+    return f->nfiles;
+}
+
+const char *finder_file(const Finder *f, int i)
+{
+    return f->dead[i] ? NULL : f->files[i];
+}
+
+/*
+ * Fuzzy ranking. The query must appear in the path in order; its score
+ * rewards characters that start a path component or a word and runs of
+ * adjacent characters, and charges for gaps. Matching uses the tightest
+ * window: where the query first ends and the latest start before that.
+ */
+
+// byte -> lowercase byte ([0]) and identity ([1]), indexed by `exact`
+static unsigned char fold[2][256];
+
+// query lowercased unless it has capitals (then it matches exactly); returns exact
+static int fold_query(const char *query, char *q)
+{
+    if (!fold[1]['a'])
+        for (int c = 0; c < 256; ++c) {
+            fold[0][c] = c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+            fold[1][c] = c;
+        }
+    int exact = 0;
+    for (const char *s = query; *s; ++s) exact |= isupper((unsigned char)*s) != 0;
+    size_t i = 0;
+    for (; query[i]; ++i) q[i] = fold[exact][(unsigned char)query[i]];
+    q[i] = '\0';
+    return exact;
+}
+
+// where q first ends as a subsequence of s, -1 if it is not one; most paths
+// fail here, so the scan is left to the library's vectorised string search
+static int subsequence_end(const char *s, const char *q, int exact)
+{
+    char set[3] = { 0 };
+    const char *p = s;
+    for (; *q; ++q) {
+        set[0] = *q;
+        set[1] = !exact && *q >= 'a' && *q <= 'z' ? *q - ('a' - 'A') : 0;
+        if (!(p = set[1] ? strpbrk(p, set) : strchr(p, *q))) return -1;
+        p++;
+    }
+    return p - s;
+}
+
+// score of path s against q, NO_MATCH if q is not in it; pos receives the matched offsets
+static int fuzzy_score(const char *s, const char *q, int exact, int *pos)
+{
+    const unsigned char *t = fold[exact];
+    int i, j, end, start = 0;
+    if (!q[0]) return 0;
+    if ((end = subsequence_end(s, q, exact)) < 0) return NO_MATCH;
+    for (i = end - 1, j = strlen(q) - 1; i >= 0; --i)
+        if (t[(unsigned char)s[i]] == (unsigned char)q[j] && --j < 0) {
+            start = i;
+            break;
+        }
+    const char *slash = strrchr(s, '/');
+    int name_at = slash ? slash - s + 1 : 0, score = 0, prev = -2;
+    for (i = start, j = 0; i < end && q[j]; ++i) {
+        if (t[(unsigned char)s[i]] != (unsigned char)q[j]) {
+            score -= prev == i - 1 ? 3 : 1;
+            continue;
+        }
+        int c = i ? (unsigned char)s[i - 1] : '/', bonus = 16;
+        if (c == '/') bonus += 24;
+        else if (c == '_' || c == '-' || c == '.' || c == ' ') bonus += 16;
+        else if (islower(c) && isupper((unsigned char)s[i])) bonus += 12;
+        if (prev == i - 1) bonus += 16;
+        if (i >= name_at) bonus += 8;
+        score += bonus;
+        prev = i;
+        if (pos) pos[j] = i;
+        j++;
+    }
+    return score;
+}
+
+static int hit_before(const FinderHit *a, const FinderHit *b)
+{
+    if (a->score != b->score) return a->score > b->score;
+    if (a->len != b->len) return a->len < b->len;
+    return a->file < b->file;
+}
+
+// keep h if it is among the best FINDER_HITS
+static void insert_hit(Picker *p, FinderHit h)
+{
+    if (p->nhits == FINDER_HITS && !hit_before(&h, &p->hits[FINDER_HITS - 1])) return;
+    if (p->nhits < FINDER_HITS) p->nhits++;
+    int i = p->nhits - 1;
+    for (; i > 0 && hit_before(&h, &p->hits[i - 1]); --i) p->hits[i] = p->hits[i - 1];
+    p->hits[i] = h;
+}
+
+static void rank_file(Picker *p, const Finder *f, int i, const char *q, int exact)
+{
+    if (f->dead[i]) return;
+    int score = fuzzy_score(f->files[i], q, exact, NULL);
+    if (score == NO_MATCH) return;
+    // an empty query matches everything and needs no list to narrow later
+    if (q[0]) {
+        if (p->nmatches == p->cap) {
+            int ncap = p->cap ? p->cap * 2 : 1024;
+            int *nm = realloc(p->matches, sizeof(int) * ncap);
+            if (!nm) return;
+            p->matches = nm;
+            p->cap = ncap;
+        }
+        p->matches[p->nmatches++] = i;
+    }
+    if (p->nhits == FINDER_HITS && score < p->hits[FINDER_HITS - 1].score) return;
+    insert_hit(p, (FinderHit){ i, score, (int)strlen(f->files[i]) });
+}
+
+void picker_rank(Picker *p, const Finder *f)
+{
+    char q[FINDER_QUERY];
+    int exact = fold_query(p->query, q);
+    size_t rlen = strlen(p->ranked);
+    int valid = p->resets == f->resets && p->files <= f->nfiles;
+    int same = valid && strcmp(p->query, p->ranked) == 0;
+    // a longer query can only match files the shorter one did
+    int narrow = valid && !same && rlen && strncmp(p->query, p->ranked, rlen) == 0;
+    if (!same) p->nhits = 0;
+    if (narrow) {
+        int n = p->nmatches;
+        p->nmatches = 0;
+        for (int k = 0; k < n; ++k) rank_file(p, f, p->matches[k], q, exact);
+    } else if (!same) {
+        p->nmatches = 0;
+        p->files = 0;
+    }
+    for (int i = p->files; i < f->nfiles; ++i) rank_file(p, f, i, q, exact);
+    p->files = f->nfiles;
+    p->resets = f->resets;
+    strcpy(p->ranked, p->query);
+    if (!same) p->sel = p->top = 0;
+    picker_select(p, 0);
+}
+
+void picker_select(Picker *p, int delta)
+{
+    p->sel += delta;
+    if (p->sel >= p->nhits) p->sel = p->nhits - 1;
+    if (p->sel < 0) p->sel = 0;
+}
+
+const char *picker_selected(const Picker *p, const Finder *f)
+{
+    return p->sel < p->nhits ? f->files[p->hits[p->sel].file] : NULL;
+}
+
+void picker_free(Picker *p)
+{
+    free(p->matches);
+    memset(p, 0, sizeof(*p));
+}
+
+// one result: the tail when it is too long, matched characters in bold
+static void draw_hit(int row, int cols, const char *path, int len, const int *pos, int npos)
+{
+    int at = len > cols ? len - cols : 0;
+    while ((path[at] & 0xc0) == 0x80) at++;
+    move(row, 0);
+    for (int k = 0; at < len;) {
+        while (k < npos && pos[k] < at) k++;
+        if (k < npos && pos[k] == at) {
+            attron(A_BOLD);
+            addnstr(path + at++, 1);
+            attroff(A_BOLD);
+            continue;
+        }
+        int run = (k < npos ? pos[k] : len) - at;
+        addnstr(path + at, run);
+        at += run;
+    }
+}
+
+void draw_picker(Picker *p, Finder *f, Codein *ed, const char *hint)
+{
+    int rows, cols;
+    getmaxyx(stdscr, rows, cols);
+    erase();
+    char q[FINDER_QUERY], count[64];
+    int exact = fold_query(p->query, q), npos = strlen(q), pos[FINDER_QUERY];
+    snprintf(count, sizeof(count), "%d/%d%s", p->query[0] ? p->nmatches : f->live, f->live,
+             finder_scanning(f) ? " scanning..." : "");
+    attron(A_BOLD);
+    mvprintw(0, 0, "Open: ");
+    attroff(A_BOLD);
+    addnstr(p->query, cols > 8 ? cols - 8 : 0);
+    int qx = getcurx(stdscr);
+    int cx = cols - (int)strlen(count);
+    if (cx > qx + 1) mvprintw(0, cx, "%s", count);
+
+    int visible = rows - 2;
+    if (visible < 1) visible = 1;
+    if (p->sel < p->top) p->top = p->sel;
+    if (p->sel >= p->top + visible) p->top = p->sel - visible + 1;
+    for (int i = 0; i < visible && p->top + i < p->nhits; ++i) {
+        const FinderHit *h = &p->hits[p->top + i];
+        fuzzy_score(f->files[h->file], q, exact, pos);
+        if (p->top + i == p->sel) attron(A_REVERSE);
+        draw_hit(i + 1, cols, f->files[h->file], h->len, pos, npos);
+        attroff(A_REVERSE);
+    }
+
+    char status[4096];
+    format_status(ed, hint, status, sizeof(status));
+    attron(A_REVERSE);
+    mvaddnstr(rows - 1, 0, status, cols);
+    attroff(A_REVERSE);
+    move(0, qx);
+    refresh();
+}
@@ -0,0 +1,68 @@
+/*
+ * Project file finder
+ * - The tree under the project root is walked on the pool, one task per
+ *   directory: a worker queues the subdirectories it meets on its own
+ *   deque and idle workers steal them, so the walk spreads over every core
+ * - .gitignore files are applied as the walk meets them; .git is skipped
+ * - Found paths reach the UI thread in batches while the walk runs
+ * - The list is kept once built and inotify keeps it current; it is
+ *   walked again only when watching failed (watch limit, queue overflow)
+ *   or a .gitignore changed
+ * - The picker ranks the list by fuzzy match, incrementally: new files
+ *   are scored as they arrive and a longer query filters the last matches
+ */
+
+#ifndef CODEIN_FINDER_H
+#define CODEIN_FINDER_H
+
+#include "codein.h"
+
+#include <stddef.h>
+
+#define FINDER_QUERY 128
+#define FINDER_HITS 256         // best matches kept in order
+
+typedef struct Finder Finder;
+
+typedef struct {
+    int file, score, len;
+} FinderHit;
+
+typedef struct {
+    char query[FINDER_QUERY];   // edited by the caller, then picker_rank()
+    char ranked[FINDER_QUERY];  // query the matches are for
+    int *matches;               // every matching file, in list order
+    int nmatches, cap;
+    int files;                  // list entries ranked so far
+    unsigned long resets;       // finder resets the ranking has seen
+    FinderHit hits[FINDER_HITS];
+    int nhits;
+    int sel, top;
+} Picker;
+
+// nearest directory at or above dir that holds .git; dir itself if none
+void finder_project_root(const char *dir, char *root, size_t size);
+
+// walk root; notify() runs on a worker when finder_update() has work
+Finder *finder_start(const char *root, void (*notify)(void));
+void finder_free(Finder *f);
+const char *finder_root(const Finder *f);
+int finder_fd(const Finder *f);         // inotify descriptor to poll, -1 if none
+// UI thread: take in found files and file system events; 1 if the list changed
+int finder_update(Finder *f);
+// walk again unless inotify has kept the list current
+void finder_refresh(Finder *f);
+int finder_scanning(Finder *f);
+int finder_count(const Finder *f);      // files in the list
+// entries of the list, removed files included; entries are appended
+// until a walk starts the list over
+int finder_entries(const Finder *f);
+const char *finder_file(const Finder *f, int i); // relative to the root; NULL if removed
+
+void picker_rank(Picker *p, const Finder *f);
+void picker_select(Picker *p, int delta);
+const char *picker_selected(const Picker *p, const Finder *f); // relative to the root; NULL if none
+void picker_free(Picker *p);
+void draw_picker(Picker *p, Finder *f, Codein *ed, const char *hint);
+
+#endif
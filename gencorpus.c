@@ -0,0 +1,52 @@
+/*
+ * Synthetic corpus generator
+ * - `codein-gencorpus PROFILE SIZE [SEED] [-o FILE]`, e.g. `log 10G 7`
+ * - `make corpus` writes the default profile set into corpus/
+ */
+
+#include "corpus.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: codein-gencorpus PROFILE SIZE[K|M|G] [SEED] [-o FILE]\nprofiles:");
+    for (int i = 0; corpus_profiles[i]; ++i) fprintf(stderr, " %s", corpus_profiles[i]);
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *args[3] = { NULL, NULL, "1" }, *out_path = NULL;
+    int nargs = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) out_path = argv[++i];
+        else if (nargs < 3) args[nargs++] = argv[i];
+        else {
+            usage();
+            return 2;
+        }
+    }
+    uint64_t size = args[1] ? corpus_parse_size(args[1]) : 0;
+    if (nargs < 2 || size == 0) {
+        usage();
+        return 2;
+    }
+    FILE *out = out_path ? fopen(out_path, "wb") : stdout;
+    if (!out) {
+        perror(out_path);
+        return 1;
+    }
+    static char buf[1 << 16];
+    setvbuf(out, buf, _IOFBF, sizeof(buf));
+    int rc = corpus_generate(out, args[0], size, strtoull(args[2], NULL, 10));
+    if (fclose(out) != 0) rc = -1;
+    if (rc < 0) {
+        fprintf(stderr, "codein-gencorpus: cannot generate %s\n", args[0]);
+        usage();
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,328 @@
+/*
+ * Project search
+ *
+ * A chunk task maps its files one at a time and gathers result lines and
+ * hits in a local Out, which is handed over under the job's lock when the
+ * chunk is done. The path of a file with matches moves along with its
+ * hits, so a hit's path stays valid as long as the job. Line numbers are
+ * counted only up to each match, from the previous one.
+ */
+
+#define _GNU_SOURCE
+#include "grep.h"
+#include "pool.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CHUNK_FILES 32
+#define BINARY_SNIFF 8192
+#define TEXT_MAX 200            // bytes of a long matching line shown
+#define TEXT_BEFORE 60          // of which before the match
+
+typedef struct {
+    char *text;                 // result lines
+    size_t len, text_cap;
+    GrepHit *hits;
+    size_t nhits, hits_cap;
+    char **paths;               // of files with hits, owned
+    size_t npaths, paths_cap;
+} Out;
+
+struct GrepJob {
+    char *root, *query;
+    size_t qlen;
+    void (*notify)(void);
+    atomic_int notified;        // notify() ran and grep_collect() has not yet
+    CancelToken *tok;
+    atomic_int chunks;          // queued or running
+    atomic_int total;           // hits found, for the cap
+    atomic_int truncated;
+    pthread_mutex_t lock;       // guards tasks and pending
+    pthread_cond_t drained;
+    int tasks;                  // like chunks, but dropped as a task's last step
+    Out pending;                // found since the last collect
+
+    // UI thread
+    int fed;                    // finder entries queued
+    Out kept;                   // collected hits and their paths; text unused
+};
+
+typedef struct {
+    GrepJob *g;
+    char **paths;
+    int n;
+} Chunk;
+
+// room for `need` elements of `size` bytes
+static int reserve(void *buf, size_t *cap, size_t need, size_t size)
+{
+    if (need <= *cap) return 0;
+    size_t ncap = *cap ? *cap * 2 : 64;
+    while (ncap < need) ncap *= 2;
+    void *nb = realloc(*(void **)buf, ncap * size);
+    if (!nb) return -1;
+    *(void **)buf = nb;
+    *cap = ncap;
+    return 0;
+}
+
+static void out_free(Out *o)
+{
+    for (size_t i = 0; i < o->npaths; ++i) free(o->paths[i]);
+    free(o->paths);
+    free(o->hits);
+    free(o->text);
+    memset(o, 0, sizeof(*o));
+}
+
+// move o's hits and paths (and text, if `text`) to the end of dst; o keeps them on failure
+static int out_move(Out *dst, Out *o, int text)
+{
+    if (reserve(&dst->hits, &dst->hits_cap, dst->nhits + o->nhits, sizeof(GrepHit)) < 0 ||
+        reserve(&dst->paths, &dst->paths_cap, dst->npaths + o->npaths, sizeof(char *)) < 0 ||
+        (text && reserve(&dst->text, &dst->text_cap, dst->len + o->len, 1) < 0))
+        return -1;
+    memcpy(dst->hits + dst->nhits, o->hits, sizeof(GrepHit) * o->nhits);
+    dst->nhits += o->nhits;
+    memcpy(dst->paths + dst->npaths, o->paths, sizeof(char *) * o->npaths);
+    dst->npaths += o->npaths;
+    o->npaths = 0;
+    if (text) {
+        memcpy(dst->text + dst->len, o->text, o->len);
+        dst->len += o->len;
+    }
+    return 0;
+}
+
+// "path:line: text" for the match at hit; a long line is cut around it
+static void emit(Out *o, const char *path, int line, const char *ls, const char *le,
+                 const char *hit, size_t qlen)
+{
+    const char *from = ls, *to = le;
+    if (to > from && to[-1] == '\r') to--;
+    if (to - from > TEXT_MAX) {
+        if (hit - from > TEXT_BEFORE) from = hit - TEXT_BEFORE;
+        while (from > ls && (*from & 0xc0) == 0x80) from--;
+        if (to - from > TEXT_MAX) to = from + TEXT_MAX > hit + qlen ? from + TEXT_MAX : hit + qlen;
+        while (to < le && (*to & 0xc0) == 0x80) to++;
+    }
+    char head[PATH_MAX + 16];
+    int hn = snprintf(head, sizeof(head), "%s:%d: ", path, line + 1);
+    if (hn >= (int)sizeof(head)) return;
+    size_t n = hn + (to - from) + 1;
+    if (reserve(&o->text, &o->text_cap, o->len + n, 1) < 0 ||
+        reserve(&o->hits, &o->hits_cap, o->nhits + 1, sizeof(GrepHit)) < 0)
+        return;
+    char *t = o->text + o->len;
+    memcpy(t, head, hn);
+    // tabs and control bytes become spaces, so byte columns match screen cells
+    for (const char *s = from; s < to; ++s) t[hn + (s - from)] = (unsigned char)*s < ' ' || *s == 0x7f ? ' ' : *s;
+    t[n - 1] = '\n';
+    o->len += n;
+    o->hits[o->nhits++] = (GrepHit){ path, line, (int)(hit - ls), hn + (int)(hit - from) };
+}
+
+// every line of the mapped file holding the query
+static void search_map(GrepJob *g, Chunk *c, int i, Out *o, const char *map, size_t size)
+{
+    const char *end = map + size, *p = map, *counted = map, *hit, *path = NULL;
+    int line = 0;
+    while (p < end && (hit = memmem(p, end - p, g->query, g->qlen))) {
+        for (const char *nl = counted; (nl = memchr(nl, '\n', hit - nl)); ++nl) line++;
+        counted = hit;
+        const char *ls = memrchr(map, '\n', hit - map), *le = memchr(hit, '\n', end - hit);
+        ls = ls ? ls + 1 : map;
+        if (!le) le = end;
+        if (!path) {
+            // the file's path moves with its hits
+            if (reserve(&o->paths, &o->paths_cap, o->npaths + 1, sizeof(char *)) < 0) return;
+            path = o->paths[o->npaths++] = c->paths[i];
+            c->paths[i] = NULL;
+        }
+        emit(o, path, line, ls, le, hit, g->qlen);
+        if (atomic_fetch_add(&g->total, 1) + 1 >= GREP_MAX_HITS) {
+            atomic_store(&g->truncated, 1);
+            cancel_token_cancel(g->tok);
+            return;
+        }
+        p = le + 1; // one result per line
+    }
+}
+
+static void grep_file(GrepJob *g, Chunk *c, int i, Out *o)
+{
+    char path[PATH_MAX];
+    struct stat st;
+    if (snprintf(path, sizeof(path), "%s/%s", g->root, c->paths[i]) >= (int)sizeof(path)) return;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || (size_t)st.st_size < g->qlen || !st.st_size) {
+        close(fd);
+        return;
+    }
+    size_t size = st.st_size;
+    char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return;
+    madvise(map, size, MADV_SEQUENTIAL);
+    if (!memchr(map, '\0', size < BINARY_SNIFF ? size : BINARY_SNIFF)) search_map(g, c, i, o, map, size);
+    munmap(map, size);
+}
+
+static void notify(GrepJob *g)
+{
+    if (!atomic_exchange(&g->notified, 1)) g->notify();
+}
+
+static void chunk_task(void *arg, CancelToken *tok)
+{
+    Chunk *c = arg;
+    GrepJob *g = c->g;
+    Out o = { 0 };
+    for (int i = 0; i < c->n && !task_cancelled(tok); ++i) grep_file(g, c, i, &o);
+    if (o.nhits) {
+        pthread_mutex_lock(&g->lock);
+        out_move(&g->pending, &o, 1);
+        pthread_mutex_unlock(&g->lock);
+        notify(g);
+    }
+    out_free(&o);
+    for (int i = 0; i < c->n; ++i) free(c->paths[i]);
+    free(c->paths);
+    free(c);
+    // the last chunk: the results stop showing "searching"
+    if (atomic_fetch_sub(&g->chunks, 1) == 1 && !task_cancelled(tok)) notify(g);
+    pthread_mutex_lock(&g->lock);
+    if (--g->tasks == 0) pthread_cond_signal(&g->drained);
+    pthread_mutex_unlock(&g->lock);
+}
+
+GrepJob *grep_start(const char *root, const char *query, void (*notify)(void))
+{
+    GrepJob *g = calloc(1, sizeof(*g));
+    if (!g) return NULL;
+    g->root = strdup(root);
+    g->query = strdup(query);
+    g->tok = cancel_token_new();
+    if (!g->root || !g->query || !g->tok || !query[0]) {
+        free(g->root);
+        free(g->query);
+        cancel_token_unref(g->tok);
+        free(g);
+        return NULL;
+    }
+    g->qlen = strlen(query);
+    g->notify = notify;
+    atomic_init(&g->notified, 0);
+    atomic_init(&g->chunks, 0);
+    atomic_init(&g->total, 0);
+    atomic_init(&g->truncated, 0);
+    pthread_mutex_init(&g->lock, NULL);
+    pthread_cond_init(&g->drained, NULL);
+    return g;
+}
+
+void grep_free(GrepJob *g)
+{
+    if (!g) return;
+    cancel_token_cancel(g->tok);
+    // queued chunks still run, cancelled, and hold g until they finish
+    pthread_mutex_lock(&g->lock);
+    while (g->tasks > 0) pthread_cond_wait(&g->drained, &g->lock);
+    pthread_mutex_unlock(&g->lock);
+    out_free(&g->pending);
+    out_free(&g->kept);
+    cancel_token_unref(g->tok);
+    pthread_mutex_destroy(&g->lock);
+    pthread_cond_destroy(&g->drained);
+    free(g->root);
+    free(g->query);
+    free(g);
+}
+
+void grep_feed(GrepJob *g, const Finder *f)
+{
+    if (strcmp(finder_root(f), g->root) != 0) return;
+    int n = finder_entries(f);
+    if (g->fed > n) g->fed = n; // the list started over
+    while (g->fed < n && !task_cancelled(g->tok)) {
+        Chunk *c = calloc(1, sizeof(*c));
+        char **paths = malloc(sizeof(char *) * CHUNK_FILES);
+        if (!c || !paths) {
+            free(c);
+            free(paths);
+            return;
+        }
+        c->g = g;
+        c->paths = paths;
+        for (; g->fed < n && c->n < CHUNK_FILES; g->fed++) {
+            const char *p = finder_file(f, g->fed);
+            if (p && (c->paths[c->n] = strdup(p))) c->n++;
+        }
+        atomic_fetch_add(&g->chunks, 1);
+        pthread_mutex_lock(&g->lock);
+        g->tasks++;
+        pthread_mutex_unlock(&g->lock);
+        if (pool_submit(POOL_INTERACTIVE, g->tok, chunk_task, c) < 0) chunk_task(c, g->tok); // search them here
+    }
+}
+
+int grep_collect(GrepJob *g, Codein *results)
+{
+    atomic_store(&g->notified, 0);
+    pthread_mutex_lock(&g->lock);
+    Out o = g->pending;
+    memset(&g->pending, 0, sizeof(g->pending));
+    pthread_mutex_unlock(&g->lock);
+    int added = 0;
+    if (o.nhits && out_move(&g->kept, &o, 0) == 0) {
+        codein_append(results, o.text, o.len);
+        added = o.nhits;
+    }
+    out_free(&o);
+    return added;
+}
+
+const GrepHit *grep_hit(const GrepJob *g, int i)
+{
+    return i >= 0 && (size_t)i < g->kept.nhits ? &g->kept.hits[i] : NULL;
+}
+
+int grep_count(const GrepJob *g)
+{
+    return g->kept.nhits;
+}
+
+int grep_files(const GrepJob *g)
+{
+    return g->kept.npaths;
+}
+
+int grep_searching(GrepJob *g)
+{
+    return atomic_load(&g->chunks) > 0;
+}
+
+int grep_truncated(const GrepJob *g)
+{
+    return atomic_load(&((GrepJob *)g)->truncated);
+}
+
+const char *grep_root(const GrepJob *g)
+{
+    return g->root;
+}
+
+const char *grep_query(const GrepJob *g)
+{
+    return g->query;
+}
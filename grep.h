@@ -0,0 +1,47 @@
+/*
+ * Project search
+ * - The finder's file list (so ignored paths never come up) is searched
+ *   on the pool, a chunk of files per task, as it fills in
+ * - Each file is mapped and searched whole with memmem, the byte-range
+ *   form of the strstr the in-buffer search uses; lines are only found
+ *   around a match
+ * - Files with a NUL byte in their first 8 KB are taken as binary
+ * - Matches reach the UI thread in batches of "path:line: text" lines for
+ *   a results buffer; where each one points is kept alongside
+ */
+
+#ifndef CODEIN_GREP_H
+#define CODEIN_GREP_H
+
+#include "codein.h"
+#include "finder.h"
+
+#define GREP_MAX_HITS 100000    // the search stops after this many matching lines
+
+typedef struct GrepJob GrepJob;
+
+typedef struct {
+    const char *path;           // relative to the root
+    int line;                   // 0-based line of the file
+    int col;                    // byte column of the match in that line
+    int at;                     // byte column of the match in the result line
+} GrepHit;
+
+// search root's files for query; notify() runs on a worker when grep_collect() has work
+GrepJob *grep_start(const char *root, const char *query, void (*notify)(void));
+// stop the search and wait for its tasks
+void grep_free(GrepJob *g);
+// queue the list entries added since the last call; f must list the job's root
+void grep_feed(GrepJob *g, const Finder *f);
+// UI thread: append the matches found since the last call to `results`,
+// whose line i then is the match grep_hit(g, i); returns how many were added
+int grep_collect(GrepJob *g, Codein *results);
+const GrepHit *grep_hit(const GrepJob *g, int i);
+int grep_count(const GrepJob *g);       // matching lines collected
+int grep_files(const GrepJob *g);       // files with a match
+int grep_searching(GrepJob *g);         // chunks still queued or running
+int grep_truncated(const GrepJob *g);   // stopped at GREP_MAX_HITS
+const char *grep_root(const GrepJob *g);
+const char *grep_query(const GrepJob *g);
+
+#endif
@@ -0,0 +1,452 @@
+/*
+ * Log histogram
+ *
+ * The time range comes from the first and last stamped lines, and the
+ * bucket width is the smallest round width giving at most TARGET_BUCKETS
+ * buckets. Each chunk task counts into its own buckets and value table
+ * with its own compiled regex, so workers share nothing; merging maps chunk values to histogram
+ * values by name. Severity levels are pre-seeded so they keep their
+ * order; other facets take values in the order they are met.
+ */
+
+#include "hist.h"
+#include "logtime.h"
+#include "render.h"
+
+#include <ctype.h>
+#include <ncurses.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TARGET_BUCKETS 48
+#define RANGE_SCAN 10000      // lines searched for the first and last stamp
+#define CHUNKS_PER_THREAD 4
+#define BAR_WIDTH 12
+#define VALUE_COL 7
+
+typedef struct {
+    HistBucket *buckets;
+    char values[HIST_MAX_VALUES][HIST_VALUE_LEN];
+    int nvalues;
+    regex_t re;                  // one per part: regexec() locks the pattern it runs
+    int has_re;
+} HistPart;
+
+struct HistJob {
+    CodeinSnapshot *snap;
+    CancelToken *tok;
+    void (*done)(HistJob *job);
+    int facet, fmt;
+    int64_t origin, width;
+    int nbuckets, nparts;
+    HistPart *parts;
+    atomic_int pending;
+};
+
+typedef struct {
+    HistJob *job;
+    int part, first, last;
+} HistChunk;
+
+static const char *const levels[] = { "TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL" };
+#define NLEVELS 6
+
+static const int64_t widths[] = {
+    1000, 2000, 5000, 10000, 15000, 30000, 60000, 120000, 300000, 600000, 900000,
+    1800000, 3600000, 7200000, 10800000, 21600000, 43200000, 86400000, 172800000, 604800000,
+};
+
+static int64_t bucket_width(int64_t span)
+{
+    int n = sizeof(widths) / sizeof(widths[0]);
+    for (int i = 0; i < n; ++i)
+        if (span / widths[i] < TARGET_BUCKETS) return widths[i];
+    int64_t w = widths[n - 1];
+    while (span / w >= TARGET_BUCKETS) w *= 2;
+    return w;
+}
+
+static void width_label(int64_t w, char *buf, size_t size)
+{
+    if (w % 86400000 == 0) snprintf(buf, size, "%lldd", (long long)(w / 86400000));
+    else if (w % 3600000 == 0) snprintf(buf, size, "%lldh", (long long)(w / 3600000));
+    else if (w % 60000 == 0) snprintf(buf, size, "%lldm", (long long)(w / 60000));
+    else snprintf(buf, size, "%llds", (long long)(w / 1000));
+}
+
+static void copy_value(char *out, const char *s, size_t n)
+{
+    if (n >= HIST_VALUE_LEN) n = HIST_VALUE_LEN - 1;
+    memcpy(out, s, n);
+    out[n] = '\0';
+}
+
+// the facet value of a line; 0 if it has none
+static int line_value(int facet, regex_t *re, const char *s, char *out)
+{
+    if (facet == HIST_LEVEL) {
+        // the first word near the start that names a level
+        for (const char *p = s; *p && p - s < 128; ++p) {
+            if (!isupper((unsigned char)*p) || (p > s && isalnum((unsigned char)p[-1]))) continue;
+            size_t n = 0;
+            while (isalpha((unsigned char)p[n])) n++;
+            for (int i = 0; i < NLEVELS; ++i) {
+                size_t ln = strlen(levels[i]);
+                if (n >= ln && strncmp(p, levels[i], ln) == 0 &&
+                    (n == ln || (i == 3 && n == 7 && strncmp(p, "WARNING", 7) == 0))) {
+                    strcpy(out, levels[i]);
+                    return 1;
+                }
+            }
+            if (n == 8 && strncmp(p, "CRITICAL", 8) == 0) {
+                strcpy(out, "FATAL");
+                return 1;
+            }
+            p += n ? n - 1 : 0;
+        }
+        return 0;
+    }
+    if (facet == HIST_SOURCE) {
+        // the first [tag] that is not a bracketed timestamp
+        for (const char *p = strchr(s, '['); p; p = strchr(p + 1, '[')) {
+            const char *e = strchr(p, ']');
+            if (!e) return 0;
+            if (isdigit((unsigned char)p[1]) || e == p + 1) continue;
+            copy_value(out, p + 1, e - p - 1);
+            return 1;
+        }
+        return 0;
+    }
+    regmatch_t m[2];
+    if (regexec(re, s, 2, m, 0) != 0) return 0;
+    int g = m[1].rm_so >= 0 ? 1 : 0; // the first group, else the whole match
+    copy_value(out, s + m[g].rm_so, m[g].rm_eo - m[g].rm_so);
+    return 1;
+}
+
+static int value_slot(char values[][HIST_VALUE_LEN], int *nvalues, const char *v)
+{
+    for (int i = 0; i < *nvalues; ++i)
+        if (strcmp(values[i], v) == 0) return i;
+    if (*nvalues == HIST_MAX_VALUES) return HIST_MAX_VALUES;
+    strcpy(values[*nvalues], v);
+    return (*nvalues)++;
+}
+
+static void seed_values(int facet, char values[][HIST_VALUE_LEN], int *nvalues)
+{
+    *nvalues = 0;
+    if (facet != HIST_LEVEL) return;
+    for (int i = 0; i < NLEVELS; ++i) strcpy(values[i], levels[i]);
+    *nvalues = NLEVELS;
+}
+
+static void clear_buckets(HistBucket *b, int n)
+{
+    memset(b, 0, sizeof(*b) * n);
+    for (int i = 0; i < n; ++i)
+        for (int v = 0; v <= HIST_MAX_VALUES; ++v) b[i].first[v] = -1;
+}
+
+static void add_line(HistBucket *b, char values[][HIST_VALUE_LEN], int *nvalues,
+                     int facet, regex_t *re, int y, const char *s)
+{
+    char v[HIST_VALUE_LEN];
+    int slot = line_value(facet, re, s, v) ? value_slot(values, nvalues, v) : HIST_MAX_VALUES;
+    b->total++;
+    b->count[slot]++;
+    if (b->first[slot] < 0 || y < b->first[slot]) b->first[slot] = y;
+}
+
+static int64_t bucket_index(int64_t origin, int64_t width, int64_t ms)
+{
+    return ms < origin ? 0 : (ms - origin) / width;
+}
+
+static void free_job(HistJob *job)
+{
+    for (int i = 0; i < job->nparts; ++i) {
+        free(job->parts[i].buckets);
+        if (job->parts[i].has_re) regfree(&job->parts[i].re);
+    }
+    free(job->parts);
+    codein_snapshot_release(job->snap);
+    cancel_token_unref(job->tok);
+    free(job);
+}
+
+static void count_task(void *arg, CancelToken *tok)
+{
+    HistChunk *ch = arg;
+    HistJob *job = ch->job;
+    HistPart *part = &job->parts[ch->part];
+    for (int y = ch->first; y < ch->last && part->buckets; ++y) {
+        if ((y & 4095) == 0 && task_cancelled(tok)) break;
+        const char *s = codein_snapshot_line(job->snap, y);
+        int64_t ms;
+        if (!logts_parse(job->fmt, s, &ms)) continue;
+        int64_t b = bucket_index(job->origin, job->width, ms);
+        if (b >= job->nbuckets) b = job->nbuckets - 1; // out of order past the last stamp
+        add_line(&part->buckets[b], part->values, &part->nvalues, job->facet, &part->re, y, s);
+    }
+    free(ch);
+    if (atomic_fetch_sub(&job->pending, 1) == 1) job->done(job);
+}
+
+static void reset(Histogram *h)
+{
+    hist_stop(h);
+    free(h->buckets);
+    if (h->has_re) regfree(&h->re);
+    memset(h, 0, sizeof(*h));
+}
+
+// stamped line nearest to y going in direction dir; 0 if none within reach
+static int find_stamp(Codein *ed, int fmt, int y, int dir, int64_t *ms)
+{
+    for (int i = 0; i < RANGE_SCAN && y >= 0 && y < codein_num_lines(ed); ++i, y += dir)
+        if (logts_parse(fmt, codein_line(ed, y), ms)) return 1;
+    return 0;
+}
+
+int hist_start(Histogram *h, Codein *ed, int fmt, int facet, const char *regex,
+               void (*done)(HistJob *job), const char **err)
+{
+    reset(h);
+    int64_t first, last;
+    if (fmt == LOGTS_NONE || !find_stamp(ed, fmt, 0, 1, &first) ||
+        !find_stamp(ed, fmt, codein_num_lines(ed) - 1, -1, &last)) {
+        *err = "No timestamps recognized";
+        return -1;
+    }
+    h->facet = facet;
+    h->fmt = fmt;
+    if (facet == HIST_REGEX) {
+        if (regcomp(&h->re, regex, REG_EXTENDED) != 0) {
+            *err = "Bad regular expression";
+            return -1;
+        }
+        h->has_re = 1;
+    }
+    if (last < first) last = first;
+    h->width = bucket_width(last - first);
+    h->origin = first / h->width * h->width;
+    h->nbuckets = bucket_index(h->origin, h->width, last) + 1;
+    h->buckets = malloc(sizeof(HistBucket) * h->nbuckets);
+    HistJob *job = calloc(1, sizeof(*job));
+    if (!h->buckets || !job) {
+        free(job);
+        *err = "Out of memory";
+        return -1;
+    }
+    clear_buckets(h->buckets, h->nbuckets);
+    seed_values(facet, h->values, &h->nvalues);
+    h->sel_value = -1;
+
+    job->done = done;
+    job->facet = facet;
+    job->fmt = fmt;
+    job->origin = h->origin;
+    job->width = h->width;
+    job->nbuckets = h->nbuckets;
+    codein_publish(ed);
+    job->snap = codein_snapshot_acquire(ed);
+    int n = codein_snapshot_num_lines(job->snap);
+    job->nparts = pool_size() * CHUNKS_PER_THREAD;
+    if (job->nparts < 1) job->nparts = 1;
+    job->parts = calloc(job->nparts, sizeof(HistPart));
+    if (job->parts) {
+        for (int i = 0; i < job->nparts; ++i) {
+            HistPart *p = &job->parts[i];
+            p->buckets = malloc(sizeof(HistBucket) * h->nbuckets);
+            if (p->buckets) clear_buckets(p->buckets, h->nbuckets);
+            seed_values(facet, p->values, &p->nvalues);
+            // a part without its regex counts nothing, like one without buckets
+            if (facet == HIST_REGEX && p->buckets && !(p->has_re = regcomp(&p->re, regex, REG_EXTENDED) == 0)) {
+                free(p->buckets);
+                p->buckets = NULL;
+            }
+        }
+    } else {
+        job->nparts = 0;
+    }
+    h->tok = cancel_token_new();
+    job->tok = cancel_token_ref(h->tok);
+    h->job = job;
+    h->lines = n;
+    h->version = codein_snapshot_version(job->snap);
+
+    atomic_init(&job->pending, job->nparts + 1); // held until every chunk is queued
+    for (int i = 0; i < job->nparts; ++i) {
+        HistChunk *ch = malloc(sizeof(*ch));
+        if (ch) {
+            ch->job = job;
+            ch->part = i;
+            ch->first = (long long)n * i / job->nparts;
+            ch->last = (long long)n * (i + 1) / job->nparts;
+        }
+        if (!ch || pool_submit(POOL_BULK, job->tok, count_task, ch) < 0) {
+            free(ch);
+            atomic_fetch_sub(&job->pending, 1);
+        }
+    }
+    if (atomic_fetch_sub(&job->pending, 1) == 1) job->done(job);
+    return 0;
+}
+
+void hist_finish(Histogram *h, HistJob *job)
+{
+    if (job != h->job || task_cancelled(job->tok)) {
+        free_job(job);
+        return;
+    }
+    for (int i = 0; i < job->nparts; ++i) {
+        HistPart *p = &job->parts[i];
+        if (!p->buckets) continue;
+        int map[HIST_MAX_VALUES + 1];
+        for (int v = 0; v < p->nvalues; ++v) map[v] = value_slot(h->values, &h->nvalues, p->values[v]);
+        map[HIST_MAX_VALUES] = HIST_MAX_VALUES;
+        for (int b = 0; b < job->nbuckets; ++b) {
+            HistBucket *src = &p->buckets[b], *dst = &h->buckets[b];
+            dst->total += src->total;
+            for (int v = 0; v <= HIST_MAX_VALUES; ++v) {
+                if (v < HIST_MAX_VALUES && v >= p->nvalues) continue;
+                int d = map[v];
+                dst->count[d] += src->count[v];
+                if (src->first[v] >= 0 && (dst->first[d] < 0 || src->first[v] < dst->first[d]))
+                    dst->first[d] = src->first[v];
+            }
+        }
+    }
+    h->job = NULL;
+    cancel_token_unref(h->tok);
+    h->tok = NULL;
+    free_job(job);
+}
+
+void hist_stop(Histogram *h)
+{
+    if (h->tok) {
+        cancel_token_cancel(h->tok);
+        cancel_token_unref(h->tok);
+    }
+    h->tok = NULL;
+    h->job = NULL;
+}
+
+void hist_append(Histogram *h, Codein *ed, int from)
+{
+    if (!h->buckets) return;
+    int n = codein_num_lines(ed);
+    for (int y = from; y < n; ++y) {
+        const char *ln = codein_line(ed, y);
+        int64_t ms;
+        if (!logts_parse(h->fmt, ln, &ms)) continue;
+        int64_t b = bucket_index(h->origin, h->width, ms);
+        if (b >= h->nbuckets && b < HIST_MAX_BUCKETS) {
+            HistBucket *nb = realloc(h->buckets, sizeof(HistBucket) * (b + 1));
+            if (nb) {
+                clear_buckets(nb + h->nbuckets, b + 1 - h->nbuckets);
+                h->buckets = nb;
+                h->nbuckets = b + 1;
+            }
+        }
+        if (b >= h->nbuckets) b = h->nbuckets - 1;
+        add_line(&h->buckets[b], h->values, &h->nvalues, h->facet, &h->re, y, ln);
+    }
+    h->lines = n;
+    h->version = codein_version(ed);
+}
+
+void hist_select(Histogram *h, int dbucket, int dvalue)
+{
+    h->sel += dbucket;
+    if (h->sel >= h->nbuckets) h->sel = h->nbuckets - 1;
+    if (h->sel < 0) h->sel = 0;
+    h->sel_value += dvalue;
+    if (h->sel_value > h->nvalues) h->sel_value = h->nvalues; // nvalues: the "other" column
+    if (h->sel_value < -1) h->sel_value = -1;
+}
+
+int hist_target_line(const Histogram *h)
+{
+    if (!h->buckets || h->sel >= h->nbuckets) return -1;
+    const HistBucket *b = &h->buckets[h->sel];
+    if (h->sel_value >= 0) return b->first[h->sel_value < h->nvalues ? h->sel_value : HIST_MAX_VALUES];
+    int line = -1;
+    for (int v = 0; v <= HIST_MAX_VALUES; ++v)
+        if (b->first[v] >= 0 && (line < 0 || b->first[v] < line)) line = b->first[v];
+    return line;
+}
+
+void draw_histogram(Histogram *h, Codein *ed, const char *hint)
+{
+    static const char *const facets[] = { "level", "source", "regex" };
+    int rows, cols;
+    getmaxyx(stdscr, rows, cols);
+    erase();
+    char w[16];
+    width_label(h->width, w, sizeof(w));
+    long long total = 0;
+    int max = 1;
+    for (int b = 0; b < h->nbuckets; ++b) {
+        total += h->buckets[b].total;
+        if (h->buckets[b].total > max) max = h->buckets[b].total;
+    }
+    attron(A_BOLD);
+    mvprintw(0, 0, "%s per %s, %lld stamped lines%s   l/s/r facet  arrows select  Enter jump  q close",
+             facets[h->facet], w, total, h->job ? " (counting...)" : "");
+    attroff(A_BOLD);
+
+    // columns: time, total, bar, then one per value and "other",
+    // scrolled so that the selected value is shown
+    int x0 = 19 + 1 + 8 + 1 + BAR_WIDTH;
+    int ncols = h->nvalues + 1, first = 0;
+    if (x0 + ncols * VALUE_COL > cols) ncols = (cols - x0) / VALUE_COL;
+    if (h->sel_value >= ncols) first = h->sel_value - ncols + 1;
+    mvprintw(1, 0, "%-19s %8s", "time", "lines");
+    for (int i = 0; i < ncols; ++i) {
+        int v = first + i;
+        const char *name = v < h->nvalues ? h->values[v] : "other";
+        size_t len = strlen(name);
+        if (len > VALUE_COL - 1) name += len - (VALUE_COL - 1); // tails tell "worker-1" from "worker-2"
+        if (v == h->sel_value) attron(A_UNDERLINE);
+        mvprintw(1, x0 + i * VALUE_COL, "%*s", VALUE_COL - 1, name);
+        attroff(A_UNDERLINE);
+    }
+
+    int visible = rows - 3;
+    if (visible < 1) visible = 1;
+    if (h->sel < h->top) h->top = h->sel;
+    if (h->sel >= h->top + visible) h->top = h->sel - visible + 1;
+    for (int i = 0; i < visible && h->top + i < h->nbuckets; ++i) {
+        int b = h->top + i, row = i + 2;
+        HistBucket *bk = &h->buckets[b];
+        char when[32], bar[BAR_WIDTH + 1];
+        logts_format(h->origin + b * h->width, when, sizeof(when));
+        int n = (int)((long long)bk->total * BAR_WIDTH / max);
+        if (bk->total && !n) n = 1;
+        memset(bar, '#', n);
+        bar[n] = '\0';
+        if (b == h->sel) attron(A_REVERSE);
+        mvprintw(row, 0, "%-19s %8d", when, bk->total);
+        attroff(A_REVERSE);
+        mvprintw(row, 29, "%-*s", BAR_WIDTH, bar);
+        for (int i = 0; i < ncols; ++i) {
+            int v = first + i, slot = v < h->nvalues ? v : HIST_MAX_VALUES;
+            if (b == h->sel && v == h->sel_value) attron(A_REVERSE);
+            mvprintw(row, x0 + i * VALUE_COL, "%*d", VALUE_COL - 1, bk->count[slot]);
+            attroff(A_REVERSE);
+        }
+    }
+
+    char status[4096];
+    format_status(ed, hint, status, sizeof(status));
+    attron(A_REVERSE);
+    mvaddnstr(rows - 1, 0, status, cols);
+    attroff(A_REVERSE);
+    move(h->sel - h->top + 2, 0);
+    refresh();
+}
@@ -0,0 +1,62 @@
+/*
+ * Log histogram: stamped lines counted per time bucket and per facet
+ * value (severity level, [source] tag or a regex capture group)
+ * - A full count splits the snapshot into chunks on the pool; the UI
+ *   thread merges the per-chunk tables when the last chunk is done
+ * - Lines appended in follow mode are counted as they arrive
+ * - Lines without a timestamp (continuations) are not counted
+ */
+
+#ifndef CODEIN_HIST_H
+#define CODEIN_HIST_H
+
+#include "codein.h"
+#include "pool.h"
+
+#include <regex.h>
+#include <stdint.h>
+
+#define HIST_MAX_VALUES 12    // more distinct values count as "other"
+#define HIST_MAX_BUCKETS 4096
+#define HIST_VALUE_LEN 24
+
+enum { HIST_LEVEL, HIST_SOURCE, HIST_REGEX };
+
+typedef struct {
+    int total;
+    int count[HIST_MAX_VALUES + 1]; // the last slot is "other"
+    int first[HIST_MAX_VALUES + 1]; // first line per value, -1 if none
+} HistBucket;
+
+typedef struct HistJob HistJob;
+
+typedef struct {
+    int facet, fmt;
+    regex_t re;
+    int has_re;
+    int64_t origin, width;    // start of bucket 0 and bucket length, ms
+    HistBucket *buckets;
+    int nbuckets;
+    char values[HIST_MAX_VALUES][HIST_VALUE_LEN];
+    int nvalues;
+    int lines;                // lines of the buffer counted
+    unsigned long version;    // buffer version the counts match
+    HistJob *job;             // full count in flight
+    CancelToken *tok;
+    int sel, sel_value, top;  // selected bucket, value column (-1: all), first row shown
+} Histogram;
+
+// start a full count; -1 with *err set if the regex or timestamps fail.
+// `done` runs on a worker thread; pass the job to hist_finish() on the UI thread.
+int hist_start(Histogram *h, Codein *ed, int fmt, int facet, const char *regex,
+               void (*done)(HistJob *job), const char **err);
+void hist_finish(Histogram *h, HistJob *job);
+void hist_stop(Histogram *h);
+// count lines [from, num_lines) that follow mode appended
+void hist_append(Histogram *h, Codein *ed, int from);
+
+void hist_select(Histogram *h, int dbucket, int dvalue);
+int hist_target_line(const Histogram *h); // first line of the selection, -1 if none
+void draw_histogram(Histogram *h, Codein *ed, const char *hint);
+
+#endif
@@ -0,0 +1,395 @@
+/*
+ * Structural index for navigating large JSON documents
+ *
+ * Stage 1 classifies 64 bytes at a time into bitmasks of quotes,
+ * backslashes and structural characters (SSE2 compares and movemask,
+ * scalar elsewhere). Backslash runs of odd length escape the next byte;
+ * a prefix XOR over the unescaped quotes gives the in-string mask, so
+ * no byte is branched on. Stage 2 walks the surviving tokens with a
+ * stack and records, per token, its container, its matching bracket and
+ * the element it belongs to; element starts are chained to their
+ * siblings. Invalid JSON gives a best-effort index.
+ */
+
+#include "json.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define MAX_PATH_DEPTH 64
+#define MAX_KEY 48
+
+typedef struct {
+    uint64_t pos;       // byte offset, counting one '\n' after every line
+    int32_t parent;     // enclosing '{' or '['; -1 at top level
+    int32_t match;      // other bracket of a pair; -1 otherwise
+    int32_t elem_start; // '{', '[' or ',' that starts the element holding this token
+    int32_t next, prev; // for element starts: neighbouring element starts
+    uint32_t elem;      // for element starts: element number in the container
+    char c;
+} JsonNode;
+
+struct JsonIndex {
+    CodeinSnapshot *snap;
+    uint64_t *line_off; // num_lines + 1
+    JsonNode *nodes;
+    size_t count, cap;
+};
+
+int json_detect(Codein *ed)
+{
+    const char *name = codein_filename(ed), *dot = strrchr(name, '.');
+    if (dot && strcmp(dot, ".json") == 0) return 1;
+    for (int y = 0; y < codein_num_lines(ed) && y < 8; ++y) {
+        const char *ln = codein_line(ed, y), *s = ln + strspn(ln, " \t\r");
+        if (*s) return *s == '{' || *s == '[';
+    }
+    return 0;
+}
+
+typedef struct {
+    uint64_t quote, backslash, op;
+} BlockMasks;
+
+#ifdef __SSE2__
+static uint64_t movemask64(__m128i a, __m128i b, __m128i c, __m128i d)
+{
+    return (uint64_t)(uint16_t)_mm_movemask_epi8(a) |
+           (uint64_t)(uint16_t)_mm_movemask_epi8(b) << 16 |
+           (uint64_t)(uint16_t)_mm_movemask_epi8(c) << 32 |
+           (uint64_t)(uint16_t)_mm_movemask_epi8(d) << 48;
+}
+#endif
+
+static BlockMasks classify(const unsigned char *p)
+{
+    BlockMasks m;
+#ifdef __SSE2__
+    __m128i in[4], q[4], b[4], o[4];
+    for (int i = 0; i < 4; ++i) {
+        in[i] = _mm_loadu_si128((const __m128i *)(p + 16 * i));
+        q[i] = _mm_cmpeq_epi8(in[i], _mm_set1_epi8('"'));
+        b[i] = _mm_cmpeq_epi8(in[i], _mm_set1_epi8('\\'));
+        // '{' and '}' differ from '[' and ']' by 0x20; OR it in to test both
+        __m128i low = _mm_or_si128(in[i], _mm_set1_epi8(0x20));
+        o[i] = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(low, _mm_set1_epi8('{')),
+                                         _mm_cmpeq_epi8(low, _mm_set1_epi8('}'))),
+                            _mm_or_si128(_mm_cmpeq_epi8(in[i], _mm_set1_epi8(':')),
+                                         _mm_cmpeq_epi8(in[i], _mm_set1_epi8(','))));
+    }
+    m.quote = movemask64(q[0], q[1], q[2], q[3]);
+    m.backslash = movemask64(b[0], b[1], b[2], b[3]);
+    m.op = movemask64(o[0], o[1], o[2], o[3]);
+#else
+    m.quote = m.backslash = m.op = 0;
+    for (int i = 0; i < 64; ++i) {
+        uint64_t bit = 1ULL << i;
+        if (p[i] == '"') m.quote |= bit;
+        else if (p[i] == '\\') m.backslash |= bit;
+        else if (strchr("{}[]:,", p[i]) && p[i]) m.op |= bit;
+    }
+#endif
+    return m;
+}
+
+// bytes escaped by a backslash run of odd length; *carry spans blocks
+static uint64_t escaped_bytes(uint64_t bs, uint64_t *carry)
+{
+    const uint64_t even = 0x5555555555555555ULL;
+    uint64_t escaped_first = *carry;
+    bs &= ~escaped_first;
+    uint64_t follows = bs << 1 | escaped_first;
+    uint64_t odd_starts = bs & ~even & ~follows;
+    uint64_t even_runs;
+    *carry = __builtin_add_overflow(odd_starts, bs, &even_runs);
+    return (even ^ (even_runs << 1)) & follows;
+}
+
+static uint64_t prefix_xor(uint64_t x)
+{
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+static int add_node(JsonIndex *ix, uint64_t pos, char c)
+{
+    if (ix->count == ix->cap) {
+        size_t ncap = ix->cap ? ix->cap * 2 : 4096;
+        JsonNode *nn = realloc(ix->nodes, sizeof(JsonNode) * ncap);
+        if (!nn) return -1;
+        ix->nodes = nn;
+        ix->cap = ncap;
+    }
+    ix->nodes[ix->count++] = (JsonNode){ .pos = pos, .c = c };
+    return 0;
+}
+
+// stage 1: structural tokens outside strings, in document order
+static int find_tokens(JsonIndex *ix, CancelToken *tok)
+{
+    uint64_t esc_carry = 0, in_string = 0;
+    int n = codein_snapshot_num_lines(ix->snap);
+    for (int y = 0; y < n; ++y) {
+        if ((y & 4095) == 0 && task_cancelled(tok)) return -1;
+        const unsigned char *s = (const unsigned char *)codein_snapshot_line(ix->snap, y);
+        size_t len = ix->line_off[y + 1] - ix->line_off[y] - 1;
+        for (size_t off = 0; off < len; off += 64) {
+            unsigned char tail[64];
+            const unsigned char *p = s + off;
+            if (len - off < 64) {
+                memset(tail, 0, sizeof(tail));
+                memcpy(tail, p, len - off);
+                p = tail;
+            }
+            BlockMasks m = classify(p);
+            uint64_t quotes = m.quote & ~escaped_bytes(m.backslash, &esc_carry);
+            uint64_t str = prefix_xor(quotes) ^ in_string;
+            in_string = (uint64_t)((int64_t)str >> 63);
+            for (uint64_t ops = m.op & ~str; ops; ops &= ops - 1) {
+                int bit = __builtin_ctzll(ops);
+                if (add_node(ix, ix->line_off[y] + off + bit, p[bit]) < 0) return -1;
+            }
+        }
+        esc_carry = 0; // a trailing backslash escapes the newline
+    }
+    return 0;
+}
+
+// stage 2: containers, bracket pairs and sibling chains
+static int link_tokens(JsonIndex *ix)
+{
+    int32_t *stack = NULL, *last = NULL;
+    size_t depth = 0, stack_cap = 0;
+    for (size_t i = 0; i < ix->count; ++i) {
+        JsonNode *n = &ix->nodes[i];
+        int32_t top = depth ? stack[depth - 1] : -1;
+        n->parent = top;
+        n->match = n->next = n->prev = -1;
+        n->elem_start = depth ? last[depth - 1] : -1;
+        if (n->c == '{' || n->c == '[') {
+            if (depth == stack_cap) {
+                size_t ncap = stack_cap ? stack_cap * 2 : 64;
+                int32_t *ns = realloc(stack, sizeof(int32_t) * ncap);
+                if (ns) stack = ns;
+                int32_t *nl = realloc(last, sizeof(int32_t) * ncap);
+                if (nl) last = nl;
+                if (!ns || !nl) {
+                    free(stack);
+                    free(last);
+                    return -1;
+                }
+                stack_cap = ncap;
+            }
+            n->elem = 0;
+            stack[depth] = i;
+            last[depth] = i;
+            depth++;
+        } else if (n->c == '}' || n->c == ']') {
+            if (!depth) continue;
+            int32_t open = stack[--depth];
+            n->match = open;
+            ix->nodes[open].match = i;
+            n->parent = ix->nodes[open].parent;
+            n->elem_start = ix->nodes[open].elem_start;
+        } else if (n->c == ',' && depth) {
+            JsonNode *prev = &ix->nodes[last[depth - 1]];
+            n->elem = prev->elem + 1;
+            n->prev = last[depth - 1];
+            prev->next = i;
+            n->elem_start = i;
+            last[depth - 1] = i;
+        }
+    }
+    free(stack);
+    free(last);
+    return 0;
+}
+
+JsonIndex *json_index_build(CodeinSnapshot *s, CancelToken *tok)
+{
+    JsonIndex *ix = calloc(1, sizeof(*ix));
+    if (!ix) return NULL;
+    ix->snap = s;
+    int n = codein_snapshot_num_lines(s);
+    ix->line_off = malloc(sizeof(uint64_t) * (n + 1));
+    if (!ix->line_off) {
+        free(ix);
+        return NULL;
+    }
+    ix->line_off[0] = 0;
+    for (int y = 0; y < n; ++y)
+        ix->line_off[y + 1] = ix->line_off[y] + strlen(codein_snapshot_line(s, y)) + 1;
+    if (find_tokens(ix, tok) < 0 || task_cancelled(tok) || link_tokens(ix) < 0) {
+        ix->snap = NULL; // the caller still owns it
+        json_index_free(ix);
+        return NULL;
+    }
+    return ix;
+}
+
+void json_index_free(JsonIndex *ix)
+{
+    if (!ix) return;
+    codein_snapshot_release(ix->snap);
+    free(ix->line_off);
+    free(ix->nodes);
+    free(ix);
+}
+
+unsigned long json_index_version(const JsonIndex *ix)
+{
+    return codein_snapshot_version(ix->snap);
+}
+
+size_t json_index_tokens(const JsonIndex *ix)
+{
+    return ix->count;
+}
+
+static uint64_t offset_of(const JsonIndex *ix, int y, int x)
+{
+    int n = codein_snapshot_num_lines(ix->snap);
+    if (y >= n) y = n - 1;
+    if (y < 0) return 0;
+    uint64_t len = ix->line_off[y + 1] - ix->line_off[y] - 1;
+    return ix->line_off[y] + ((uint64_t)x < len ? (uint64_t)x : len);
+}
+
+static void position_of(const JsonIndex *ix, uint64_t pos, int *y, int *x)
+{
+    int lo = 0, hi = codein_snapshot_num_lines(ix->snap) - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (ix->line_off[mid] <= pos) lo = mid;
+        else hi = mid - 1;
+    }
+    *y = lo;
+    *x = pos - ix->line_off[lo];
+}
+
+// first non-blank byte after pos, as a document position
+static uint64_t skip_blank(const JsonIndex *ix, uint64_t pos)
+{
+    int y, x, n = codein_snapshot_num_lines(ix->snap);
+    position_of(ix, pos, &y, &x);
+    for (; y < n; ++y, x = 0) {
+        const char *s = codein_snapshot_line(ix->snap, y);
+        size_t len = ix->line_off[y + 1] - ix->line_off[y] - 1;
+        while ((size_t)x < len && strchr(" \t\r", s[x])) x++;
+        if ((size_t)x < len) return ix->line_off[y] + x;
+    }
+    return pos;
+}
+
+// last token at or before pos; -1 if none
+static int32_t token_at(const JsonIndex *ix, uint64_t pos)
+{
+    size_t lo = 0, hi = ix->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ix->nodes[mid].pos <= pos) lo = mid + 1;
+        else hi = mid;
+    }
+    return (int32_t)lo - 1;
+}
+
+// container holding pos and the start of the element pos is in
+static void context_of(const JsonIndex *ix, uint64_t pos, int32_t *c, int32_t *s)
+{
+    int32_t i = token_at(ix, pos);
+    *c = *s = -1;
+    if (i < 0) return;
+    const JsonNode *n = &ix->nodes[i];
+    if ((n->c == '{' || n->c == '[') && n->pos < pos) {
+        *c = *s = i; // inside, in the first element
+    } else if (n->c == ',' && n->parent >= 0) {
+        *c = n->parent;
+        *s = i;
+    } else {
+        // on a bracket, past a closing one, or after a colon
+        *c = n->parent;
+        *s = n->elem_start;
+    }
+}
+
+static void key_after(const JsonIndex *ix, uint64_t pos, char *buf, size_t size)
+{
+    int y, x;
+    position_of(ix, skip_blank(ix, pos + 1), &y, &x);
+    const char *s = codein_snapshot_line(ix->snap, y) + x;
+    if (*s != '"') {
+        snprintf(buf, size, "?");
+        return;
+    }
+    size_t len = 1;
+    while (s[len] && s[len] != '"' && len < MAX_KEY) len += s[len] == '\\' && s[len + 1] ? 2 : 1;
+    snprintf(buf, size, "%.*s%s", (int)len - 1, s + 1, s[len] == '"' ? "" : "...");
+}
+
+void json_path(const JsonIndex *ix, int y, int x, char *buf, size_t size)
+{
+    int32_t c, s, levels[MAX_PATH_DEPTH][2];
+    int depth = 0, truncated = 0;
+    context_of(ix, offset_of(ix, y, x), &c, &s);
+    while (c >= 0) {
+        if (depth == MAX_PATH_DEPTH) {
+            // keep the innermost levels
+            memmove(levels, levels + 1, sizeof(levels[0]) * (MAX_PATH_DEPTH - 1));
+            depth--;
+            truncated = 1;
+        }
+        levels[depth][0] = c;
+        levels[depth][1] = s;
+        depth++;
+        s = ix->nodes[c].elem_start;
+        c = ix->nodes[c].parent;
+    }
+    size_t used = snprintf(buf, size, truncated ? "$..." : "$");
+    for (int d = depth - 1; d >= 0 && used < size; --d) {
+        const JsonNode *cn = &ix->nodes[levels[d][0]];
+        const JsonNode *sn = &ix->nodes[levels[d][1]];
+        if (cn->c == '[') {
+            used += snprintf(buf + used, size - used, "[%u]", sn->elem);
+        } else {
+            char key[MAX_KEY + 8];
+            key_after(ix, sn->pos, key, sizeof(key));
+            used += snprintf(buf + used, size - used, ".%s", key);
+        }
+    }
+}
+
+int json_jump(const JsonIndex *ix, int how, int y, int x, int *ny, int *nx)
+{
+    uint64_t pos = offset_of(ix, y, x), target;
+    int32_t c, s, i = token_at(ix, pos);
+    context_of(ix, pos, &c, &s);
+    if (how == JSON_MATCH) {
+        // on a bracket: its partner; elsewhere: the end of the container
+        if (i >= 0 && ix->nodes[i].pos == pos && ix->nodes[i].match >= 0)
+            target = ix->nodes[ix->nodes[i].match].pos;
+        else if (c >= 0 && ix->nodes[c].match >= 0)
+            target = ix->nodes[ix->nodes[c].match].pos;
+        else
+            return 0;
+    } else if (how == JSON_PARENT) {
+        if (c < 0) return 0;
+        target = ix->nodes[c].pos;
+    } else {
+        if (s < 0) return 0;
+        int32_t sib = how == JSON_NEXT ? ix->nodes[s].next : ix->nodes[s].prev;
+        if (sib < 0) return 0;
+        target = skip_blank(ix, ix->nodes[sib].pos + 1);
+    }
+    position_of(ix, target, ny, nx);
+    return 1;
+}
@@ -0,0 +1,33 @@
+/*
+ * Structural index for navigating large JSON documents
+ * - Built from a snapshot in two stages: a SIMD pass finds the brackets,
+ *   colons and commas outside strings, then one pass over those links
+ *   every token to its container and to its neighbouring elements
+ * - Lookups binary search the token positions, so jumps and the status
+ *   line path cost O(log n + depth) on documents of any shape, including
+ *   one gigantic line
+ */
+
+#ifndef CODEIN_JSON_H
+#define CODEIN_JSON_H
+
+#include "codein.h"
+#include "pool.h"
+
+typedef struct JsonIndex JsonIndex;
+
+int json_detect(Codein *ed); // .json name, or text starting with { or [
+// NULL when cancelled or out of memory; keeps a reference to the snapshot
+JsonIndex *json_index_build(CodeinSnapshot *s, CancelToken *tok);
+void json_index_free(JsonIndex *ix);
+unsigned long json_index_version(const JsonIndex *ix);
+size_t json_index_tokens(const JsonIndex *ix);
+
+// path of the value at (y, x), e.g. `$.items[4812].meta`
+void json_path(const JsonIndex *ix, int y, int x, char *buf, size_t size);
+
+enum { JSON_PARENT, JSON_NEXT, JSON_PREV, JSON_MATCH };
+// target of a structural jump from (y, x); 0 when there is none
+int json_jump(const JsonIndex *ix, int how, int y, int x, int *ny, int *nx);
+
+#endif
@@ -0,0 +1,290 @@
+/*
+ * Timestamps in log files
+ *
+ * The index keeps one sample per INDEX_STEP lines: the first line of the
+ * interval that carries a timestamp. Building it parses 1/INDEX_STEP of
+ * the file, and a lookup is a binary search over the samples followed by
+ * a scan of one interval, since lines between samples are unindexed.
+ * Logs are assumed to be in time order; a bare time of day that wraps
+ * past midnight is not unwrapped.
+ */
+
+#include "logtime.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define INDEX_STEP 256
+#define DETECT_LINES 50
+#define DAY_MS 86400000LL
+
+struct LogIndex {
+    CodeinSnapshot *snap;
+    int fmt;
+    int *line;
+    int64_t *ms;
+    int count, cap;
+};
+
+static const char *const months[] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec",
+};
+
+// days since 1970-01-01 of a proleptic Gregorian date
+static int64_t days_from_civil(int64_t y, int m, int d)
+{
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+// n digits at s; -1 if any is not a digit
+static int digits(const char *s, int n)
+{
+    int v = 0;
+    for (int i = 0; i < n; ++i) {
+        if (!isdigit((unsigned char)s[i])) return -1;
+        v = v * 10 + s[i] - '0';
+    }
+    return v;
+}
+
+// "HH:MM:SS[.fff]" at s; returns the characters used, 0 if none
+static int parse_clock(const char *s, int64_t *ms)
+{
+    int h = digits(s, 2);
+    if (h < 0 || h > 23 || s[2] != ':') return 0;
+    int m = digits(s + 3, 2);
+    if (m < 0 || m > 59 || s[5] != ':') return 0;
+    int sec = digits(s + 6, 2);
+    if (sec < 0 || sec > 60) return 0;
+    int used = 8, frac = 0, scale = 100;
+    if (s[8] == '.' || s[8] == ',') {
+        for (used = 9; isdigit((unsigned char)s[used]); ++used) {
+            frac += (s[used] - '0') * scale;
+            scale /= 10;
+        }
+    }
+    *ms = ((h * 60LL + m) * 60 + sec) * 1000 + frac;
+    return used;
+}
+
+static int month_index(const char *s)
+{
+    for (int i = 0; i < 12; ++i)
+        if (strncmp(s, months[i], 3) == 0) return i + 1;
+    return -1;
+}
+
+int logts_parse(int fmt, const char *s, int64_t *ms)
+{
+    while (*s == ' ' || *s == '[') s++;
+    int64_t tod;
+    if (fmt == LOGTS_ISO) {
+        // 2024-01-01T00:00:00.000Z or 2024-01-01 00:00:00
+        int y = digits(s, 4);
+        if (y < 0 || s[4] != '-') return 0;
+        int mo = digits(s + 5, 2);
+        if (mo < 1 || mo > 12 || s[7] != '-') return 0;
+        int d = digits(s + 8, 2);
+        if (d < 1 || d > 31) return 0;
+        if ((s[10] != 'T' && s[10] != ' ') || !parse_clock(s + 11, &tod)) return 0;
+        *ms = days_from_civil(y, mo, d) * DAY_MS + tod;
+        return 1;
+    }
+    if (fmt == LOGTS_CLF) {
+        // 10/Oct/2000:13:55:36
+        int d = digits(s, 2);
+        if (d < 1 || d > 31 || s[2] != '/') return 0;
+        int mo = month_index(s + 3);
+        if (mo < 0 || s[6] != '/') return 0;
+        int y = digits(s + 7, 4);
+        if (y < 0 || s[11] != ':' || !parse_clock(s + 12, &tod)) return 0;
+        *ms = days_from_civil(y, mo, d) * DAY_MS + tod;
+        return 1;
+    }
+    if (fmt == LOGTS_SYSLOG) {
+        // Oct  3 13:55:36, without a year: placed in 1970
+        int mo = month_index(s), d;
+        if (mo < 0 || s[3] != ' ') return 0;
+        d = s[4] == ' ' ? digits(s + 5, 1) : digits(s + 4, 2);
+        if (d < 1 || s[6] != ' ' || !parse_clock(s + 7, &tod)) return 0;
+        *ms = days_from_civil(1970, mo, d) * DAY_MS + tod;
+        return 1;
+    }
+    if (fmt == LOGTS_EPOCH) {
+        // 1700000000[.123] or 1700000000123
+        int n = 0;
+        int64_t v = 0;
+        while (isdigit((unsigned char)s[n]) && n < 13) v = v * 10 + s[n++] - '0';
+        if (isdigit((unsigned char)s[n]) || (n != 10 && n != 13)) return 0;
+        if (n == 10) {
+            v *= 1000;
+            if (s[n] == '.') {
+                int scale = 100;
+                for (int i = n + 1; isdigit((unsigned char)s[i]) && scale; ++i, scale /= 10)
+                    v += (s[i] - '0') * scale;
+            }
+        }
+        *ms = v;
+        return 1;
+    }
+    if (fmt == LOGTS_TIME) return parse_clock(s, ms) > 0;
+    return 0;
+}
+
+const char *logts_name(int fmt)
+{
+    static const char *const names[] = { "none", "ISO 8601", "CLF", "syslog", "epoch", "time of day" };
+    return fmt >= 0 && fmt <= LOGTS_TIME ? names[fmt] : "none";
+}
+
+int logts_detect(Codein *ed)
+{
+    for (int fmt = LOGTS_ISO; fmt <= LOGTS_TIME; ++fmt) {
+        int lines = 0, hits = 0;
+        for (int y = 0; y < codein_num_lines(ed) && lines < DETECT_LINES; ++y) {
+            if (!codein_line(ed, y)[0]) continue;
+            int64_t ms;
+            lines++;
+            hits += logts_parse(fmt, codein_line(ed, y), &ms);
+        }
+        // continuation lines (stack traces) need not carry a stamp
+        if (lines && hits * 2 >= lines) return fmt;
+    }
+    return LOGTS_NONE;
+}
+
+int logts_parse_query(int fmt, const char *q, int64_t ref, int64_t *ms)
+{
+    int y, mo, d, n = 0;
+    int64_t tod = 0;
+    while (*q == ' ') q++;
+    if (sscanf(q, "%4d-%2d-%2d%n", &y, &mo, &d, &n) == 3 && n == 10) {
+        if (mo < 1 || mo > 12 || d < 1 || d > 31) return -1;
+        q += 10;
+        while (*q == ' ' || *q == 'T') q++;
+        if (*q) {
+            char clock[16];
+            snprintf(clock, sizeof(clock), "%s%s", q, strlen(q) == 5 ? ":00" : "");
+            if (!parse_clock(clock, &tod)) return -1;
+        }
+        if (fmt == LOGTS_SYSLOG) y = 1970;
+        *ms = days_from_civil(y, mo, d) * DAY_MS + tod;
+        return 0;
+    }
+    char clock[16];
+    snprintf(clock, sizeof(clock), "%s%s", q, strlen(q) == 5 ? ":00" : "");
+    if (!parse_clock(clock, &tod)) return -1;
+    int64_t day = ref >= 0 ? ref / DAY_MS : (ref - DAY_MS + 1) / DAY_MS;
+    *ms = (fmt == LOGTS_TIME ? 0 : day * DAY_MS) + tod;
+    return 0;
+}
+
+void logts_format(int64_t ms, char *buf, size_t size)
+{
+    time_t t = ms / 1000;
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(buf, size, "%Y-%m-%d %H:%M:%S", &tm);
+}
+
+static int add_sample(LogIndex *ix, int y, int64_t ms)
+{
+    if (ix->count == ix->cap) {
+        int ncap = ix->cap ? ix->cap * 2 : 1024;
+        int *nl = realloc(ix->line, sizeof(int) * ncap);
+        if (nl) ix->line = nl;
+        int64_t *nm = realloc(ix->ms, sizeof(int64_t) * ncap);
+        if (nm) ix->ms = nm;
+        if (!nl || !nm) return -1;
+        ix->cap = ncap;
+    }
+    ix->line[ix->count] = y;
+    ix->ms[ix->count] = ms;
+    ix->count++;
+    return 0;
+}
+
+LogIndex *log_index_build(CodeinSnapshot *s, int fmt, CancelToken *tok)
+{
+    LogIndex *ix = calloc(1, sizeof(*ix));
+    if (!ix) return NULL;
+    ix->fmt = fmt;
+    int n = codein_snapshot_num_lines(s);
+    for (int base = 0; base < n; base += INDEX_STEP) {
+        if ((base & (INDEX_STEP * 64 - 1)) == 0 && task_cancelled(tok)) break;
+        int end = base + INDEX_STEP < n ? base + INDEX_STEP : n;
+        for (int y = base; y < end; ++y) {
+            int64_t ms;
+            if (!logts_parse(fmt, codein_snapshot_line(s, y), &ms)) continue;
+            if (add_sample(ix, y, ms) < 0) {
+                log_index_free(ix);
+                return NULL;
+            }
+            break;
+        }
+    }
+    if (task_cancelled(tok)) {
+        log_index_free(ix);
+        return NULL;
+    }
+    ix->snap = s;
+    return ix;
+}
+
+void log_index_free(LogIndex *ix)
+{
+    if (!ix) return;
+    codein_snapshot_release(ix->snap);
+    free(ix->line);
+    free(ix->ms);
+    free(ix);
+}
+
+unsigned long log_index_version(const LogIndex *ix)
+{
+    return codein_snapshot_version(ix->snap);
+}
+
+int log_index_find(const LogIndex *ix, Codein *ed, int64_t ms)
+{
+    // first sample at or after the target; the match is in the interval before it
+    int lo = 0, hi = ix->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (ix->ms[mid] < ms) lo = mid + 1;
+        else hi = mid;
+    }
+    int from = lo > 0 ? ix->line[lo - 1] : 0;
+    int last = codein_num_lines(ed) - 1, to = lo < ix->count ? ix->line[lo] : last;
+    if (to > last) to = last; // the buffer shrank since
+    for (int y = from; y <= to; ++y) {
+        int64_t t;
+        if (logts_parse(ix->fmt, codein_line(ed, y), &t) && t >= ms) return y;
+    }
+    return -1;
+}
+
+int log_time_at(const LogIndex *ix, Codein *ed, int y, int64_t *ms)
+{
+    for (int i = y; i >= 0 && i > y - INDEX_STEP; --i)
+        if (i < codein_num_lines(ed) && logts_parse(ix->fmt, codein_line(ed, i), ms)) return 1;
+    // fall back to the sample before y
+    int lo = 0, hi = ix->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (ix->line[mid] <= y) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo > 0) *ms = ix->ms[lo - 1];
+    else if (ix->count) *ms = ix->ms[0];
+    else return 0;
+    return 1;
+}
@@ -0,0 +1,40 @@
+/*
+ * Timestamps in log files
+ * - The format is detected from the first lines: ISO 8601, Common Log
+ *   Format, syslog, Unix epoch or a bare time of day at the line start
+ * - A sparse index of (line, time) samples is built from a snapshot in
+ *   the background; a jump binary searches it and parses at most one
+ *   sample interval of lines
+ * - Times are milliseconds since 1970-01-01 as written, ignoring zones
+ */
+
+#ifndef CODEIN_LOGTIME_H
+#define CODEIN_LOGTIME_H
+
+#include "codein.h"
+#include "pool.h"
+
+#include <stdint.h>
+
+enum { LOGTS_NONE, LOGTS_ISO, LOGTS_CLF, LOGTS_SYSLOG, LOGTS_EPOCH, LOGTS_TIME };
+
+typedef struct LogIndex LogIndex;
+
+int logts_detect(Codein *ed);
+const char *logts_name(int fmt);
+// 1 if the line starts with a timestamp in format fmt
+int logts_parse(int fmt, const char *s, int64_t *ms);
+// "HH:MM[:SS]" (on the day of `ref`) or "YYYY-MM-DD[ HH:MM[:SS]]"; -1 if malformed
+int logts_parse_query(int fmt, const char *q, int64_t ref, int64_t *ms);
+void logts_format(int64_t ms, char *buf, size_t size);
+
+// NULL when cancelled or out of memory; keeps a reference to the snapshot
+LogIndex *log_index_build(CodeinSnapshot *s, int fmt, CancelToken *tok);
+void log_index_free(LogIndex *ix);
+unsigned long log_index_version(const LogIndex *ix);
+// first line of the live buffer stamped at or after `ms`; -1 if none
+int log_index_find(const LogIndex *ix, Codein *ed, int64_t ms);
+// time of line y, or of the nearest stamped line before it; 0 if none
+int log_time_at(const LogIndex *ix, Codein *ed, int y, int64_t *ms);
+
+#endif
@@ -0,0 +1,1190 @@
+/*
+ * Language server client
+ *
+ * Messages are "Content-Length: n\r\n\r\n" headers and a JSON body. The
+ * editor thread builds outgoing bodies and queues them; the I/O thread
+ * writes the queue as the pipe accepts it and reads frames back, parsing
+ * each body into a small tree that is posted whole to the editor thread.
+ * Every delivery in flight holds the client, so lsp_stop() leaves the
+ * last free to whichever of them runs last.
+ */
+
+#define _GNU_SOURCE
+#include "lsp.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/eventfd.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define READ_CHUNK 65536
+#define MAX_DEPTH 64            // deeper JSON is rejected
+#define MAX_ITEMS 200           // completion items kept
+#define MAX_HOVER 1024
+#define MAX_PENDING 65536       // batched change text before a full resend is cheaper
+#define EXIT_WAIT_MS 500        // for the server to close its output after "exit"
+#define KILL_WAIT_MS 100        // then for it to go once its pipes are closed
+
+extern char **environ;
+
+enum { J_NULL, J_BOOL, J_NUM, J_STR, J_ARR, J_OBJ };
+
+typedef struct JVal JVal;
+struct JVal {
+    int type;
+    long long num;              // J_NUM (integral part) and J_BOOL
+    char *str;                  // J_STR
+    char *key;                  // member name when inside an object
+    JVal *child, *next;
+};
+
+typedef struct {
+    char *s;
+    size_t len, cap;
+    int failed;                 // an allocation failed: the contents are incomplete
+} Buf;
+
+typedef struct OutMsg {
+    char *data;
+    size_t len, off;
+    struct OutMsg *next;
+} OutMsg;
+
+typedef struct {
+    Lsp *lsp;
+    JVal *msg;                  // NULL: the server closed its output
+} Delivery;
+
+struct Lsp {
+    Codein *ed;
+    int (*post)(void (*fn)(void *), void *);
+    void (*handler)(void *arg, const LspEvent *ev);
+    void *arg;
+
+    pid_t pid;
+    int in_fd, out_fd, wake_fd;
+    pthread_t thread;
+    pthread_mutex_t lock;       // guards the queue and `stopping`
+    OutMsg *head, *tail;
+    int stopping;
+    atomic_int in_flight;       // deliveries posted and not yet run
+
+    // editor thread only from here on
+    int stopped, dead;
+    int ready;                  // initialize was answered
+    int utf8;                   // the server counts columns in bytes, not UTF-16 units
+    int opened;                 // the buffer's document is open on the server
+    char *uri;
+    int doc_version;
+    Buf changes;                // contentChanges not yet sent, comma separated
+    int full;                   // resend the whole text instead
+    int next_id, init_id, def_id, hover_id, complete_id;
+    LspDiag *diags;
+    int ndiags;
+    LspItem *items;
+    int nitems;
+};
+
+static void buf_add(Buf *b, const char *s, size_t n)
+{
+    if (b->failed) return;
+    if (b->len + n + 1 > b->cap) {
+        size_t ncap = b->cap ? b->cap : 256;
+        while (ncap < b->len + n + 1) ncap *= 2;
+        char *ns = realloc(b->s, ncap);
+        if (!ns) {
+            b->failed = 1;
+            return;
+        }
+        b->s = ns;
+        b->cap = ncap;
+    }
+    memcpy(b->s + b->len, s, n);
+    b->len += n;
+    b->s[b->len] = '\0';
+}
+
+static void buf_puts(Buf *b, const char *s)
+{
+    buf_add(b, s, strlen(s));
+}
+
+static void buf_printf(Buf *b, const char *fmt, ...)
+{
+    char small[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(small, sizeof(small), fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    if ((size_t)n < sizeof(small)) {
+        buf_add(b, small, n);
+        return;
+    }
+    char *big = malloc(n + 1);
+    if (!big) {
+        b->failed = 1;
+        return;
+    }
+    va_start(ap, fmt);
+    vsnprintf(big, n + 1, fmt, ap);
+    va_end(ap);
+    buf_add(b, big, n);
+    free(big);
+}
+
+// the bytes of s as the inside of a JSON string
+static void buf_escaped(Buf *b, const char *s, size_t n)
+{
+    size_t run = 0;
+    for (size_t i = 0; i < n; ++i) {
+        unsigned char c = s[i];
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        buf_add(b, s + run, i - run);
+        run = i + 1;
+        if (c == '"' || c == '\\') buf_printf(b, "\\%c", c);
+        else if (c == '\n') buf_puts(b, "\\n");
+        else if (c == '\t') buf_puts(b, "\\t");
+        else if (c == '\r') buf_puts(b, "\\r");
+        else buf_printf(b, "\\u%04x", c);
+    }
+    buf_add(b, s + run, n - run);
+}
+
+static void buf_string(Buf *b, const char *s)
+{
+    buf_puts(b, "\"");
+    buf_escaped(b, s, strlen(s));
+    buf_puts(b, "\"");
+}
+
+static void jfree(JVal *v)
+{
+    while (v) {
+        JVal *next = v->next;
+        jfree(v->child);
+        free(v->str);
+        free(v->key);
+        free(v);
+        v = next;
+    }
+}
+
+static void skip_ws(const char **p)
+{
+    while (**p == ' ' || **p == '\t' || **p == '\n' || **p == '\r') (*p)++;
+}
+
+static int hex_digit(int c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static int hex4(const char *s)
+{
+    int v = 0;
+    for (int i = 0; i < 4; ++i) {
+        int d = hex_digit(s[i]);
+        if (d < 0) return -1;
+        v = v << 4 | d;
+    }
+    return v;
+}
+
+static void add_utf8(Buf *b, uint32_t cp)
+{
+    char out[4];
+    int n;
+    if (cp < 0x80) {
+        out[0] = cp;
+        n = 1;
+    } else if (cp < 0x800) {
+        out[0] = 0xc0 | cp >> 6;
+        out[1] = 0x80 | (cp & 0x3f);
+        n = 2;
+    } else if (cp < 0x10000) {
+        out[0] = 0xe0 | cp >> 12;
+        out[1] = 0x80 | (cp >> 6 & 0x3f);
+        out[2] = 0x80 | (cp & 0x3f);
+        n = 3;
+    } else {
+        out[0] = 0xf0 | cp >> 18;
+        out[1] = 0x80 | (cp >> 12 & 0x3f);
+        out[2] = 0x80 | (cp >> 6 & 0x3f);
+        out[3] = 0x80 | (cp & 0x3f);
+        n = 4;
+    }
+    buf_add(b, out, n);
+}
+
+// *p is at the opening quote; NULL on a malformed string
+static char *parse_string(const char **p)
+{
+    Buf b = {0};
+    const char *s = *p + 1;
+    while (*s && *s != '"') {
+        if (*s != '\\') {
+            const char *e = s;
+            while (*e && *e != '"' && *e != '\\') e++;
+            buf_add(&b, s, e - s);
+            s = e;
+            continue;
+        }
+        char c = s[1];
+        if (!c) break;
+        s += 2;
+        if (c == 'n') buf_puts(&b, "\n");
+        else if (c == 't') buf_puts(&b, "\t");
+        else if (c == 'r') buf_puts(&b, "\r");
+        else if (c == 'b') buf_puts(&b, "\b");
+        else if (c == 'f') buf_puts(&b, "\f");
+        else if (c == '"' || c == '\\' || c == '/') buf_add(&b, &c, 1);
+        else if (c == 'u') {
+            int u = hex4(s);
+            if (u < 0) break;
+            s += 4;
+            if (u >= 0xd800 && u < 0xdc00 && s[0] == '\\' && s[1] == 'u') {
+                int lo = hex4(s + 2);
+                if (lo >= 0xdc00 && lo < 0xe000) {
+                    u = 0x10000 + ((u - 0xd800) << 10) + (lo - 0xdc00);
+                    s += 6;
+                }
+            }
+            add_utf8(&b, u >= 0xd800 && u < 0xe000 ? 0xfffd : u);
+        } else {
+            break;
+        }
+    }
+    if (*s != '"' || b.failed) {
+        free(b.s);
+        return NULL;
+    }
+    *p = s + 1;
+    return b.s ? b.s : strdup("");
+}
+
+static JVal *parse_value(const char **p, int depth)
+{
+    skip_ws(p);
+    if (depth > MAX_DEPTH) return NULL;
+    JVal *v = calloc(1, sizeof(*v));
+    if (!v) return NULL;
+    char c = **p;
+    if (c == '{' || c == '[') {
+        char close = c == '{' ? '}' : ']';
+        v->type = c == '{' ? J_OBJ : J_ARR;
+        (*p)++;
+        skip_ws(p);
+        if (**p == close) {
+            (*p)++;
+            return v;
+        }
+        JVal **tail = &v->child;
+        for (;;) {
+            char *key = NULL;
+            if (v->type == J_OBJ) {
+                skip_ws(p);
+                if (**p != '"' || !(key = parse_string(p))) break;
+                skip_ws(p);
+                if (**p != ':') {
+                    free(key);
+                    break;
+                }
+                (*p)++;
+            }
+            JVal *item = parse_value(p, depth + 1);
+            if (!item) {
+                free(key);
+                break;
+            }
+            item->key = key;
+            *tail = item;
+            tail = &item->next;
+            skip_ws(p);
+            if (**p == ',') {
+                (*p)++;
+                continue;
+            }
+            if (**p == close) {
+                (*p)++;
+                return v;
+            }
+            break;
+        }
+        jfree(v);
+        return NULL;
+    }
+    if (c == '"') {
+        v->str = parse_string(p);
+        v->type = J_STR;
+        if (v->str) return v;
+    } else if (strncmp(*p, "true", 4) == 0 || strncmp(*p, "false", 5) == 0) {
+        v->type = J_BOOL;
+        v->num = c == 't';
+        *p += c == 't' ? 4 : 5;
+        return v;
+    } else if (strncmp(*p, "null", 4) == 0) {
+        *p += 4;
+        return v;
+    } else if (c == '-' || isdigit((unsigned char)c)) {
+        // positions and ids are integers; a fraction or exponent is skipped
+        char *end;
+        v->num = strtoll(*p, &end, 10);
+        while (*end == '.' || *end == 'e' || *end == 'E' || *end == '+' || *end == '-' ||
+               isdigit((unsigned char)*end))
+            end++;
+        *p = end;
+        v->type = J_NUM;
+        return v;
+    }
+    free(v);
+    return NULL;
+}
+
+static JVal *jget(const JVal *obj, const char *key)
+{
+    if (!obj || obj->type != J_OBJ) return NULL;
+    for (JVal *m = obj->child; m; m = m->next)
+        if (strcmp(m->key, key) == 0) return m;
+    return NULL;
+}
+
+static const char *jstr(const JVal *v)
+{
+    return v && v->type == J_STR ? v->str : NULL;
+}
+
+static long long jnum(const JVal *v, long long def)
+{
+    return v && v->type == J_NUM ? v->num : def;
+}
+
+/* Outgoing messages */
+
+static void wake(Lsp *lsp)
+{
+    uint64_t one = 1;
+    if (write(lsp->wake_fd, &one, sizeof(one)) < 0) {
+        // counter saturated: the thread is awake anyway
+    }
+}
+
+// queue a finished body; a body that failed to build is dropped
+static void send_body(Lsp *lsp, Buf *body)
+{
+    char head[64];
+    int hn = snprintf(head, sizeof(head), "Content-Length: %zu\r\n\r\n", body->len);
+    OutMsg *m = NULL;
+    char *data = NULL;
+    if (!lsp->dead && !body->failed && body->s) {
+        m = malloc(sizeof(*m));
+        data = malloc(hn + body->len);
+    }
+    if (!m || !data) {
+        free(m);
+        free(data);
+        free(body->s);
+        return;
+    }
+    memcpy(data, head, hn);
+    memcpy(data + hn, body->s, body->len);
+    free(body->s);
+    m->data = data;
+    m->len = hn + body->len;
+    m->off = 0;
+    m->next = NULL;
+    pthread_mutex_lock(&lsp->lock);
+    if (lsp->tail) lsp->tail->next = m;
+    else lsp->head = m;
+    lsp->tail = m;
+    pthread_mutex_unlock(&lsp->lock);
+    wake(lsp);
+}
+
+// start a message; params follow and end_message() closes it
+static void begin_message(Buf *b, const char *method, int id)
+{
+    buf_puts(b, "{\"jsonrpc\":\"2.0\",");
+    if (id) buf_printf(b, "\"id\":%d,", id);
+    buf_printf(b, "\"method\":\"%s\",\"params\":", method);
+}
+
+static void end_message(Lsp *lsp, Buf *b)
+{
+    buf_puts(b, "}");
+    send_body(lsp, b);
+}
+
+// columns in the units the server counts, for byte column x of line s
+static int to_server_col(const Lsp *lsp, const char *s, int x)
+{
+    if (lsp->utf8) return x;
+    int units = 0;
+    for (int i = 0; i < x && s[i]; ++i) {
+        unsigned char c = s[i];
+        if ((c & 0xc0) != 0x80) units += c >= 0xf0 ? 2 : 1;
+    }
+    return units;
+}
+
+static int from_server_col(const Lsp *lsp, const char *s, long long col)
+{
+    int len = strlen(s);
+    if (col < 0) return 0;
+    if (lsp->utf8) return col < len ? col : len;
+    int i = 0;
+    for (long long units = 0; i < len && units < col;) {
+        unsigned char c = s[i++];
+        units += c >= 0xf0 ? 2 : 1;
+        while (i < len && (s[i] & 0xc0) == 0x80) i++;
+    }
+    return i;
+}
+
+static const char *buffer_line(const Lsp *lsp, long long y)
+{
+    const char *ln = y >= 0 && y < INT_MAX ? codein_line(lsp->ed, (int)y) : NULL;
+    return ln ? ln : "";
+}
+
+static void add_position(Buf *b, const Lsp *lsp, int y, int x)
+{
+    buf_printf(b, "{\"line\":%d,\"character\":%d}", y, to_server_col(lsp, buffer_line(lsp, y), x));
+}
+
+// the buffer as the server sees it: lines joined by "\n"
+static void add_text(Buf *b, const Codein *ed)
+{
+    buf_puts(b, "\"");
+    int n = codein_num_lines(ed);
+    for (int y = 0; y < n; ++y) {
+        const char *ln = codein_line(ed, y);
+        buf_escaped(b, ln, strlen(ln));
+        if (y < n - 1 || codein_format(ed)->final_newline) buf_puts(b, "\\n");
+    }
+    buf_puts(b, "\"");
+}
+
+static void add_uri_bytes(Buf *b, const char *s)
+{
+    for (; *s; ++s) {
+        unsigned char c = *s;
+        if (isalnum(c) || strchr("-._~/", c)) buf_add(b, s, 1);
+        else buf_printf(b, "%%%02X", c);
+    }
+}
+
+static char *path_to_uri(const char *path)
+{
+    char cwd[PATH_MAX];
+    Buf b = {0};
+    buf_puts(&b, "file://");
+    if (path[0] != '/' && getcwd(cwd, sizeof(cwd))) {
+        add_uri_bytes(&b, cwd);
+        buf_puts(&b, "/");
+    }
+    add_uri_bytes(&b, path);
+    if (b.failed) {
+        free(b.s);
+        return NULL;
+    }
+    return b.s;
+}
+
+static char *uri_to_path(const char *uri)
+{
+    if (strncmp(uri, "file://", 7) != 0) return NULL;
+    const char *s = uri + 7;
+    char *out = malloc(strlen(s) + 1), *o = out;
+    if (!out) return NULL;
+    for (; *s; ++s) {
+        if (*s == '%' && hex_digit(s[1]) >= 0 && hex_digit(s[2]) >= 0) {
+            *o++ = hex_digit(s[1]) << 4 | hex_digit(s[2]);
+            s += 2;
+        } else {
+            *o++ = *s;
+        }
+    }
+    *o = '\0';
+    return out;
+}
+
+static const char *language_id(const char *path)
+{
+    static const char *const ids[][2] = {
+        { ".c", "c" }, { ".h", "c" }, { ".cc", "cpp" }, { ".cpp", "cpp" }, { ".cxx", "cpp" },
+        { ".hh", "cpp" }, { ".hpp", "cpp" }, { ".hxx", "cpp" }, { ".py", "python" },
+        { ".rs", "rust" }, { ".go", "go" }, { ".js", "javascript" }, { ".ts", "typescript" },
+        { ".java", "java" }, { ".sh", "shellscript" },
+    };
+    const char *dot = strrchr(path, '.');
+    if (dot && !strchr(dot, '/'))
+        for (size_t i = 0; i < sizeof(ids) / sizeof(ids[0]); ++i)
+            if (strcmp(dot, ids[i][0]) == 0) return ids[i][1];
+    return "plaintext";
+}
+
+static void open_document(Lsp *lsp)
+{
+    const char *path = codein_filename(lsp->ed);
+    free(lsp->uri);
+    lsp->uri = path[0] ? path_to_uri(path) : NULL;
+    lsp->opened = 0;
+    if (!lsp->uri) return;
+    Buf b = {0};
+    begin_message(&b, "textDocument/didOpen", 0);
+    buf_puts(&b, "{\"textDocument\":{\"uri\":");
+    buf_string(&b, lsp->uri);
+    buf_printf(&b, ",\"languageId\":\"%s\",\"version\":%d,\"text\":", language_id(path), ++lsp->doc_version);
+    add_text(&b, lsp->ed);
+    buf_puts(&b, "}}");
+    end_message(lsp, &b);
+    lsp->opened = 1;
+    lsp->full = 0;
+    lsp->changes.len = 0;
+}
+
+static void close_document(Lsp *lsp)
+{
+    if (!lsp->opened) return;
+    Buf b = {0};
+    begin_message(&b, "textDocument/didClose", 0);
+    buf_puts(&b, "{\"textDocument\":{\"uri\":");
+    buf_string(&b, lsp->uri);
+    buf_puts(&b, "}}");
+    end_message(lsp, &b);
+    lsp->opened = 0;
+}
+
+// editor change hook: one span edit becomes one contentChanges entry
+static void on_change(void *arg, int y, int x, const char *removed, const char *inserted)
+{
+    Lsp *lsp = arg;
+    if (!lsp->opened || lsp->full) return;
+    // a lone byte of a multibyte character has no UTF-16 position
+    int ascii = 1;
+    for (const char *p = removed; p && *p; ++p) ascii &= (unsigned char)*p < 0x80;
+    for (const char *p = inserted; p && *p; ++p) ascii &= (unsigned char)*p < 0x80;
+    if (y < 0 || !ascii || lsp->changes.len > MAX_PENDING) {
+        lsp->full = 1;
+        lsp->changes.len = 0;
+        return;
+    }
+    // the text before x is the same before and after the edit
+    int col = to_server_col(lsp, buffer_line(lsp, y), x);
+    int end_y = y, end_col = col;
+    if (strcmp(removed, "\n") == 0) {
+        end_y = y + 1;
+        end_col = 0;
+    } else {
+        end_col += strlen(removed);
+    }
+    Buf *b = &lsp->changes;
+    if (b->len) buf_puts(b, ",");
+    buf_printf(b, "{\"range\":{\"start\":{\"line\":%d,\"character\":%d},\"end\":{\"line\":%d,\"character\":%d}},\"text\":",
+               y, col, end_y, end_col);
+    buf_string(b, inserted);
+    buf_puts(b, "}");
+    if (b->failed) {
+        free(b->s);
+        *b = (Buf){0};
+        lsp->full = 1;
+    }
+}
+
+void lsp_flush(Lsp *lsp)
+{
+    if (!lsp || !lsp->opened || (!lsp->full && !lsp->changes.len)) return;
+    Buf b = {0};
+    begin_message(&b, "textDocument/didChange", 0);
+    buf_puts(&b, "{\"textDocument\":{\"uri\":");
+    buf_string(&b, lsp->uri);
+    buf_printf(&b, ",\"version\":%d},\"contentChanges\":[", ++lsp->doc_version);
+    if (lsp->full) {
+        buf_puts(&b, "{\"text\":");
+        add_text(&b, lsp->ed);
+        buf_puts(&b, "}");
+    } else {
+        buf_add(&b, lsp->changes.s, lsp->changes.len);
+    }
+    buf_puts(&b, "]}");
+    end_message(lsp, &b);
+    lsp->full = 0;
+    lsp->changes.len = 0;
+}
+
+// a request about the cursor position; returns its id, 0 if not sent
+static int position_request(Lsp *lsp, const char *method)
+{
+    if (!lsp || !lsp->opened) return 0;
+    lsp_flush(lsp);
+    int id = ++lsp->next_id;
+    Buf b = {0};
+    begin_message(&b, method, id);
+    buf_puts(&b, "{\"textDocument\":{\"uri\":");
+    buf_string(&b, lsp->uri);
+    buf_puts(&b, "},\"position\":");
+    int y, x;
+    codein_cursor(lsp->ed, &y, &x);
+    add_position(&b, lsp, y, x);
+    buf_puts(&b, "}");
+    end_message(lsp, &b);
+    return id;
+}
+
+void lsp_definition(Lsp *lsp)
+{
+    int id = position_request(lsp, "textDocument/definition");
+    if (id) lsp->def_id = id;
+}
+
+void lsp_hover(Lsp *lsp)
+{
+    int id = position_request(lsp, "textDocument/hover");
+    if (id) lsp->hover_id = id;
+}
+
+void lsp_complete(Lsp *lsp)
+{
+    int id = position_request(lsp, "textDocument/completion");
+    if (id) lsp->complete_id = id;
+}
+
+/* Incoming messages, on the editor thread */
+
+static void emit(Lsp *lsp, LspEvent *ev)
+{
+    if (lsp->handler) lsp->handler(lsp->arg, ev);
+}
+
+static void clear_diags(Lsp *lsp)
+{
+    for (int i = 0; i < lsp->ndiags; ++i) free(lsp->diags[i].message);
+    free(lsp->diags);
+    lsp->diags = NULL;
+    lsp->ndiags = 0;
+}
+
+static int diag_cmp(const void *a, const void *b)
+{
+    const LspDiag *p = a, *q = b;
+    if (p->y0 != q->y0) return p->y0 < q->y0 ? -1 : 1;
+    return (p->x0 > q->x0) - (p->x0 < q->x0);
+}
+
+static void on_diagnostics(Lsp *lsp, const JVal *params)
+{
+    const char *uri = jstr(jget(params, "uri"));
+    const JVal *list = jget(params, "diagnostics");
+    if (!uri || !lsp->uri || strcmp(uri, lsp->uri) != 0 || !list || list->type != J_ARR) return;
+    clear_diags(lsp);
+    int n = 0;
+    for (const JVal *d = list->child; d; d = d->next) n++;
+    lsp->diags = n ? calloc(n, sizeof(LspDiag)) : NULL;
+    if (!lsp->diags) n = 0;
+    for (const JVal *d = list->child; d && lsp->ndiags < n; d = d->next) {
+        const JVal *range = jget(d, "range"), *start = jget(range, "start"), *end = jget(range, "end");
+        const char *msg = jstr(jget(d, "message"));
+        LspDiag *g = &lsp->diags[lsp->ndiags];
+        g->y0 = jnum(jget(start, "line"), 0);
+        g->y1 = jnum(jget(end, "line"), g->y0);
+        if (g->y1 < g->y0) g->y1 = g->y0;
+        g->x0 = from_server_col(lsp, buffer_line(lsp, g->y0), jnum(jget(start, "character"), 0));
+        g->x1 = from_server_col(lsp, buffer_line(lsp, g->y1), jnum(jget(end, "character"), 0));
+        g->severity = jnum(jget(d, "severity"), 1);
+        g->message = strdup(msg ? msg : "");
+        if (g->message) lsp->ndiags++;
+    }
+    qsort(lsp->diags, lsp->ndiags, sizeof(LspDiag), diag_cmp);
+    emit(lsp, &(LspEvent){ .kind = LSP_DIAGNOSTICS });
+}
+
+// line y of a file that is not in the buffer, for column conversion
+static char *file_line(const char *path, long long y)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) return NULL;
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t n = 0;
+    for (long long i = 0; i <= y && n >= 0; ++i) n = getline(&line, &cap, f);
+    fclose(f);
+    if (n < 0) {
+        free(line);
+        return NULL;
+    }
+    line[strcspn(line, "\r\n")] = '\0';
+    return line;
+}
+
+static void on_definition(Lsp *lsp, const JVal *result)
+{
+    // Location, Location[] or LocationLink[]: the first one is taken
+    const JVal *loc = result && result->type == J_ARR ? result->child : result;
+    const char *uri = jstr(jget(loc, "uri"));
+    const JVal *range = jget(loc, "range");
+    if (!uri) {
+        uri = jstr(jget(loc, "targetUri"));
+        range = jget(loc, "targetSelectionRange");
+    }
+    char *path = uri ? uri_to_path(uri) : NULL;
+    LspEvent ev = { .kind = LSP_DEFINITION, .path = path };
+    if (path) {
+        const JVal *start = jget(range, "start");
+        long long y = jnum(jget(start, "line"), 0), col = jnum(jget(start, "character"), 0);
+        ev.y = y;
+        if (lsp->uri && strcmp(uri, lsp->uri) == 0) {
+            ev.x = from_server_col(lsp, buffer_line(lsp, y), col);
+        } else {
+            char *line = file_line(path, y);
+            ev.x = line ? from_server_col(lsp, line, col) : 0;
+            free(line);
+        }
+    }
+    emit(lsp, &ev);
+    free(path);
+}
+
+// hover contents flattened to one line: code fences dropped, blanks squeezed
+static void flatten(Buf *out, const JVal *v)
+{
+    if (!v) return;
+    if (v->type == J_ARR) {
+        for (const JVal *c = v->child; c; c = c->next) flatten(out, c);
+        return;
+    }
+    const char *s = v->type == J_STR ? v->str : jstr(jget(v, "value"));
+    for (; s && *s && out->len < MAX_HOVER; ++s) {
+        if (strncmp(s, "```", 3) == 0) {
+            s += strcspn(s, "\n");
+            if (!*s) break;
+            continue;
+        }
+        int space = isspace((unsigned char)*s);
+        if (space && (!out->len || out->s[out->len - 1] == ' ')) continue;
+        buf_add(out, space ? " " : s, 1);
+    }
+    if (out->len && out->s[out->len - 1] != ' ') buf_puts(out, " ");
+}
+
+static void on_hover(Lsp *lsp, const JVal *result)
+{
+    Buf text = {0};
+    flatten(&text, jget(result, "contents"));
+    while (text.len && text.s[text.len - 1] == ' ') text.s[--text.len] = '\0';
+    emit(lsp, &(LspEvent){ .kind = LSP_HOVER, .text = text.len ? text.s : "" });
+    free(text.s);
+}
+
+static void clear_items(Lsp *lsp)
+{
+    for (int i = 0; i < lsp->nitems; ++i) {
+        free(lsp->items[i].label);
+        free(lsp->items[i].insert);
+    }
+    free(lsp->items);
+    lsp->items = NULL;
+    lsp->nitems = 0;
+}
+
+static void on_completion(Lsp *lsp, const JVal *result)
+{
+    const JVal *list = result && result->type == J_OBJ ? jget(result, "items") : result;
+    clear_items(lsp);
+    lsp->items = calloc(MAX_ITEMS, sizeof(LspItem));
+    for (const JVal *c = list && list->type == J_ARR ? list->child : NULL;
+         c && lsp->items && lsp->nitems < MAX_ITEMS; c = c->next) {
+        const char *label = jstr(jget(c, "label"));
+        const char *insert = jstr(jget(jget(c, "textEdit"), "newText"));
+        if (!insert) insert = jstr(jget(c, "insertText"));
+        if (!label) continue;
+        while (isspace((unsigned char)*label)) label++;
+        if (!insert) insert = label;
+        LspItem *it = &lsp->items[lsp->nitems];
+        it->label = strdup(label);
+        it->insert = strdup(insert);
+        if (it->label && it->insert) {
+            lsp->nitems++;
+        } else {
+            free(it->label);
+            free(it->insert);
+        }
+    }
+    emit(lsp, &(LspEvent){ .kind = LSP_COMPLETION, .items = lsp->items, .nitems = lsp->nitems });
+}
+
+static void on_initialized(Lsp *lsp, const JVal *result)
+{
+    const char *enc = jstr(jget(jget(result, "capabilities"), "positionEncoding"));
+    if (!enc) enc = jstr(jget(result, "offsetEncoding"));
+    lsp->utf8 = enc && strcmp(enc, "utf-8") == 0;
+    Buf b = {0};
+    begin_message(&b, "initialized", 0);
+    buf_puts(&b, "{}");
+    end_message(lsp, &b);
+    lsp->ready = 1;
+    open_document(lsp);
+}
+
+static void handle_message(Lsp *lsp, const JVal *msg)
+{
+    const JVal *id = jget(msg, "id");
+    const char *method = jstr(jget(msg, "method"));
+    if (method && id) {
+        // a request from the server: none is supported, so answer null
+        Buf b = {0};
+        buf_puts(&b, "{\"jsonrpc\":\"2.0\",\"id\":");
+        if (id->type == J_STR) buf_string(&b, id->str);
+        else buf_printf(&b, "%lld", id->num);
+        buf_puts(&b, ",\"result\":null}");
+        send_body(lsp, &b);
+        return;
+    }
+    if (method) {
+        if (strcmp(method, "textDocument/publishDiagnostics") == 0) on_diagnostics(lsp, jget(msg, "params"));
+        return;
+    }
+    if (!id || id->type != J_NUM || id->num == 0) return;
+    // an answer superseded by a newer request of its kind is dropped
+    const JVal *result = jget(msg, "result");
+    if (id->num == lsp->init_id) on_initialized(lsp, result);
+    else if (id->num == lsp->def_id) on_definition(lsp, result);
+    else if (id->num == lsp->hover_id) on_hover(lsp, result);
+    else if (id->num == lsp->complete_id) on_completion(lsp, result);
+}
+
+static void free_lsp(Lsp *lsp)
+{
+    clear_diags(lsp);
+    clear_items(lsp);
+    while (lsp->head) {
+        OutMsg *m = lsp->head;
+        lsp->head = m->next;
+        free(m->data);
+        free(m);
+    }
+    free(lsp->changes.s);
+    free(lsp->uri);
+    pthread_mutex_destroy(&lsp->lock);
+    free(lsp);
+}
+
+static void deliver(void *arg)
+{
+    Delivery *d = arg;
+    Lsp *lsp = d->lsp;
+    if (!lsp->stopped && d->msg) {
+        handle_message(lsp, d->msg);
+    } else if (!lsp->stopped) {
+        lsp->dead = 1;
+        lsp->opened = 0;
+        emit(lsp, &(LspEvent){ .kind = LSP_EXITED });
+    }
+    jfree(d->msg);
+    free(d);
+    if (atomic_fetch_sub(&lsp->in_flight, 1) == 1 && lsp->stopped) free_lsp(lsp);
+}
+
+/* The I/O thread */
+
+static void post_delivery(Lsp *lsp, JVal *msg)
+{
+    Delivery *d = malloc(sizeof(*d));
+    if (!d) {
+        jfree(msg);
+        return;
+    }
+    d->lsp = lsp;
+    d->msg = msg;
+    atomic_fetch_add(&lsp->in_flight, 1);
+    if (lsp->post(deliver, d) < 0) {
+        atomic_fetch_sub(&lsp->in_flight, 1);
+        jfree(msg);
+        free(d);
+    }
+}
+
+// split complete frames off the front of `in`
+static void read_frames(Lsp *lsp, Buf *in)
+{
+    size_t pos = 0;
+    for (;;) {
+        char *start = in->s + pos;
+        char *end = memmem(start, in->len - pos, "\r\n\r\n", 4);
+        if (!end) break;
+        size_t body_len = 0;
+        for (char *h = start; h < end; h = strstr(h, "\r\n") + 2)
+            if (strncasecmp(h, "Content-Length:", 15) == 0) body_len = strtoul(h + 15, NULL, 10);
+        size_t body = end + 4 - in->s;
+        if (in->len - body < body_len) break;
+        // bodies are parsed in place: terminate this one for the parser
+        char saved = in->s[body + body_len];
+        in->s[body + body_len] = '\0';
+        const char *p = in->s + body;
+        JVal *msg = parse_value(&p, 0);
+        in->s[body + body_len] = saved;
+        if (msg) post_delivery(lsp, msg);
+        pos = body + body_len;
+    }
+    memmove(in->s, in->s + pos, in->len - pos);
+    in->len -= pos;
+}
+
+// write what the pipe takes; a message that cannot be written is dropped
+static void write_queue(Lsp *lsp)
+{
+    pthread_mutex_lock(&lsp->lock);
+    while (lsp->head) {
+        OutMsg *m = lsp->head;
+        ssize_t n = write(lsp->in_fd, m->data + m->off, m->len - m->off);
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) break;
+        if (n > 0) m->off += n;
+        if (n > 0 && m->off < m->len) continue;
+        lsp->head = m->next;
+        if (!lsp->head) lsp->tail = NULL;
+        free(m->data);
+        free(m);
+    }
+    pthread_mutex_unlock(&lsp->lock);
+}
+
+static long long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static void *io_thread(void *arg)
+{
+    Lsp *lsp = arg;
+    sigset_t pipe_set;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_set, NULL);
+    Buf in = {0};
+    char chunk[READ_CHUNK];
+    int open = 1, writable = 1;
+    long long deadline = 0;
+    for (;;) {
+        pthread_mutex_lock(&lsp->lock);
+        int stopping = lsp->stopping, queued = lsp->head != NULL;
+        pthread_mutex_unlock(&lsp->lock);
+        // when stopping, "shutdown" and "exit" go out and the server is
+        // read until it closes its end, so its reply never hits a closed pipe
+        if (stopping && !deadline) deadline = now_ms() + EXIT_WAIT_MS;
+        if (stopping && (!open || now_ms() >= deadline)) break;
+        // a pipe whose reader is gone polls as an error even with no events asked
+        struct pollfd fds[3] = {
+            { lsp->wake_fd, POLLIN, 0 },
+            { open ? lsp->out_fd : -1, POLLIN, 0 },
+            { writable ? lsp->in_fd : -1, queued ? POLLOUT : 0, 0 },
+        };
+        long long wait = stopping ? deadline - now_ms() : -1;
+        if (poll(fds, 3, stopping && wait < 0 ? 0 : (int)wait) <= 0) continue;
+        if (fds[0].revents & POLLIN) {
+            uint64_t v;
+            if (read(lsp->wake_fd, &v, sizeof(v)) < 0) {
+                // another wakeup took it
+            }
+        }
+        if (fds[2].revents & (POLLERR | POLLHUP)) writable = 0;
+        if (fds[2].revents) write_queue(lsp);
+        if (fds[1].revents) {
+            ssize_t n = read(lsp->out_fd, chunk, sizeof(chunk));
+            if (n > 0) buf_add(&in, chunk, n);
+            if (n > 0 && !in.failed) {
+                read_frames(lsp, &in);
+            } else if (n == 0 || in.failed || errno != EINTR) {
+                // a message too big to hold ends the session like an exit
+                open = 0;
+                if (!stopping) post_delivery(lsp, NULL);
+            }
+        }
+    }
+    free(in.s);
+    return NULL;
+}
+
+static pid_t spawn(const char *cmd, int *in_fd, int *out_fd)
+{
+    int to[2], from[2];
+    if (pipe2(to, O_CLOEXEC) < 0) return -1;
+    if (pipe2(from, O_CLOEXEC) < 0) {
+        close(to[0]);
+        close(to[1]);
+        return -1;
+    }
+    posix_spawn_file_actions_t fa;
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_adddup2(&fa, to[0], 0);
+    posix_spawn_file_actions_adddup2(&fa, from[1], 1);
+    posix_spawn_file_actions_addopen(&fa, 2, "/dev/null", O_WRONLY, 0);
+    // the editor blocks the signals it reads through signalfd
+    sigset_t none, deflt;
+    sigemptyset(&none);
+    sigemptyset(&deflt);
+    sigaddset(&deflt, SIGPIPE);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigmask(&attr, &none);
+    posix_spawnattr_setsigdefault(&attr, &deflt);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+    char *argv[] = { "sh", "-c", (char *)cmd, NULL };
+    pid_t pid;
+    int rc = posix_spawn(&pid, "/bin/sh", &fa, &attr, argv, environ);
+    posix_spawn_file_actions_destroy(&fa);
+    posix_spawnattr_destroy(&attr);
+    close(to[0]);
+    close(from[1]);
+    if (rc != 0) {
+        close(to[1]);
+        close(from[0]);
+        return -1;
+    }
+    fcntl(to[1], F_SETFL, O_NONBLOCK);
+    *in_fd = to[1];
+    *out_fd = from[0];
+    return pid;
+}
+
+static void send_initialize(Lsp *lsp)
+{
+    char cwd[PATH_MAX];
+    char *root = getcwd(cwd, sizeof(cwd)) ? path_to_uri(cwd) : NULL;
+    Buf b = {0};
+    lsp->init_id = ++lsp->next_id;
+    begin_message(&b, "initialize", lsp->init_id);
+    buf_printf(&b, "{\"processId\":%d,\"clientInfo\":{\"name\":\"codein\"},\"rootUri\":", (int)getpid());
+    if (root) buf_string(&b, root);
+    else buf_puts(&b, "null");
+    buf_puts(&b, ",\"capabilities\":{"
+                "\"general\":{\"positionEncodings\":[\"utf-8\",\"utf-16\"]},"
+                "\"offsetEncoding\":[\"utf-8\",\"utf-16\"],"
+                "\"textDocument\":{"
+                "\"synchronization\":{\"dynamicRegistration\":false},"
+                "\"publishDiagnostics\":{},"
+                "\"hover\":{\"contentFormat\":[\"plaintext\",\"markdown\"]},"
+                "\"completion\":{\"completionItem\":{\"snippetSupport\":false}},"
+                "\"definition\":{\"linkSupport\":true}}}}");
+    end_message(lsp, &b);
+    free(root);
+}
+
+Lsp *lsp_start(const char *cmd, Codein *ed, int (*post)(void (*fn)(void *), void *),
+               void (*handler)(void *arg, const LspEvent *ev), void *arg)
+{
+    Lsp *lsp = calloc(1, sizeof(*lsp));
+    if (!lsp) return NULL;
+    lsp->ed = ed;
+    lsp->post = post;
+    lsp->handler = handler;
+    lsp->arg = arg;
+    pthread_mutex_init(&lsp->lock, NULL);
+    lsp->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    lsp->pid = lsp->wake_fd >= 0 ? spawn(cmd, &lsp->in_fd, &lsp->out_fd) : -1;
+    if (lsp->pid < 0) {
+        if (lsp->wake_fd >= 0) close(lsp->wake_fd);
+        free_lsp(lsp);
+        return NULL;
+    }
+    if (pthread_create(&lsp->thread, NULL, io_thread, lsp) != 0) {
+        close(lsp->in_fd);
+        close(lsp->out_fd);
+        close(lsp->wake_fd);
+        waitpid(lsp->pid, NULL, 0);
+        free_lsp(lsp);
+        return NULL;
+    }
+    codein_set_change_hook(ed, on_change, lsp);
+    send_initialize(lsp);
+    return lsp;
+}
+
+void lsp_stop(Lsp *lsp)
+{
+    if (!lsp) return;
+    codein_set_change_hook(lsp->ed, NULL, NULL);
+    if (!lsp->dead) {
+        Buf b = {0};
+        begin_message(&b, "shutdown", ++lsp->next_id);
+        buf_puts(&b, "null");
+        end_message(lsp, &b);
+        b = (Buf){0};
+        begin_message(&b, "exit", 0);
+        buf_puts(&b, "null");
+        end_message(lsp, &b);
+    }
+    pthread_mutex_lock(&lsp->lock);
+    lsp->stopping = 1;
+    pthread_mutex_unlock(&lsp->lock);
+    wake(lsp);
+    pthread_join(lsp->thread, NULL);
+    close(lsp->in_fd);
+    close(lsp->out_fd);
+    close(lsp->wake_fd);
+    // a server that ignores "exit" and the closed pipes is killed
+    struct timespec tick = { 0, 10 * 1000000L };
+    int waited = 0;
+    while (waitpid(lsp->pid, NULL, WNOHANG) == 0) {
+        if (waited >= KILL_WAIT_MS) {
+            kill(lsp->pid, SIGKILL);
+            waitpid(lsp->pid, NULL, 0);
+            break;
+        }
+        nanosleep(&tick, NULL);
+        waited += 10;
+    }
+    // deliveries still queued on the editor thread free the client last
+    lsp->stopped = 1;
+    if (atomic_load(&lsp->in_flight) == 0) free_lsp(lsp);
+}
+
+void lsp_reopen(Lsp *lsp)
+{
+    if (!lsp || !lsp->ready || lsp->dead) return;
+    close_document(lsp);
+    clear_diags(lsp);
+    open_document(lsp);
+}
+
+int lsp_diagnostics(const Lsp *lsp, const LspDiag **diags)
+{
+    *diags = lsp ? lsp->diags : NULL;
+    return lsp ? lsp->ndiags : 0;
+}
+
+const char *lsp_default_command(const char *path)
+{
+    const char *id = path ? language_id(path) : "";
+    if (strcmp(id, "c") != 0 && strcmp(id, "cpp") != 0) return NULL;
+    const char *env = getenv("PATH");
+    char dir[PATH_MAX];
+    for (const char *p = env ? env : ""; *p;) {
+        size_t n = strcspn(p, ":");
+        if (n && n + sizeof("/clangd") <= sizeof(dir)) {
+            snprintf(dir, sizeof(dir), "%.*s/clangd", (int)n, p);
+            if (access(dir, X_OK) == 0) return "clangd";
+        }
+        p += n + (p[n] == ':');
+    }
+    return NULL;
+}
@@ -0,0 +1,66 @@
+/*
+ * Language server client
+ * - The server is a child process speaking JSON-RPC on its stdin and
+ *   stdout; one I/O thread writes queued messages and reads replies, so
+ *   a slow or stuck server never blocks the editor
+ * - insert_char, backspace and newline are sent as incremental didChange
+ *   ranges, batched per frame; any other edit (undo, replace, reload)
+ *   falls back to sending the whole text once
+ * - Replies are interpreted on the editor thread, which owns all state;
+ *   positions are converted between byte columns and the server's
+ *   UTF-16 (or UTF-8, when it agrees to it) columns there
+ */
+
+#ifndef CODEIN_LSP_H
+#define CODEIN_LSP_H
+
+#include "codein.h"
+
+typedef struct Lsp Lsp;
+
+typedef struct {
+    int y0, x0, y1, x1;         // byte columns in the buffer
+    int severity;               // 1 error, 2 warning, 3 information, 4 hint
+    char *message;
+} LspDiag;
+
+typedef struct {
+    char *label;
+    char *insert;               // text to put in place of the word before the cursor
+} LspItem;
+
+enum { LSP_DIAGNOSTICS, LSP_DEFINITION, LSP_HOVER, LSP_COMPLETION, LSP_EXITED };
+
+typedef struct {
+    int kind;
+    const char *path;           // definition: file, NULL when none was found
+    int y, x;                   // definition: byte position
+    const char *text;           // hover: contents as one line
+    const LspItem *items;       // completion
+    int nitems;
+} LspEvent;
+
+/*
+ * Start `cmd` (run through /bin/sh) for the buffer's file. `post` must
+ * run fn(arg) on the editor thread; `handler` then receives results.
+ * NULL if the process or its thread cannot be started.
+ */
+Lsp *lsp_start(const char *cmd, Codein *ed, int (*post)(void (*fn)(void *), void *),
+               void (*handler)(void *arg, const LspEvent *ev), void *arg);
+void lsp_stop(Lsp *lsp);
+// the buffer now holds another file: close the old document, open this one
+void lsp_reopen(Lsp *lsp);
+// send the edits made since the last call
+void lsp_flush(Lsp *lsp);
+
+void lsp_definition(Lsp *lsp);
+void lsp_hover(Lsp *lsp);
+void lsp_complete(Lsp *lsp);
+
+// diagnostics of the buffer, sorted by position
+int lsp_diagnostics(const Lsp *lsp, const LspDiag **diags);
+// language server for a file name when none is given: clangd for C and
+// C++ if it is on PATH; NULL otherwise
+const char *lsp_default_command(const char *path);
+
+#endif
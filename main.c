@@ -1,242 +1,204 @@
 /*
  * Minimal ncurses-based screen editor
  * - Launch with `./codein [filename]` (filename optional)
+ * - `./codein --script cmds.txt [filename]` edits without a terminal
+ * - `./codein --record keys.trace [filename]` logs every key with its time
+ * - `./codein --replay keys.trace [--realtime] [--tty] [filename]` replays
+ *   a trace and reports per-key latency and hot-path costs
+ * - `./codein --server SOCK [filename]` shares one loaded buffer with
+ *   every `./codein --attach SOCK` on the host
+ * - `./codein --lsp CMD [filename]` runs CMD as the language server
+ *   (clangd is used for C and C++ when it is installed; "" turns it off)
  */
 
 #include <ncurses.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <locale.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
 
-#define MAX_LINES 10000
-#define MAX_COL 4096
-#define MAX_SEARCH 256
+#include "encoding.h"
+#include "finder.h"
+#include "grep.h"
+#include "hist.h"
+#include "json.h"
+#include "logtime.h"
+#include "lsp.h"
+#include "memstats.h"
+#include "pool.h"
+#include "prof.h"
+#include "remote.h"
+#include "render.h"
+#include "script.h"
+#include "table.h"
+#include "tags.h"
+#include "termout.h"
 
-#define UNDO_DEPTH 32
+#define MAX_MACRO 4096
+#define MAX_TIMERS 16
+#define STATUS_MSG_MS 3000
+#define FOLLOW_MS 500
+#define FOLLOW_MAX (4 << 20) // bytes read per follow tick
+#define TRACE_EVENTS (1 << 18) // trace ring size, ~8 MB
+#define MENU_ROWS 8 // completion items shown at once
+#define MENU_WIDTH 40
 
-static char *lines[MAX_LINES];
-static int num_lines = 0;
-static char filename[1024] = {0};
+static Codein *ed; // the buffer being edited
 
-static int cur_x = 0; // column index
-static int cur_y = 0; // line index
-static int top_line = 0; // first visible line
+static char status_msg[256] = {0}; // transient message shown in the status line
+static int status_timer = -1;
 
-static char search_query[MAX_SEARCH] = {0};
+/*
+ * Keyboard macros. Every key read while recording is appended to
+ * macro_keys; replay feeds them back through handle_key() inside a batch,
+ * which suppresses drawing and beeps and folds every edit into the single
+ * undo record pushed by the first edit.
+ */
+static int macro_keys[MAX_MACRO];
+static int macro_len = 0;
+static int recording = 0;
+static const int *replay_keys = NULL;
+static int replay_pos = 0, replay_len = 0;
+static int search_failed = 0; // the last Ctrl-F or Ctrl-N found nothing; ends a replay
+
+static int save_in_flight = 0;
+static int export_in_flight = 0;
+static int export_fd = -1; // latest shared-memory export, open while readers may want it
 
 /* forward declarations */
-static void newline(void);
-static void page_up(void);
-static void page_down(void);
-static void push_undo(void);
-static void do_undo(void);
-static void do_redo(void);
-static void search_forward(void);
 static void prompt_search(void);
 static void show_help(void);
 static void prompt_save_filename(void);
+static void set_status_msg(const char *fmt, ...);
+
+typedef void (*event_fn)(void *arg);
+static int post_event(event_fn fn, void *arg);
+static void request_redraw(void);
+static int add_timer(int delay_ms, int repeat_ms, event_fn fn, void *arg);
+static void cancel_timer(int id);
 
+/*
+ * Keystroke traces: --record writes "<ms since start> <key code>" per key,
+ * --replay feeds such a file back in place of the terminal.
+ */
 typedef struct {
-    char **lines;
-    int num_lines;
-    int cur_x, cur_y, top_line;
-} UndoSnapshot;
-
-static UndoSnapshot undo_stack[UNDO_DEPTH];
-static int undo_count = 0;
-static UndoSnapshot redo_stack[UNDO_DEPTH];
-static int redo_count = 0;
-
-static void free_snapshot(UndoSnapshot *s)
-{
-    if (!s->lines) return;
-    for (int i = 0; i < s->num_lines; ++i) free(s->lines[i]);
-    free(s->lines);
-    s->lines = NULL;
-    s->num_lines = 0;
-}
-
-static void push_undo(void)
-{
-    if (undo_count == UNDO_DEPTH) {
-        // drop oldest
-        free_snapshot(&undo_stack[0]);
-        memmove(&undo_stack[0], &undo_stack[1], sizeof(UndoSnapshot) * (UNDO_DEPTH - 1));
-        undo_count--;
-    }
-    UndoSnapshot *s = &undo_stack[undo_count];
-    s->num_lines = num_lines;
-    s->lines = malloc(sizeof(char*) * s->num_lines);
-    if (!s->lines) {
-        s->num_lines = 0;
-        return;
-    }
-    for (int i = 0; i < s->num_lines; ++i) s->lines[i] = strdup(lines[i]);
-    s->cur_x = cur_x; s->cur_y = cur_y; s->top_line = top_line;
-    undo_count++;
-    // clear redo stack on new action
-    for (int i = 0; i < redo_count; ++i) free_snapshot(&redo_stack[i]);
-    redo_count = 0;
+    long long ms;
+    int key;
+} TraceKey;
+
+static FILE *trace_out = NULL;
+static long long trace_start = 0;
+static TraceKey *trace_keys = NULL;
+static int trace_len = 0, trace_pos = 0;
+static int trace_realtime = 0;
+
+static long long now_ms(void);
+
+static void log_key(int ch)
+{
+    if (trace_out) fprintf(trace_out, "%lld %d\n", now_ms() - trace_start, ch);
 }
 
-static void do_undo(void)
+// next key of a replayed trace; in realtime mode wait for its timestamp
+static int next_trace_key(void)
 {
-    if (undo_count == 0) {
-        beep();
-        return;
-    }
-    // get last snapshot
-    UndoSnapshot *s = &undo_stack[undo_count - 1];
-    // save current state to redo stack
-    if (redo_count < UNDO_DEPTH) {
-        UndoSnapshot *r = &redo_stack[redo_count];
-        r->num_lines = num_lines;
-        r->lines = malloc(sizeof(char*) * r->num_lines);
-        if (r->lines) {
-            for (int i = 0; i < r->num_lines; ++i) r->lines[i] = strdup(lines[i]);
-            r->cur_x = cur_x; r->cur_y = cur_y; r->top_line = top_line;
-            redo_count++;
-        }
-    } else {
-        // redo stack full, drop oldest
-        free_snapshot(&redo_stack[0]);
-        memmove(&redo_stack[0], &redo_stack[1], sizeof(UndoSnapshot) * (UNDO_DEPTH - 1));
-        UndoSnapshot *r = &redo_stack[UNDO_DEPTH - 1];
-        r->num_lines = num_lines;
-        r->lines = malloc(sizeof(char*) * r->num_lines);
-        if (r->lines) {
-            for (int i = 0; i < r->num_lines; ++i) r->lines[i] = strdup(lines[i]);
-            r->cur_x = cur_x; r->cur_y = cur_y; r->top_line = top_line;
-        }
+    if (trace_pos >= trace_len) return 27; // trace ended inside a prompt
+    TraceKey *k = &trace_keys[trace_pos++];
+    if (trace_realtime) {
+        long long wait = trace_start + k->ms - now_ms();
+        if (wait > 0) poll(NULL, 0, (int)wait);
     }
-    // free current buffer
-    for (int i = 0; i < num_lines; ++i) free(lines[i]);
-    // copy snapshot into current buffer
-    for (int i = 0; i < s->num_lines; ++i) lines[i] = s->lines[i];
-    // null out transferred pointers to avoid double-free
-    s->lines = NULL;
-    num_lines = s->num_lines;
-    cur_x = s->cur_x; cur_y = s->cur_y; top_line = s->top_line;
-    // remove snapshot from stack
-    undo_count--;
+    return k->key;
 }
 
-static void do_redo(void)
+static void record_key(int ch)
 {
-    if (redo_count == 0) {
-        beep();
+    if (!recording) return;
+    if (macro_len == MAX_MACRO) {
+        recording = 0;
+        set_status_msg("Macro too long, recording stopped");
         return;
     }
-    // get last snapshot from redo stack
-    UndoSnapshot *r = &redo_stack[redo_count - 1];
-    // save current state to undo stack
-    if (undo_count < UNDO_DEPTH) {
-        UndoSnapshot *s = &undo_stack[undo_count];
-        s->num_lines = num_lines;
-        s->lines = malloc(sizeof(char*) * s->num_lines);
-        if (s->lines) {
-            for (int i = 0; i < s->num_lines; ++i) s->lines[i] = strdup(lines[i]);
-            s->cur_x = cur_x; s->cur_y = cur_y; s->top_line = top_line;
-            undo_count++;
-        }
-    } else {
-        // undo stack full, drop oldest
-        free_snapshot(&undo_stack[0]);
-        memmove(&undo_stack[0], &undo_stack[1], sizeof(UndoSnapshot) * (UNDO_DEPTH - 1));
-        UndoSnapshot *s = &undo_stack[UNDO_DEPTH - 1];
-        s->num_lines = num_lines;
-        s->lines = malloc(sizeof(char*) * s->num_lines);
-        if (s->lines) {
-            for (int i = 0; i < s->num_lines; ++i) s->lines[i] = strdup(lines[i]);
-            s->cur_x = cur_x; s->cur_y = cur_y; s->top_line = top_line;
-        }
-    }
-    // free current buffer
-    for (int i = 0; i < num_lines; ++i) free(lines[i]);
-    // copy snapshot into current buffer
-    for (int i = 0; i < r->num_lines; ++i) lines[i] = r->lines[i];
-    // null out transferred pointers to avoid double-free
-    r->lines = NULL;
-    num_lines = r->num_lines;
-    cur_x = r->cur_x; cur_y = r->cur_y; top_line = r->top_line;
-    // remove snapshot from redo stack
-    redo_count--;
+    macro_keys[macro_len++] = ch;
 }
 
-static void search_forward(void)
+// next key from a replaying macro or the terminal
+static int read_key(void)
 {
-    if (!search_query[0]) {
-        beep();
-        return;
+    if (replay_keys) {
+        if (replay_pos < replay_len) return replay_keys[replay_pos++];
+        return 27; // macro ended inside a prompt: cancel it
     }
-    int len = strlen(search_query);
-    int start_y = cur_y, start_x = cur_x + 1;
-    // search from current position forward
-    for (int y = start_y; y < num_lines; ++y) {
-        char *line = lines[y];
-        int search_from = (y == start_y) ? start_x : 0;
-        char *p = strstr(line + search_from, search_query);
-        if (p) {
-            cur_y = y;
-            cur_x = p - line;
-            return;
-        }
-    }
-    // wrap around: search from beginning
-    for (int y = 0; y < start_y; ++y) {
-        char *line = lines[y];
-        char *p = strstr(line, search_query);
-        if (p) {
-            cur_y = y;
-            cur_x = p - line;
-            return;
-        }
-    }
-    beep(); // not found
+    if (trace_keys) return next_trace_key();
+    int ch = getch();
+    log_key(ch);
+    record_key(ch);
+    return ch;
 }
 
-static void prompt_search(void)
+/*
+ * Read a line of input on the status row into buf. Returns 1 when
+ * confirmed with Enter, 0 when cancelled with ESC.
+ */
+static int prompt_line(const char *label, char *buf, int size)
 {
     int rows, cols;
     getmaxyx(stdscr, rows, cols);
-    // draw search input line at bottom
-    move(rows - 1, 0);
-    clrtoeol();
-    attron(A_REVERSE);
-    mvprintw(rows - 1, 0, "Search: ");
-    attroff(A_REVERSE);
-    refresh();
-    // collect input until ESC or Enter
-    char buf[MAX_SEARCH] = {0};
-    int pos = 0;
+    (void)cols;
+    int pos = strlen(buf);
     int ch;
     while (1) {
-        ch = getch();
+        if (!codein_in_batch(ed)) {
+            // draw input line at bottom
+            move(rows - 1, 0);
+            clrtoeol();
+            attron(A_REVERSE);
+            mvprintw(rows - 1, 0, "%s%s", label, buf);
+            attroff(A_REVERSE);
+            refresh();
+        }
+        // collect input until ESC or Enter
+        ch = read_key();
         if (ch == 27) { // ESC
-            break;
+            return 0;
         } else if (ch == '\n' || ch == KEY_ENTER) {
-            strncpy(search_query, buf, MAX_SEARCH - 1);
-            search_forward();
-            break;
+            return 1;
         } else if (ch == KEY_BACKSPACE || ch == 127) {
             if (pos > 0) buf[--pos] = '\0';
-        } else if (ch >= 32 && ch < 127 && pos < MAX_SEARCH - 1) {
+        } else if (ch >= 32 && ch < 127 && pos < size - 1) {
             buf[pos++] = (char)ch;
             buf[pos] = '\0';
         }
-        // redraw input
-        move(rows - 1, 0);
-        clrtoeol();
-        attron(A_REVERSE);
-        mvprintw(rows - 1, 0, "Search: %s", buf);
-        attroff(A_REVERSE);
-        refresh();
     }
 }
 
+static void prompt_search(void)
+{
+    char buf[CODEIN_MAX_SEARCH] = {0};
+    if (!prompt_line("Search: ", buf, sizeof(buf))) return;
+    search_failed = !codein_search(ed, buf);
+}
+
 static void show_help(void)
 {
+    if (codein_in_batch(ed)) {
+        read_key();
+        return;
+    }
     erase();
     const char *help_text[] = {
         "=== CODEIN EDITOR HELP ===",
@@ -253,12 +215,28 @@ static void show_help(void)
         "  Enter           New line / split line",
         "  Ctrl+U          Undo",
         "  Ctrl+Z          Redo",
+        "  Ctrl+R          Start/stop macro recording",
+        "  Ctrl+E          Replay macro (count, 0 = until search fails)",
         "",
         "Search & File:",
         "  Ctrl+F          Find text",
         "  Ctrl+N          Find next",
         "  Ctrl+S          Save file (prompts for name if none set)",
+        "  Ctrl+X          Export snapshot to shared memory",
+        "  Ctrl+O          Column view for CSV/TSV (Tab/Shift+Tab: next/previous field)",
+        "  Ctrl+K u/n/p/m  JSON: parent, next/previous sibling, matching bracket",
+        "  Ctrl+G          Go to time in a log file",
+        "  Ctrl+Y          Log histogram (l/s/r: level, source, regex; Enter jumps)",
+        "  Ctrl+W          Follow the file as it grows",
+        "  Ctrl+D          Go to definition (language server)",
+        "  Ctrl+L          Show type and documentation at the cursor",
+        "  Ctrl+Space      Complete the word (Up/Down, Enter accepts, Esc closes)",
+        "  Ctrl+]          Jump to the tag under the cursor (again: next match)",
+        "  Ctrl+B          Open a project file (type to filter, Enter opens)",
+        "  Ctrl+/          Search the project's files (Enter opens a match)",
         "  Ctrl+Q          Quit editor",
+        "  Ctrl+T          Memory and terminal output stats",
+        "  Ctrl+P          Toggle latency HUD",
         "  Ctrl+H          Show this help",
         "",
         "Press any key to return...",
@@ -272,325 +250,1634 @@ static void show_help(void)
         mvprintw(line, 0, "%s", help_text[i]);
     }
     refresh();
-    getch(); // wait for any key
+    read_key(); // wait for any key
+}
+
+static void show_stats(void)
+{
+    if (codein_in_batch(ed)) return;
+    char *text = NULL;
+    size_t len = 0;
+    FILE *f = open_memstream(&text, &len);
+    if (!f) return;
+    fprintf(f, "=== MEMORY USE (bytes) ===\n\n");
+    mem_report(ed, f);
+    fprintf(f, "\n");
+    term_report(f);
+    fprintf(f, "\nPress any key to return...\n");
+    fclose(f);
+
+    erase();
+    int rows = getmaxy(stdscr), line = 0;
+    for (char *s = text, *nl; *s && line < rows - 1; s = nl + 1, ++line) {
+        nl = strchr(s, '\n');
+        mvprintw(line, 0, "%.*s", (int)(nl - s), s);
+    }
+    refresh();
+    free(text);
+    read_key();
+}
+
+typedef struct {
+    CodeinSnapshot *snap;
+    char path[1024];
+    int result;
+} SaveJob;
+
+static void save_done(void *arg)
+{
+    SaveJob *job = arg;
+    save_in_flight = 0;
+    if (job->result == 0 && strcmp(job->path, codein_filename(ed)) == 0) {
+        codein_mark_saved(ed, job->snap);
+    }
+    if (job->result == 0) set_status_msg("Saved %d lines", codein_snapshot_num_lines(job->snap));
+    else set_status_msg("Save failed");
+    codein_snapshot_release(job->snap);
+    free(job);
+    codein_reclaim(ed);
+}
+
+static void save_task(void *arg, CancelToken *tok)
+{
+    (void)tok; // a started save always runs to completion
+    SaveJob *job = arg;
+    job->result = codein_snapshot_write(job->snap, job->path);
+    post_event(save_done, job);
 }
 
-static void load_file(const char *path)
+// write the current version on the pool; editing continues meanwhile
+static void start_save(const char *path)
 {
-    FILE *f;
-    if (!path) {
-        lines[0] = strdup("");
-        num_lines = 1;
+    if (save_in_flight) {
+        set_status_msg("Save already in progress");
         return;
     }
-    strncpy(filename, path, sizeof(filename) - 1);
-    f = fopen(path, "r");
-    if (!f) {
-        lines[0] = strdup("");
-        num_lines = 1;
+    SaveJob *job = calloc(1, sizeof(*job));
+    if (!job) {
+        set_status_msg("Save failed");
+        return;
+    }
+    codein_publish(ed);
+    job->snap = codein_snapshot_acquire(ed);
+    strncpy(job->path, path, sizeof(job->path) - 1);
+    save_in_flight = 1;
+    set_status_msg("Saving...");
+    if (pool_submit(POOL_INTERACTIVE, NULL, save_task, job) < 0) save_task(job, NULL); // write it here
+}
+
+typedef struct {
+    CodeinSnapshot *snap;
+    int fd;
+} ExportJob;
+
+static void export_done(void *arg)
+{
+    ExportJob *job = arg;
+    export_in_flight = 0;
+    if (job->fd >= 0) {
+        // tools that opened the previous export keep their own reference
+        if (export_fd >= 0) close(export_fd);
+        export_fd = job->fd;
+        set_status_msg("Exported %d lines: /proc/%d/fd/%d", codein_snapshot_num_lines(job->snap),
+                       (int)getpid(), export_fd);
+    } else {
+        set_status_msg("Export failed");
+    }
+    codein_snapshot_release(job->snap);
+    free(job);
+    codein_reclaim(ed);
+}
+
+static void export_task(void *arg, CancelToken *tok)
+{
+    (void)tok;
+    ExportJob *job = arg;
+    job->fd = codein_snapshot_export(job->snap, "codein");
+    post_event(export_done, job);
+}
+
+// copy the current version into a sealed memfd for local tools to mmap
+static void start_export(void)
+{
+    if (export_in_flight) return;
+    ExportJob *job = calloc(1, sizeof(*job));
+    if (!job) {
+        set_status_msg("Export failed");
         return;
     }
+    codein_publish(ed);
+    job->snap = codein_snapshot_acquire(ed);
+    export_in_flight = 1;
+    if (pool_submit(POOL_INTERACTIVE, NULL, export_task, job) < 0) export_task(job, NULL); // copy it here
+}
+
+static void prompt_save_filename(void)
+{
+    if (codein_filename(ed)[0] != '\0') {
+        // filename already set, just save; nothing to do if disk matches
+        if (codein_on_disk(ed) && !codein_modified(ed)) {
+            set_status_msg("No changes to save");
+            return;
+        }
+        start_save(codein_filename(ed));
+        return;
+    }
+    char buf[1024] = {0};
+    if (prompt_line("Save as: ", buf, sizeof(buf)) && buf[0]) {
+        codein_set_filename(ed, buf);
+        start_save(codein_filename(ed));
+    }
+}
+
+// columnar view for delimited files
+static Table table;
+static int table_view = 0;
+
+static void table_refined(void *arg)
+{
+    (void)arg;
+    request_redraw();
+}
+
+// called from sampling tasks on worker threads
+static void table_notify(void)
+{
+    post_event(table_refined, NULL);
+}
+
+static void start_table(char delim)
+{
+    table_init(&table, delim);
+    table_analyze(&table, ed, table_notify);
+    table_view = 1;
+}
+
+static void toggle_table(void)
+{
+    if (table_view) {
+        table_stop(&table);
+        table_view = 0;
+        return;
+    }
+    char delim = table_detect(ed, 0);
+    if (delim) start_table(delim);
+    else set_status_msg("No column delimiter found");
+}
+
+/*
+ * JSON navigation: the structural index is rebuilt on the pool whenever
+ * a frame finds it older than the buffer; a newer build cancels the one
+ * in flight. Jumps and the status line path wait for a current index.
+ */
+static int json_mode = 0;
+static JsonIndex *json_ix = NULL;
+static CancelToken *json_tok = NULL; // build in flight
+static unsigned long json_tok_version = 0;
+
+typedef struct {
+    CodeinSnapshot *snap;
+    CancelToken *tok;
+    JsonIndex *ix;
+} JsonJob;
+
+static void json_built(void *arg)
+{
+    JsonJob *job = arg;
+    if (job->tok == json_tok) {
+        cancel_token_unref(json_tok);
+        json_tok = NULL;
+    }
+    if (job->ix && !task_cancelled(job->tok)) {
+        json_index_free(json_ix);
+        json_ix = job->ix;
+        request_redraw();
+    } else if (job->ix) {
+        json_index_free(job->ix);
+    } else {
+        codein_snapshot_release(job->snap);
+    }
+    cancel_token_unref(job->tok);
+    free(job);
+    codein_reclaim(ed);
+}
+
+static void json_task(void *arg, CancelToken *tok)
+{
+    JsonJob *job = arg;
+    job->ix = task_cancelled(tok) ? NULL : json_index_build(job->snap, tok);
+    post_event(json_built, job);
+}
+
+static int json_current(void)
+{
+    return json_ix && json_index_version(json_ix) == codein_version(ed);
+}
+
+static void json_refresh(void)
+{
+    if (!json_mode || json_current() || (json_tok && json_tok_version == codein_version(ed))) return;
+    JsonJob *job = calloc(1, sizeof(*job));
+    if (!job) return;
+    if (json_tok) {
+        cancel_token_cancel(json_tok);
+        cancel_token_unref(json_tok);
+    }
+    codein_publish(ed);
+    job->snap = codein_snapshot_acquire(ed);
+    json_tok = cancel_token_new();
+    json_tok_version = codein_version(ed);
+    job->tok = cancel_token_ref(json_tok);
+    pool_submit(POOL_BULK, job->tok, json_task, job);
+}
+
+// Ctrl-K then a key: structural jumps
+static void json_command(void)
+{
+    if (!json_current()) {
+        json_mode = 1;
+        json_refresh();
+        set_status_msg("Indexing JSON, try again in a moment");
+        return;
+    }
+    if (!codein_in_batch(ed)) {
+        draw_screen(ed, "JSON: u parent  n next  p previous  m matching bracket");
+    }
+    int k = read_key(), how;
+    if (k == 'u') how = JSON_PARENT;
+    else if (k == 'n') how = JSON_NEXT;
+    else if (k == 'p') how = JSON_PREV;
+    else if (k == 'm') how = JSON_MATCH;
+    else return;
+    int cy, cx, y, x;
+    codein_cursor(ed, &cy, &cx);
+    if (json_jump(json_ix, how, cy, cx, &y, &x)) codein_goto(ed, y, x);
+    else beep();
+}
+
+/*
+ * Log files: the timestamp index is built once after load and again
+ * when a jump finds it older than the buffer. A stale index still serves
+ * that jump, since its line numbers drift only by what was edited.
+ */
+static int log_fmt = LOGTS_NONE;
+static LogIndex *log_ix = NULL;
+static CancelToken *log_tok = NULL; // build in flight
+
+typedef struct {
+    CodeinSnapshot *snap;
+    CancelToken *tok;
+    LogIndex *ix;
+} LogJob;
+
+static void log_built(void *arg)
+{
+    LogJob *job = arg;
+    if (job->tok == log_tok) {
+        cancel_token_unref(log_tok);
+        log_tok = NULL;
+    }
+    if (job->ix && !task_cancelled(job->tok)) {
+        log_index_free(log_ix);
+        log_ix = job->ix;
+    } else if (job->ix) {
+        log_index_free(job->ix);
+    } else {
+        codein_snapshot_release(job->snap);
+    }
+    cancel_token_unref(job->tok);
+    free(job);
+    codein_reclaim(ed);
+}
+
+static void log_task(void *arg, CancelToken *tok)
+{
+    LogJob *job = arg;
+    job->ix = task_cancelled(tok) ? NULL : log_index_build(job->snap, log_fmt, tok);
+    post_event(log_built, job);
+}
+
+static void log_reindex(void)
+{
+    if (log_fmt == LOGTS_NONE || log_tok) return;
+    if (log_ix && log_index_version(log_ix) == codein_version(ed)) return;
+    LogJob *job = calloc(1, sizeof(*job));
+    if (!job) return;
+    codein_publish(ed);
+    job->snap = codein_snapshot_acquire(ed);
+    log_tok = cancel_token_new();
+    job->tok = cancel_token_ref(log_tok);
+    pool_submit(POOL_BULK, job->tok, log_task, job);
+}
+
+// Ctrl-G: jump to the first line at or after a time
+static void prompt_goto_time(void)
+{
+    if (log_fmt == LOGTS_NONE) log_fmt = logts_detect(ed);
+    if (log_fmt == LOGTS_NONE) {
+        set_status_msg("No timestamps recognized");
+        return;
+    }
+    log_reindex();
+    if (!log_ix) {
+        set_status_msg("Indexing %s timestamps, try again in a moment", logts_name(log_fmt));
+        return;
+    }
+    char buf[64] = {0};
+    if (!prompt_line("Go to time (HH:MM:SS or YYYY-MM-DD HH:MM:SS): ", buf, sizeof(buf)) || !buf[0])
+        return;
+    int64_t ref = 0, target;
+    int cy;
+    codein_cursor(ed, &cy, NULL);
+    log_time_at(log_ix, ed, cy, &ref);
+    if (logts_parse_query(log_fmt, buf, ref, &target) < 0) {
+        set_status_msg("Bad time: %s", buf);
+        return;
+    }
+    int y = log_index_find(log_ix, ed, target);
+    if (y < 0) {
+        set_status_msg("No line at or after %s", buf);
+        y = codein_num_lines(ed) - 1;
+    }
+    codein_goto(ed, y, 0);
+}
+
+/*
+ * Histogram panel (Ctrl-Y): a full count runs on the pool and is kept
+ * while the panel is closed, so reopening is instant unless the buffer
+ * was edited. Follow mode (Ctrl-W) appends what the file grew by and
+ * counts the new lines on the spot.
+ */
+static Histogram hist;
+static int hist_view = 0;
+static char hist_regex[128];
+static int follow_timer = -1;
+static off_t follow_offset;
+
+static void hist_counted(void *arg)
+{
+    hist_finish(&hist, arg);
+    // lines followed in while the count ran
+    if (!hist.job && hist.buckets && hist.lines < codein_num_lines(ed)) hist_append(&hist, ed, hist.lines);
+    codein_reclaim(ed);
+    request_redraw();
+}
+
+static void hist_done(HistJob *job)
+{
+    post_event(hist_counted, job);
+}
+
+static void hist_open(int facet)
+{
+    if (log_fmt == LOGTS_NONE) log_fmt = logts_detect(ed);
+    const char *err;
+    hist_view = hist_start(&hist, ed, log_fmt, facet, hist_regex, hist_done, &err) == 0;
+    if (!hist_view) set_status_msg("%s", err);
+}
+
+static void toggle_hist(void)
+{
+    if (hist_view) hist_view = 0;
+    else if (hist.buckets && (hist.job || hist.version == codein_version(ed))) hist_view = 1;
+    else hist_open(hist.facet);
+}
+
+static void prompt_hist_regex(void)
+{
+    char buf[sizeof(hist_regex)];
+    strcpy(buf, hist_regex);
+    if (!prompt_line("Facet regex (group 1 is the value): ", buf, sizeof(buf)) || !buf[0]) return;
+    strcpy(hist_regex, buf);
+    hist_open(HIST_REGEX);
+}
+
+// keys of the histogram panel; 0 lets the editor handle the key
+static int hist_key(int ch)
+{
+    int page = LINES - 3 > 1 ? LINES - 3 : 1;
+    if (ch == KEY_UP || ch == KEY_DOWN) {
+        hist_select(&hist, ch == KEY_UP ? -1 : 1, 0);
+    } else if (ch == KEY_PPAGE || ch == KEY_NPAGE) {
+        hist_select(&hist, ch == KEY_PPAGE ? -page : page, 0);
+    } else if (ch == KEY_LEFT || ch == KEY_RIGHT) {
+        hist_select(&hist, 0, ch == KEY_LEFT ? -1 : 1);
+    } else if (ch == '\n' || ch == KEY_ENTER) {
+        int y = hist_target_line(&hist);
+        if (y < 0) {
+            beep();
+            return 1;
+        }
+        codein_goto(ed, y, 0);
+        hist_view = 0;
+    } else if (ch == 'l') {
+        hist_open(HIST_LEVEL);
+    } else if (ch == 's') {
+        hist_open(HIST_SOURCE);
+    } else if (ch == 'r') {
+        prompt_hist_regex();
+    } else if (ch == 'q' || ch == 27 || ch == 25) {
+        hist_view = 0;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+static void follow_poll(void *arg)
+{
+    (void)arg;
+    struct stat st;
+    if (stat(codein_filename(ed), &st) < 0 || st.st_size == follow_offset) return;
+    if (st.st_size < follow_offset) {
+        follow_offset = st.st_size;
+        set_status_msg("File truncated, following from its new end");
+        return;
+    }
+    size_t avail = st.st_size - follow_offset, size = avail < FOLLOW_MAX ? avail : FOLLOW_MAX, n = 0;
     char *buf = NULL;
-    size_t cap = 0;
-    ssize_t len;
-    num_lines = 0;
-    while ((len = getline(&buf, &cap, f)) != -1 && num_lines < MAX_LINES) {
-        // strip newline
-        while (len > 0 && (buf[len-1] == '\n' || buf[len-1] == '\r')) buf[--len] = '\0';
-        lines[num_lines++] = strdup(buf);
+    int fd = open(codein_filename(ed), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    // a line longer than one read is read on to its end; an unfinished
+    // last line waits for the next tick
+    for (;;) {
+        char *nb = realloc(buf, size);
+        if (!nb) break;
+        buf = nb;
+        ssize_t r = pread(fd, buf + n, size - n, follow_offset + n);
+        if (r <= 0) break;
+        n += r;
+        if (n < size || size == avail || memchr(buf + n - r, '\n', r)) break;
+        size = size * 2 < avail ? size * 2 : avail;
+    }
+    close(fd);
+    if (n > 0) {
+        int cy;
+        codein_cursor(ed, &cy, NULL);
+        int at_end = cy == codein_num_lines(ed) - 1;
+        size_t used = codein_append(ed, buf, n);
+        follow_offset += used;
+        if (used && at_end) codein_goto(ed, codein_num_lines(ed) - 1, 0);
+        if (hist.buckets) hist_append(&hist, ed, hist.lines);
+        request_redraw();
     }
     free(buf);
-    if (num_lines == 0) {
-        lines[0] = strdup("");
-        num_lines = 1;
+}
+
+// Ctrl-W: follow the file as it grows, from its size when switched on
+static void toggle_follow(void)
+{
+    struct stat st;
+    if (follow_timer >= 0) {
+        cancel_timer(follow_timer);
+        follow_timer = -1;
+        set_status_msg("Follow off");
+    } else if (!codein_filename(ed)[0] || stat(codein_filename(ed), &st) < 0) {
+        set_status_msg("Nothing to follow: the buffer has no file");
+    } else if (codein_encoding(ed) != ENC_UTF8) {
+        set_status_msg("Follow reads UTF-8 only, this file is %s", enc_name(codein_encoding(ed)));
+    } else {
+        follow_offset = st.st_size;
+        follow_timer = add_timer(FOLLOW_MS, FOLLOW_MS, follow_poll, NULL);
+        set_status_msg("Following %s", codein_filename(ed));
     }
-    fclose(f);
 }
 
-static int save_file(const char *path)
+/*
+ * Language server: edits are flushed once per frame; diagnostics are
+ * underlined (errors reversed) and the one under the cursor shows in the
+ * status line. Definition (Ctrl-D), hover (Ctrl-L) and completion
+ * (Ctrl-Space) answers arrive as events and are dropped if superseded.
+ */
+static Lsp *lsp = NULL;
+static const LspItem *menu_items = NULL; // completion menu, open when set
+static int menu_len = 0, menu_sel = 0, menu_top = 0;
+
+// the buffer now holds another file: per-file views start over
+static int switch_file(const char *path)
 {
-    const char *p = path ? path : filename;
-    if (!p || p[0] == '\0') return -1;
-    FILE *f = fopen(p, "w");
-    if (!f) return -1;
-    for (int i = 0; i < num_lines; ++i) {
-        fprintf(f, "%s\n", lines[i]);
+    if (table_view) toggle_table();
+    if (follow_timer >= 0) {
+        cancel_timer(follow_timer);
+        follow_timer = -1;
     }
-    fclose(f);
+    hist_view = 0;
+    hist_stop(&hist);
+    int status = codein_load(ed, path);
+    json_mode = json_detect(ed);
+    log_fmt = json_mode ? LOGTS_NONE : logts_detect(ed);
+    log_reindex();
+    lsp_reopen(lsp);
+    return status;
+}
+
+static void goto_definition(const LspEvent *ev)
+{
+    char here[PATH_MAX], there[PATH_MAX];
+    if (!ev->path) {
+        set_status_msg("No definition found");
+    } else if (realpath(ev->path, there) && realpath(codein_filename(ed), here) && strcmp(here, there) == 0) {
+        codein_goto(ed, ev->y, ev->x);
+    } else if (codein_modified(ed)) {
+        set_status_msg("Definition is in %s; save this file first", ev->path);
+    } else if (switch_file(ev->path) < 0) {
+        set_status_msg("Cannot open %s", ev->path);
+    } else {
+        codein_goto(ed, ev->y, ev->x);
+    }
+    request_redraw();
+}
+
+static void lsp_event(void *arg, const LspEvent *ev)
+{
+    (void)arg;
+    if (ev->kind == LSP_DEFINITION) {
+        goto_definition(ev);
+    } else if (ev->kind == LSP_HOVER) {
+        if (ev->text[0]) set_status_msg("%s", ev->text);
+        else set_status_msg("Nothing to show here");
+    } else if (ev->kind == LSP_COMPLETION) {
+        menu_items = ev->nitems ? ev->items : NULL;
+        menu_len = ev->nitems;
+        menu_sel = menu_top = 0;
+        if (!menu_items) set_status_msg("No completions");
+    } else if (ev->kind == LSP_EXITED) {
+        menu_items = NULL;
+        set_status_msg("Language server exited");
+    }
+    request_redraw();
+}
+
+// Ctrl-D, Ctrl-L, Ctrl-Space
+static void lsp_command(void (*request)(Lsp *))
+{
+    if (lsp) request(lsp);
+    else set_status_msg("No language server (start with --lsp CMD)");
+}
+
+// replace the identifier before the cursor with the chosen completion
+static void accept_completion(const LspItem *it)
+{
+    int y, x;
+    codein_begin_batch(ed);
+    codein_cursor(ed, &y, &x);
+    const char *ln = codein_line(ed, y);
+    while (x > 0 && (isalnum((unsigned char)ln[x - 1]) || ln[x - 1] == '_')) {
+        codein_backspace(ed);
+        x--;
+    }
+    for (const char *p = it->insert; *p; ++p) {
+        if (*p == '\n') codein_newline(ed);
+        else codein_insert_char(ed, (unsigned char)*p);
+    }
+    codein_end_batch(ed);
+}
+
+// keys of the completion menu; 0 closes it and lets the editor handle the key
+static int menu_key(int ch)
+{
+    if (ch == KEY_UP || ch == KEY_DOWN) {
+        menu_sel = (menu_sel + (ch == KEY_UP ? menu_len - 1 : 1)) % menu_len;
+        if (menu_sel < menu_top) menu_top = menu_sel;
+        if (menu_sel >= menu_top + MENU_ROWS) menu_top = menu_sel - MENU_ROWS + 1;
+        return 1;
+    }
+    const LspItem *chosen = &menu_items[menu_sel];
+    menu_items = NULL;
+    if (ch == '\n' || ch == KEY_ENTER || ch == '\t') {
+        accept_completion(chosen);
+        return 1;
+    }
+    return ch == 27;
+}
+
+// the menu below the cursor line, or above it near the bottom
+static void draw_menu(void)
+{
+    int rows = LINES - 1, n = menu_len - menu_top < MENU_ROWS ? menu_len - menu_top : MENU_ROWS;
+    int cy, cx;
+    codein_cursor(ed, &cy, &cx);
+    cy -= codein_top_line(ed);
+    cx = cx < COLS ? cx : COLS / 2;
+    int y = cy + 1, x = cx;
+    if (y + n > rows) y = cy - n;
+    if (y < 0) y = 0;
+    if (x + MENU_WIDTH > COLS) x = COLS > MENU_WIDTH ? COLS - MENU_WIDTH : 0;
+    for (int i = 0; i < n && y + i < rows; ++i) {
+        const LspItem *it = &menu_items[menu_top + i];
+        attrset(menu_top + i == menu_sel ? A_REVERSE : A_UNDERLINE);
+        mvprintw(y + i, x, " %-*.*s", MENU_WIDTH - 1, MENU_WIDTH - 1, it->label);
+    }
+    attrset(A_NORMAL);
+    move(cy, cx);
+    refresh();
+}
+
+/*
+ * Tags (Ctrl-]): the word under the cursor is looked up in the nearest
+ * tags file at or above the buffer's directory. Pressing it again on the
+ * same word steps through the other matches.
+ */
+static Tags *tags = NULL;
+static char tags_dir[PATH_MAX];
+static TagMatch *tag_matches = NULL;
+static int tag_count = 0, tag_next = 0;
+static char tag_name[128];
+
+// the identifier at or just before the cursor; 0 if there is none
+static int word_at_cursor(char *buf, size_t size)
+{
+    int y, a, b;
+    codein_cursor(ed, &y, &a);
+    const char *ln = codein_line(ed, y);
+    b = a;
+    while (a > 0 && (isalnum((unsigned char)ln[a - 1]) || ln[a - 1] == '_')) a--;
+    while (isalnum((unsigned char)ln[b]) || ln[b] == '_') b++;
+    if (a == b || (size_t)(b - a) >= size) return 0;
+    memcpy(buf, ln + a, b - a);
+    buf[b - a] = '\0';
+    return 1;
+}
+
+// the directory of the buffer's file, "." if it has none
+static void buffer_dir(char *dir, size_t size)
+{
+    const char *name = codein_filename(ed), *slash = strrchr(name, '/');
+    if (!slash) snprintf(dir, size, ".");
+    else if (slash == name) snprintf(dir, size, "/");
+    else snprintf(dir, size, "%.*s", (int)(slash - name), name);
+}
+
+// the buffer's directory; the tags file is searched from there up
+static int find_tags(void)
+{
+    char dir[PATH_MAX];
+    buffer_dir(dir, sizeof(dir));
+    if (tags && strcmp(dir, tags_dir) == 0) return 1;
+    tags_close(tags);
+    tags = tags_find(dir);
+    strcpy(tags_dir, dir);
+    return tags != NULL;
+}
+
+static void goto_tag(const TagMatch *m)
+{
+    char here[PATH_MAX], there[PATH_MAX];
+    int same = realpath(m->path, there) && realpath(codein_filename(ed), here) && strcmp(here, there) == 0;
+    if (!same && codein_modified(ed)) {
+        set_status_msg("%s is in %s; save this file first", tag_name, m->path);
+        return;
+    }
+    if (!same && (access(m->path, R_OK) < 0 || switch_file(m->path) < 0)) {
+        set_status_msg("Cannot open %s", m->path);
+        return;
+    }
+    // the line number is a hint the pattern confirms; else search for it
+    int n = codein_num_lines(ed), y = m->line > 0 && m->line <= n ? m->line - 1 : -1;
+    if (m->pattern && (y < 0 || !tag_matches_line(m, codein_line(ed, y)))) {
+        y = -1;
+        for (int i = 0; i < n && y < 0; ++i)
+            if (tag_matches_line(m, codein_line(ed, i))) y = i;
+    }
+    if (y < 0) {
+        set_status_msg("%s: not found in %s (tags file out of date?)", tag_name, m->path);
+        return;
+    }
+    const char *at = strstr(codein_line(ed, y), tag_name);
+    codein_goto(ed, y, at ? (int)(at - codein_line(ed, y)) : 0);
+    if (tag_count > 1) set_status_msg("%s: match %d of %d (Ctrl-] again for the next)", tag_name, tag_next + 1, tag_count);
+}
+
+static void jump_to_tag(void)
+{
+    char word[sizeof(tag_name)];
+    if (!word_at_cursor(word, sizeof(word))) {
+        set_status_msg("No identifier under the cursor");
+        return;
+    }
+    if (tag_count > 1 && strcmp(word, tag_name) == 0) {
+        tag_next = (tag_next + 1) % tag_count;
+        goto_tag(&tag_matches[tag_next]);
+        return;
+    }
+    if (!find_tags()) {
+        set_status_msg("No tags file in %s or above", tags_dir);
+        return;
+    }
+    tags_free_matches(tag_matches, tag_count);
+    tag_count = tags_lookup(tags, word, &tag_matches);
+    tag_next = 0;
+    strcpy(tag_name, word);
+    if (tag_count < 0) {
+        tag_count = 0;
+        set_status_msg("Cannot read %s", tags_path(tags));
+    } else if (tag_count == 0) {
+        set_status_msg("%s: no tag", word);
+    } else {
+        goto_tag(&tag_matches[0]);
+    }
+}
+
+/*
+ * File picker (Ctrl-B): the files under the project root, the nearest
+ * directory above the buffer that holds .git, ranked as the query is
+ * typed. The list outlives the picker and inotify keeps it current, so
+ * opening it again is instant.
+ */
+static Finder *finder = NULL;
+static Picker picker;
+static int picker_view = 0;
+static GrepJob *grep_job = NULL; // fed the finder's list as it grows
+static int grep_view = 0;
+
+static void finder_updated(void *arg)
+{
+    (void)arg;
+    if (!finder) return;
+    finder_update(finder);
+    if (grep_job) grep_feed(grep_job, finder);
+    if (grep_view) request_redraw();
+    if (picker_view) {
+        picker_rank(&picker, finder);
+        request_redraw();
+    }
+}
+
+// runs on a worker when found files or the end of a walk wait
+static void finder_notify(void)
+{
+    post_event(finder_updated, NULL);
+}
+
+// the buffer's project listed by the finder; 0 if it cannot be
+static int project_finder(void)
+{
+    char dir[PATH_MAX], root[PATH_MAX];
+    buffer_dir(dir, sizeof(dir));
+    finder_project_root(dir, root, sizeof(root));
+    if (finder && strcmp(root, finder_root(finder)) != 0) {
+        // a search goes with the list that fed it
+        grep_free(grep_job);
+        grep_job = NULL;
+        grep_view = 0;
+        finder_free(finder);
+        finder = NULL;
+    }
+    if (finder) {
+        finder_refresh(finder);
+    } else if (!(finder = finder_start(root, finder_notify))) {
+        set_status_msg("Cannot list %s", root);
+        return 0;
+    }
+    return 1;
+}
+
+static void open_picker(void)
+{
+    if (!project_finder()) return;
+    picker.query[0] = '\0';
+    picker_rank(&picker, finder);
+    picker_view = 1;
+}
+
+// open rel under root in the buffer; 0 if it is not there afterwards
+static int open_project_file(const char *root, const char *rel)
+{
+    char path[PATH_MAX * 2], cwd[PATH_MAX], here[PATH_MAX], there[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", root, rel);
+    // shown relative to the working directory when it is under it
+    size_t n = getcwd(cwd, sizeof(cwd)) ? strlen(cwd) : 0;
+    if (n && strncmp(path, cwd, n) == 0 && path[n] == '/') memmove(path, path + n + 1, strlen(path + n));
+    else if (strncmp(path, "./", 2) == 0) memmove(path, path + 2, strlen(path + 1));
+    if (realpath(path, there) && realpath(codein_filename(ed), here) && strcmp(here, there) == 0) return 1;
+    if (codein_modified(ed)) set_status_msg("Save this file before opening %s", path);
+    else if (switch_file(path) < 0) set_status_msg("Cannot open %s", path);
+    else return 1;
     return 0;
 }
 
-static void prompt_save_filename(void)
+static void open_picked(void)
 {
-    if (filename[0] != '\0') {
-        // filename already set, just save
-        save_file(filename);
+    const char *rel = picker_selected(&picker, finder);
+    if (!rel) {
+        beep();
         return;
     }
-    int rows, cols;
-    getmaxyx(stdscr, rows, cols);
-    // draw prompt at bottom
-    move(rows - 1, 0);
-    clrtoeol();
-    attron(A_REVERSE);
-    mvprintw(rows - 1, 0, "Save as: ");
-    attroff(A_REVERSE);
-    refresh();
-    // collect input until ESC or Enter
-    char buf[1024] = {0};
-    int pos = 0;
-    int ch;
-    while (1) {
-        ch = getch();
-        if (ch == 27) { // ESC - cancel
-            break;
-        } else if (ch == '\n' || ch == KEY_ENTER) {
-            if (pos > 0) {
-                strncpy(filename, buf, sizeof(filename) - 1);
-                save_file(filename);
-            }
-            break;
-        } else if (ch == KEY_BACKSPACE || ch == 127) {
-            if (pos > 0) buf[--pos] = '\0';
-        } else if (ch >= 32 && ch < 127 && pos < 1023) {
-            buf[pos++] = (char)ch;
-            buf[pos] = '\0';
+    picker_view = 0;
+    open_project_file(finder_root(finder), rel);
+}
+
+// keys of the file picker; 0 lets the editor handle the key
+static int picker_key(int ch)
+{
+    size_t len = strlen(picker.query);
+    int page = LINES - 2 > 1 ? LINES - 2 : 1;
+    if (ch == KEY_UP || ch == KEY_DOWN) {
+        picker_select(&picker, ch == KEY_UP ? -1 : 1);
+    } else if (ch == KEY_PPAGE || ch == KEY_NPAGE) {
+        picker_select(&picker, ch == KEY_PPAGE ? -page : page);
+    } else if (ch == '\n' || ch == KEY_ENTER) {
+        open_picked();
+    } else if (ch == 27 || ch == 2) {
+        picker_view = 0;
+    } else if (ch == KEY_BACKSPACE || ch == 127) {
+        if (len) picker.query[len - 1] = '\0';
+        picker_rank(&picker, finder);
+    } else if (ch >= 32 && ch < 127) {
+        if (len < sizeof(picker.query) - 1) {
+            picker.query[len] = ch;
+            picker.query[len + 1] = '\0';
         }
-        // redraw input
-        move(rows - 1, 0);
-        clrtoeol();
-        attron(A_REVERSE);
-        mvprintw(rows - 1, 0, "Save as: %s", buf);
-        attroff(A_REVERSE);
-        refresh();
+        picker_rank(&picker, finder);
+    } else {
+        return 0;
     }
+    return 1;
+}
+
+/*
+ * Project search (Ctrl-/): every file the picker lists, searched on the
+ * pool for the query. Matches stream into a results buffer of
+ * "path:line: text" lines; Enter opens the file of the one under the
+ * cursor at the match. Searching for the same query again shows the last
+ * results.
+ */
+static Codein *grep_ed = NULL; // the results
+static char grep_query_buf[128];
+
+static void grep_updated(void *arg)
+{
+    (void)arg;
+    if (!grep_job) return;
+    grep_collect(grep_job, grep_ed);
+    if (grep_view) request_redraw();
+}
+
+// runs on a worker when found matches or the end of the search wait
+static void grep_notify(void)
+{
+    post_event(grep_updated, NULL);
 }
 
-static void draw_screen()
+static void start_grep(void)
 {
+    if (!prompt_line("Grep project: ", grep_query_buf, sizeof(grep_query_buf)) || !grep_query_buf[0]) return;
+    if (!grep_ed && !(grep_ed = codein_new())) return;
+    if (!project_finder()) return;
+    grep_view = 1;
+    if (grep_job && strcmp(grep_query(grep_job), grep_query_buf) == 0 &&
+        strcmp(grep_root(grep_job), finder_root(finder)) == 0)
+        return;
+    grep_free(grep_job);
+    codein_load(grep_ed, NULL);
+    if (!(grep_job = grep_start(finder_root(finder), grep_query_buf, grep_notify))) {
+        grep_view = 0;
+        set_status_msg("Cannot search %s", finder_root(finder));
+        return;
+    }
     int rows, cols;
     getmaxyx(stdscr, rows, cols);
-    erase();
-    int visible = rows - 1; // reserve last line for status
-    for (int i = 0; i < visible; ++i) {
-        int idx = top_line + i;
-        if (idx >= num_lines) break;
-        // highlight current line with underline
-        if (idx == cur_y) {
-            attron(A_BOLD);
-        }
-        // only draw up to screen width
-        mvaddnstr(i, 0, lines[idx], cols);
-        if (idx == cur_y) {
-            attroff(A_BOLD);
+    codein_set_view(grep_ed, rows - 1, cols);
+    grep_feed(grep_job, finder);
+}
+
+static void open_grep_hit(void)
+{
+    int y;
+    codein_cursor(grep_ed, &y, NULL);
+    const GrepHit *h = grep_hit(grep_job, y);
+    if (!h) {
+        beep();
+        return;
+    }
+    if (!open_project_file(grep_root(grep_job), h->path)) return;
+    grep_view = 0;
+    codein_goto(ed, h->line, h->col);
+}
+
+// keys of the results; 0 lets the editor handle the key
+static int grep_key(int ch)
+{
+    if (ch == KEY_UP) codein_move_up(grep_ed);
+    else if (ch == KEY_DOWN) codein_move_down(grep_ed);
+    else if (ch == KEY_PPAGE) codein_page_up(grep_ed);
+    else if (ch == KEY_NPAGE) codein_page_down(grep_ed);
+    else if (ch == KEY_LEFT) codein_move_left(grep_ed);
+    else if (ch == KEY_RIGHT) codein_move_right(grep_ed);
+    else if (ch == '\n' || ch == KEY_ENTER) open_grep_hit();
+    else if (ch == 27 || ch == 'q' || ch == 31) grep_view = 0;
+    else if (!(ch >= 32 && ch < 127) && ch != KEY_BACKSPACE && ch != 127) return 0;
+    return 1; // the results are read-only
+}
+
+// the results with each visible match highlighted
+static void draw_grep(const char *hint)
+{
+    static RenderMark marks[512];
+    char buf[256];
+    int n = 0, qlen = strlen(grep_query(grep_job));
+    codein_scroll_to_cursor(grep_ed, LINES - 1);
+    int top = codein_top_line(grep_ed);
+    for (int y = top; y < top + LINES - 1 && n < 512; ++y) {
+        const GrepHit *h = grep_hit(grep_job, y);
+        if (h) marks[n++] = (RenderMark){ y, h->at, y, h->at + qlen, A_REVERSE };
+    }
+    if (!status_msg[0]) {
+        snprintf(buf, sizeof(buf), "%.64s: %d matches in %d files%s  Enter opens  Esc closes",
+                 grep_query(grep_job), grep_count(grep_job), grep_files(grep_job),
+                 grep_searching(grep_job) || finder_scanning(finder) ? " (searching)" : grep_truncated(grep_job) ? " (stopped)" : "");
+        hint = buf;
+    }
+    draw_screen_marked(grep_ed, hint, marks, n);
+}
+
+// diagnostics on the visible lines as underlines
+static void draw_with_diagnostics(const char *hint)
+{
+    static RenderMark *marks = NULL;
+    static int cap = 0;
+    const LspDiag *d;
+    int n = lsp_diagnostics(lsp, &d), nmarks = 0;
+    codein_scroll_to_cursor(ed, LINES - 1);
+    int top = codein_top_line(ed);
+    for (int i = 0; i < n && d[i].y0 < top + LINES; ++i) {
+        if (d[i].y1 < top) continue;
+        if (nmarks == cap) {
+            int ncap = cap ? cap * 2 : 64;
+            RenderMark *nm = realloc(marks, sizeof(RenderMark) * ncap);
+            if (!nm) break;
+            marks = nm;
+            cap = ncap;
         }
+        marks[nmarks++] = (RenderMark){ d[i].y0, d[i].x0, d[i].y1, d[i].x1,
+                                        d[i].severity == 1 ? A_REVERSE : A_UNDERLINE };
     }
-    // status (truncate if necessary)
-    move(rows - 1, 0);
-    clrtoeol();
-    char status[4096];
-    if (filename[0])
-        snprintf(status, sizeof(status), "File: %s  Ln %d Col %d  Ctrl-H: help", filename, cur_y+1, cur_x+1);
-    else
-        snprintf(status, sizeof(status), "[No Name]  Ln %d Col %d  Ctrl-H: help", cur_y+1, cur_x+1);
-    attron(A_REVERSE);
-    mvaddnstr(rows - 1, 0, status, cols);
-    attroff(A_REVERSE);
-
-    // ensure cursor is within visible bounds
-    if (cur_x < 0) cur_x = 0;
-    if (cur_y < 0) cur_y = 0;
-    if (cur_y >= num_lines) cur_y = num_lines - 1;
-    int disp_y = cur_y - top_line;
-    if (disp_y < 0) {
-        top_line = cur_y;
-        disp_y = 0;
-    } else if (disp_y >= visible) {
-        top_line = cur_y - visible + 1;
-        disp_y = visible - 1;
-    }
-    int disp_x = cur_x;
-    if (disp_x >= cols) disp_x = cols - 1;
-    move(disp_y, disp_x);
-    refresh();
+    draw_screen_marked(ed, hint, marks, nmarks);
+    if (menu_items) draw_menu();
 }
 
-static void insert_char(int c)
+// the first diagnostic on the cursor line, for the status line
+static const char *cursor_diagnostic(void)
 {
-    // record undo before mutating
-    push_undo();
-    // wrap to newline when reaching screen width
-    int rows, cols;
-    getmaxyx(stdscr, rows, cols);
-    (void)rows; // rows is unused here; keep to match screen size usage
-    if (cur_x >= cols - 1) {
-        newline();
-        return;
+    static const char *const kinds[] = { "error", "error", "warning", "info", "hint" };
+    static char buf[256];
+    const LspDiag *d;
+    int n = lsp_diagnostics(lsp, &d), y;
+    codein_cursor(ed, &y, NULL);
+    for (int i = 0; i < n && d[i].y0 <= y; ++i) {
+        if (d[i].y1 < y) continue;
+        int sev = d[i].severity >= 1 && d[i].severity <= 4 ? d[i].severity : 0;
+        snprintf(buf, sizeof(buf), "%s: %s", kinds[sev], d[i].message);
+        buf[strcspn(buf, "\n")] = '\0';
+        return buf;
     }
-    char *ln = lines[cur_y];
-    int len = strlen(ln);
-    if (len + 2 >= MAX_COL) return;
-    char *newl = malloc(len + 2);
-    if (!newl) return;
-    memcpy(newl, ln, cur_x);
-    newl[cur_x] = (char)c;
-    memcpy(newl + cur_x + 1, ln + cur_x, len - cur_x + 1);
-    free(lines[cur_y]);
-    lines[cur_y] = newl;
-    cur_x++;
-}
-
-static void backspace()
-{
-    push_undo();
-    if (cur_x > 0) {
-        char *ln = lines[cur_y];
-        int len = strlen(ln);
-        memmove(ln + cur_x - 1, ln + cur_x, len - cur_x + 1);
-        cur_x--;
-    } else if (cur_y > 0) {
-        int prev_len = strlen(lines[cur_y-1]);
-        int cur_len = strlen(lines[cur_y]);
-        if (prev_len + cur_len + 1 >= MAX_COL) return;
-        char *newl = malloc(prev_len + cur_len + 1);
-        strcpy(newl, lines[cur_y-1]);
-        strcat(newl, lines[cur_y]);
-        free(lines[cur_y-1]);
-        lines[cur_y-1] = newl;
-        free(lines[cur_y]);
-        // shift lines up
-        for (int i = cur_y; i < num_lines - 1; ++i) lines[i] = lines[i+1];
-        num_lines--;
-        cur_y--;
-        cur_x = prev_len;
-    }
-}
-
-static void newline()
-{
-    push_undo();
-    if (num_lines + 1 >= MAX_LINES) return;
-    char *ln = lines[cur_y];
-    // split at cur_x
-    char *left = malloc(cur_x + 1);
-    char *right = strdup(ln + cur_x);
-    if (!left || !right) return;
-    memcpy(left, ln, cur_x);
-    left[cur_x] = '\0';
-    free(lines[cur_y]);
-    lines[cur_y] = left;
-    // insert right as new line
-    for (int i = num_lines; i > cur_y + 1; --i) lines[i] = lines[i-1];
-    lines[cur_y+1] = right;
-    num_lines++;
-    cur_y++;
-    cur_x = 0;
-}
-
-static void page_up(void)
+    return NULL;
+}
+
+static void draw(const char *hint)
 {
-    int rows, cols;
-    getmaxyx(stdscr, rows, cols);
-    int visible = rows - 1;
-    if (visible <= 0) visible = 1;
-    if (cur_y == 0) {
-        top_line = 0;
+    if (picker_view) draw_picker(&picker, finder, ed, hint);
+    else if (grep_view) draw_grep(hint);
+    else if (hist_view) draw_histogram(&hist, ed, hint);
+    else if (table_view) draw_table(ed, &table, hint);
+    else draw_with_diagnostics(hint);
+}
+
+// latency HUD: cost of the last key-driven frame
+static int hud = 0;
+static uint64_t hud_key_ns = 0, hud_frame_bytes = 0;
+
+// full repaint with the front end's current status hint
+static void redraw(void)
+{
+    lsp_flush(lsp);
+    const char *diag = cursor_diagnostic();
+    const char *hint = status_msg[0] ? status_msg
+                     : recording ? "Recording macro (Ctrl-R stops)" : diag ? diag : "Ctrl-H: help";
+    char path[256], path_hint[sizeof(path) + sizeof(status_msg) + 2];
+    json_refresh();
+    if (json_current()) {
+        int y, x;
+        codein_cursor(ed, &y, &x);
+        json_path(json_ix, y, x, path, sizeof(path));
+        snprintf(path_hint, sizeof(path_hint), "%s  %.*s", path, (int)sizeof(status_msg), hint);
+        hint = path_hint;
+    }
+    if (!hud) {
+        draw(hint);
         return;
     }
-    if (cur_y - visible < 0) cur_y = 0;
-    else cur_y -= visible;
-    if (top_line > cur_y) top_line = cur_y;
-    int l = strlen(lines[cur_y]);
-    if (cur_x > l) cur_x = l;
+    char buf[sizeof(path_hint) + 64];
+    snprintf(buf, sizeof(buf), "[key %.2fms out %lluB] %s", hud_key_ns / 1e6,
+             (unsigned long long)hud_frame_bytes, hint);
+    draw(buf);
+}
+
+// which output bucket a key's frame is charged to
+static int key_out_type(int ch)
+{
+    switch (ch) {
+    case KEY_BACKSPACE: case 127: return OUT_DELETE;
+    case KEY_UP: case KEY_DOWN: case KEY_LEFT: case KEY_RIGHT: return OUT_MOVE;
+    case KEY_PPAGE: case KEY_NPAGE: return OUT_SCROLL;
+    case 21: case 26: return OUT_UNDO;
+    case 6: case 14: return OUT_SEARCH;
+    case 5: case 8: case 19: case 20: return OUT_PROMPT;
+    case '\n': case KEY_ENTER: return OUT_INSERT;
+    }
+    return ch >= 32 && ch < 127 ? OUT_INSERT : OUT_OTHER;
+}
+
+/*
+ * Event loop: the UI thread sleeps in poll() on the tty, an eventfd that
+ * background work pokes after posting a completion, a signalfd for
+ * SIGWINCH and, once the file picker has listed a project, its inotify
+ * descriptor. Timers are kept in a small table and bound the poll timeout.
+ * Everything that touches the buffer or the screen runs on the UI thread;
+ * other threads only hand work over through post_event().
+ */
+typedef struct PostedEvent {
+    event_fn fn;
+    void *arg;
+    struct PostedEvent *next;
+} PostedEvent;
+
+typedef struct {
+    int active;
+    long long deadline; // CLOCK_MONOTONIC, ms
+    int repeat_ms;      // 0 for one-shot
+    event_fn fn;
+    void *arg;
+} Timer;
+
+static int wake_fd = -1;
+static int sig_fd = -1;
+static pthread_mutex_t posted_lock = PTHREAD_MUTEX_INITIALIZER;
+static PostedEvent *posted_head = NULL, *posted_tail = NULL;
+static Timer timers[MAX_TIMERS];
+static int needs_redraw = 0;
+static int frame_type = OUT_OTHER; // what the pending repaint is charged to
+
+static long long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void request_redraw(void)
+{
+    needs_redraw = 1;
 }
 
-static void page_down(void)
+// queue fn(arg) to run on the UI thread; safe to call from any thread
+static int post_event(event_fn fn, void *arg)
+{
+    PostedEvent *e = malloc(sizeof(*e));
+    if (!e) return -1;
+    e->fn = fn;
+    e->arg = arg;
+    e->next = NULL;
+    pthread_mutex_lock(&posted_lock);
+    if (posted_tail) posted_tail->next = e;
+    else posted_head = e;
+    posted_tail = e;
+    pthread_mutex_unlock(&posted_lock);
+    uint64_t one = 1;
+    if (write(wake_fd, &one, sizeof(one)) < 0) {
+        // counter saturated: a wakeup is already pending
+    }
+    return 0;
+}
+
+static void run_posted(void)
+{
+    uint64_t n;
+    if (read(wake_fd, &n, sizeof(n)) < 0) {
+        // spurious wakeup
+    }
+    pthread_mutex_lock(&posted_lock);
+    PostedEvent *e = posted_head;
+    posted_head = posted_tail = NULL;
+    pthread_mutex_unlock(&posted_lock);
+    while (e) {
+        PostedEvent *next = e->next;
+        e->fn(e->arg);
+        free(e);
+        e = next;
+    }
+}
+
+// returns a timer id, or -1 if the table is full
+static int add_timer(int delay_ms, int repeat_ms, event_fn fn, void *arg)
+{
+    for (int i = 0; i < MAX_TIMERS; ++i) {
+        if (timers[i].active) continue;
+        timers[i].active = 1;
+        timers[i].deadline = now_ms() + delay_ms;
+        timers[i].repeat_ms = repeat_ms;
+        timers[i].fn = fn;
+        timers[i].arg = arg;
+        return i;
+    }
+    return -1;
+}
+
+static void cancel_timer(int id)
+{
+    if (id >= 0 && id < MAX_TIMERS) timers[id].active = 0;
+}
+
+// milliseconds until the next timer fires, -1 if none is armed
+static int next_timer_timeout(void)
+{
+    long long now = now_ms(), best = -1;
+    for (int i = 0; i < MAX_TIMERS; ++i) {
+        if (!timers[i].active) continue;
+        long long left = timers[i].deadline - now;
+        if (left < 0) left = 0;
+        if (best < 0 || left < best) best = left;
+    }
+    return (int)best;
+}
+
+static void run_timers(void)
+{
+    long long now = now_ms();
+    for (int i = 0; i < MAX_TIMERS; ++i) {
+        Timer *t = &timers[i];
+        if (!t->active || t->deadline > now) continue;
+        if (t->repeat_ms > 0) t->deadline = now + t->repeat_ms;
+        else t->active = 0;
+        t->fn(t->arg);
+    }
+}
+
+static void clear_status_msg(void *arg)
+{
+    (void)arg;
+    status_msg[0] = '\0';
+    status_timer = -1;
+    request_redraw();
+}
+
+static void set_status_msg(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(status_msg, sizeof(status_msg), fmt, ap);
+    va_end(ap);
+    cancel_timer(status_timer);
+    status_timer = add_timer(STATUS_MSG_MS, 0, clear_status_msg, NULL);
+    request_redraw();
+}
+
+static void terminal_bell(void *arg)
+{
+    (void)arg;
+    beep();
+}
+
+static void update_view_size(void)
 {
     int rows, cols;
     getmaxyx(stdscr, rows, cols);
-    int visible = rows - 1;
-    if (visible <= 0) visible = 1;
-    if (cur_y >= num_lines - 1) {
-        top_line = num_lines > visible ? num_lines - visible : 0;
+    codein_set_view(ed, rows - 1, cols); // reserve last line for status
+    if (grep_ed) codein_set_view(grep_ed, rows - 1, cols);
+}
+
+static const char *trace_path = NULL; // --trace: Chrome trace output
+
+static void write_trace(void)
+{
+    if (trace_path && prof_trace_write(trace_path) < 0)
+        set_status_msg("Cannot write trace %s", trace_path);
+}
+
+static void handle_signals(void)
+{
+    struct signalfd_siginfo si;
+    while (read(sig_fd, &si, sizeof(si)) == sizeof(si)) {
+        if (si.ssi_signo == SIGUSR1) {
+            write_trace();
+            continue;
+        }
+        if (si.ssi_signo == SIGWINCH) {
+            struct winsize ws;
+            if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0)
+                resizeterm(ws.ws_row, ws.ws_col);
+            update_view_size();
+            frame_type = OUT_RESIZE;
+            request_redraw();
+        }
+    }
+}
+
+// set up wakeup and signal descriptors; must run before any thread starts
+static int init_events(void)
+{
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGWINCH);
+    sigaddset(&mask, SIGUSR1); // dump the trace ring
+    if (pthread_sigmask(SIG_BLOCK, &mask, NULL) != 0) return -1;
+    sig_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (sig_fd < 0 || wake_fd < 0) return -1;
+    return 0;
+}
+
+static int handle_key(int ch);
+
+/*
+ * Replay the recorded macro `count` times, or until a search in it fails
+ * when count is 0. In that mode searches do not wrap, and replay also
+ * stops after an iteration that changed neither buffer nor cursor.
+ */
+static void replay_macro(int count)
+{
+    if (macro_len == 0 || recording || replay_keys) {
+        beep();
         return;
     }
-    if (cur_y + visible >= num_lines - 1) cur_y = num_lines - 1;
-    else cur_y += visible;
-    int desired_top = cur_y - visible + 1;
-    if (desired_top < 0) desired_top = 0;
-    top_line = desired_top;
-    int l = strlen(lines[cur_y]);
-    if (cur_x > l) cur_x = l;
+    codein_begin_batch(ed);
+    codein_set_search_wrap(ed, count != 0);
+    search_failed = 0;
+    for (int n = 0; count == 0 || n < count; ++n) {
+        unsigned long before = codein_version(ed);
+        int bx, by, x, y;
+        codein_cursor(ed, &by, &bx);
+        replay_keys = macro_keys;
+        replay_len = macro_len;
+        replay_pos = 0;
+        while (replay_pos < replay_len && !search_failed)
+            handle_key(replay_keys[replay_pos++]);
+        if (search_failed) break;
+        codein_cursor(ed, &y, &x);
+        if (count == 0 && before == codein_version(ed) && bx == x && by == y) break;
+    }
+    replay_keys = NULL;
+    codein_set_search_wrap(ed, 1);
+    codein_end_batch(ed);
+    request_redraw();
+}
+
+static void prompt_replay(void)
+{
+    char buf[16] = {0};
+    if (!prompt_line("Replay macro times (0 = until search fails): ", buf, sizeof(buf))) return;
+    replay_macro(buf[0] ? atoi(buf) : 1);
+}
+
+static void toggle_recording(void)
+{
+    if (recording) {
+        recording = 0;
+        macro_len--; // drop the Ctrl-R that stopped it
+        set_status_msg("Macro recorded (%d keys), Ctrl-E replays", macro_len);
+    } else {
+        recording = 1;
+        macro_len = 0;
+    }
+}
+
+// apply one key; returns 0 when the editor should quit
+static int handle_key(int ch)
+{
+    if (picker_view && picker_key(ch)) return 1;
+    if (grep_view && grep_key(ch)) return 1;
+    if (hist_view && hist_key(ch)) return 1;
+    if (menu_items && menu_key(ch)) return 1;
+    if (ch == 17) { // Ctrl-Q
+        return replay_keys != NULL; // a macro cannot quit the editor
+    } else if (ch == 18) { // Ctrl-R (record macro)
+        if (replay_keys) return 1;
+        toggle_recording();
+    } else if (ch == 5) { // Ctrl-E (replay macro)
+        if (recording) {
+            macro_len--;
+            beep();
+            return 1;
+        }
+        prompt_replay();
+    } else if (ch == 19) { // Ctrl-S
+        prompt_save_filename();
+    } else if (ch == KEY_UP) {
+        codein_move_up(ed);
+    } else if (ch == KEY_DOWN) {
+        codein_move_down(ed);
+    } else if (ch == KEY_PPAGE) {
+        codein_page_up(ed);
+    } else if (ch == KEY_NPAGE) {
+        codein_page_down(ed);
+    } else if (ch == KEY_LEFT) {
+        codein_move_left(ed);
+    } else if (ch == KEY_RIGHT) {
+        codein_move_right(ed);
+    } else if (ch == KEY_BACKSPACE || ch == 127) {
+        codein_backspace(ed);
+    } else if (ch == 21) { // Ctrl-U (undo)
+        codein_undo(ed);
+    } else if (ch == 26) { // Ctrl-Z (redo)
+        codein_redo(ed);
+    } else if (ch == 6) { // Ctrl-F
+        prompt_search();
+    } else if (ch == 14) { // Ctrl-N (search again)
+        search_failed = !codein_search(ed, NULL);
+    } else if (ch == 24) { // Ctrl-X
+        start_export();
+    } else if (ch == 7) { // Ctrl-G
+        prompt_goto_time();
+    } else if (ch == 11) { // Ctrl-K
+        json_command();
+    } else if (ch == 25) { // Ctrl-Y
+        toggle_hist();
+    } else if (ch == 23) { // Ctrl-W
+        toggle_follow();
+    } else if (ch == 4) { // Ctrl-D
+        lsp_command(lsp_definition);
+    } else if (ch == 12) { // Ctrl-L
+        lsp_command(lsp_hover);
+    } else if (ch == 0) { // Ctrl-Space
+        lsp_command(lsp_complete);
+    } else if (ch == 29) { // Ctrl-]
+        jump_to_tag();
+    } else if (ch == 2) { // Ctrl-B
+        open_picker();
+    } else if (ch == 31) { // Ctrl-/
+        start_grep();
+    } else if (ch == 15) { // Ctrl-O
+        toggle_table();
+    } else if ((ch == '\t' || ch == KEY_BTAB) && table_view) {
+        table_next_field(ed, &table, ch == '\t' ? 1 : -1);
+    } else if (ch == 20) { // Ctrl-T
+        show_stats();
+    } else if (ch == 16) { // Ctrl-P
+        hud = !hud;
+    } else if (ch == 8) { // Ctrl-H
+        show_help();
+    } else if (ch == '\n' || ch == KEY_ENTER) {
+        codein_newline(ed);
+    } else if (ch >= 32 && ch < 127) {
+        codein_insert_char(ed, ch);
+    }
+    return 1;
+}
+
+static int load_trace(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    char buf[128];
+    int cap = 0;
+    while (fgets(buf, sizeof(buf), f)) {
+        TraceKey k;
+        if (buf[0] == '#' || sscanf(buf, "%lld %d", &k.ms, &k.key) != 2) continue;
+        if (trace_len == cap) {
+            cap = cap ? cap * 2 : 1024;
+            TraceKey *nk = realloc(trace_keys, sizeof(TraceKey) * cap);
+            if (!nk) {
+                fclose(f);
+                return -1;
+            }
+            trace_keys = nk;
+        }
+        trace_keys[trace_len++] = k;
+    }
+    fclose(f);
+    if (trace_len == 0) {
+        fprintf(stderr, "codein: %s: no keys in trace\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// replay the loaded trace as fast as possible (or at recorded pace)
+static void run_replay(void)
+{
+    uint64_t *lat = malloc(sizeof(uint64_t) * trace_len);
+    int nkeys = 0;
+    if (!lat) return;
+    prof_enabled = 1;
+    trace_start = now_ms();
+    uint64_t start = prof_now_ns();
+    while (trace_pos < trace_len) {
+        int ch = next_trace_key();
+        uint64_t t0 = prof_now_ns();
+        int keep_going;
+        {
+            PROF_SCOPE(PROF_KEY);
+            keep_going = handle_key(ch);
+            codein_publish(ed);
+            redraw();
+        }
+        term_frame_end(key_out_type(ch));
+        lat[nkeys++] = prof_now_ns() - t0;
+        struct pollfd pfd = { wake_fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 0) > 0) run_posted();
+        if (!keep_going) break;
+    }
+    uint64_t total = prof_now_ns() - start;
+    endwin();
+
+    qsort(lat, nkeys, sizeof(uint64_t), cmp_u64);
+    printf("keys %d  total %.3f ms  %.0f keys/s\n", nkeys, total / 1e6,
+           total ? nkeys / (total / 1e9) : 0.0);
+    printf("latency_us p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n",
+           lat[nkeys / 2] / 1e3, lat[nkeys * 9 / 10] / 1e3,
+           lat[nkeys * 99 / 100] / 1e3, lat[nkeys - 1] / 1e3);
+    prof_report(stdout);
+    term_report(stdout);
+    free(lat);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: codein [--stats] [--trace OUT.json] "
+                    "[--record TRACE | --replay TRACE [--realtime] [--tty]] [file]\n"
+                    "       codein [--stats] [--trace OUT.json] --script CMDS [file]\n"
+                    "       codein [--lsp CMD] [file]\n"
+                    "       codein --server SOCK [file]\n"
+                    "       codein --attach SOCK\n");
 }
 
 int main(int argc, char **argv)
 {
-    if (argc > 1) load_file(argv[1]);
-    else load_file(NULL);
+    const char *script = NULL, *record = NULL, *replay = NULL, *path = NULL;
+    const char *serve = NULL, *attach = NULL, *lsp_cmd = NULL;
+    int use_tty = 0, stats = 0;
+    setlocale(LC_ALL, ""); // buffers hold UTF-8; curses needs the locale to draw it
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--script") == 0 && i + 1 < argc) script = argv[++i];
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) record = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) replay = argv[++i];
+        else if (strcmp(argv[i], "--realtime") == 0) trace_realtime = 1;
+        else if (strcmp(argv[i], "--tty") == 0) use_tty = 1;
+        else if (strcmp(argv[i], "--stats") == 0) stats = 1;
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) trace_path = argv[++i];
+        else if (strcmp(argv[i], "--server") == 0 && i + 1 < argc) serve = argv[++i];
+        else if (strcmp(argv[i], "--attach") == 0 && i + 1 < argc) attach = argv[++i];
+        else if (strcmp(argv[i], "--lsp") == 0 && i + 1 < argc) lsp_cmd = argv[++i];
+        else if (argv[i][0] == '-' && argv[i][1] == '-') {
+            usage();
+            return 2;
+        } else path = argv[i];
+    }
+    if (attach) return run_client(attach);
+    if (trace_path) {
+        if (prof_trace_start(TRACE_EVENTS) < 0) {
+            perror("codein");
+            return 1;
+        }
+        prof_trace_thread("ui");
+    }
+    ed = codein_new();
+    if (!ed) {
+        perror("codein");
+        return 1;
+    }
+    if (codein_load(ed, path) < 0) {
+        perror(path);
+        return 1;
+    }
+    if (script) {
+        int status = run_script(ed, script);
+        if (trace_path && prof_trace_write(trace_path) < 0) perror(trace_path);
+        if (stats) mem_report(ed, stderr);
+        return status;
+    }
+    if (serve) {
+        int status = run_server(ed, serve);
+        if (stats) mem_report(ed, stderr);
+        codein_free(ed);
+        return status;
+    }
+    if (replay && load_trace(replay) < 0) return 1;
+    if (record && !(trace_out = fopen(record, "w"))) {
+        perror(record);
+        return 1;
+    }
+
+    if (init_events() < 0) {
+        perror("codein");
+        return 1;
+    }
+    // workers inherit the blocked signal mask set up above
+    pool_init(0);
 
-    initscr();
+    if (replay && !use_tty) {
+        // null renderer: full curses work, output discarded
+        FILE *null_out = fopen("/dev/null", "w");
+        const char *term = getenv("TERM");
+        if (null_out) term_out_fd = fileno(null_out);
+        if (!null_out || !newterm(term && term[0] ? term : "xterm", null_out, stdin)) {
+            fprintf(stderr, "codein: cannot set up null renderer\n");
+            return 1;
+        }
+    } else {
+        term_out_fd = STDOUT_FILENO;
+        initscr();
+    }
     raw();
     keypad(stdscr, TRUE);
     noecho();
     curs_set(1);
+    update_view_size();
+    codein_set_bell(ed, terminal_bell, NULL);
+    char delim = table_detect(ed, 1);
+    if (delim) start_table(delim);
+    else if (!(json_mode = json_detect(ed))) {
+        log_fmt = logts_detect(ed);
+        log_reindex();
+    }
+    if (!replay && !lsp_cmd) lsp_cmd = lsp_default_command(path);
+    if (!replay && lsp_cmd && lsp_cmd[0] && !(lsp = lsp_start(lsp_cmd, ed, post_event, lsp_event, NULL)))
+        set_status_msg("Cannot start language server: %s", lsp_cmd);
 
-    int ch;
-    draw_screen();
-    while (1) {
-        ch = getch();
-        if (ch == 17) { // Ctrl-Q
-            break;
-        } else if (ch == 19) { // Ctrl-S
-            prompt_save_filename();
-        } else if (ch == KEY_UP) {
-            if (cur_y > 0) {
-                cur_y--;
-                int l = strlen(lines[cur_y]);
-                if (cur_x > l) cur_x = l;
-            }
-        } else if (ch == KEY_DOWN) {
-            if (cur_y < num_lines - 1) {
-                cur_y++;
-                int l = strlen(lines[cur_y]);
-                if (cur_x > l) cur_x = l;
+    int running = !replay;
+    trace_start = now_ms();
+    codein_publish(ed);
+    redraw();
+    term_frame_end(OUT_OTHER);
+    if (replay) run_replay();
+    while (running) {
+        struct pollfd fds[4] = {
+            { STDIN_FILENO, POLLIN, 0 },
+            { wake_fd, POLLIN, 0 },
+            { sig_fd, POLLIN, 0 },
+            { finder ? finder_fd(finder) : -1, POLLIN, 0 },
+        };
+        if (poll(fds, 4, next_timer_timeout()) < 0) continue; // EINTR
+        if (fds[2].revents & POLLIN) handle_signals();
+        if (fds[1].revents & POLLIN) run_posted();
+        if (fds[3].revents & POLLIN) finder_updated(NULL);
+        run_timers();
+        uint64_t key_t0 = 0;
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            // drain every queued key, then redraw once; prompts block in getch()
+            int ch;
+            for (;;) {
+                nodelay(stdscr, TRUE);
+                ch = getch();
+                nodelay(stdscr, FALSE);
+                if (ch == ERR) break;
+                if (!key_t0) key_t0 = prof_now_ns();
+                log_key(ch);
+                record_key(ch);
+                PROF_SCOPE(PROF_KEY);
+                if (!handle_key(ch)) {
+                    running = 0;
+                    break;
+                }
+                frame_type = key_out_type(ch);
+                needs_redraw = 1;
             }
-        } else if (ch == KEY_PPAGE) {
-            page_up();
-        } else if (ch == KEY_NPAGE) {
-            page_down();
-        } else if (ch == KEY_LEFT) {
-            if (cur_x > 0) cur_x--;
-            else if (cur_y > 0) {
-                cur_y--;
-                cur_x = strlen(lines[cur_y]);
-            }
-        } else if (ch == KEY_RIGHT) {
-            int l = strlen(lines[cur_y]);
-            if (cur_x < l) cur_x++;
-            else if (cur_y < num_lines - 1) {
-                cur_y++;
-                cur_x = 0;
+            if (fds[0].revents & (POLLHUP | POLLERR)) running = 0;
+        }
+        if (running && needs_redraw) {
+            needs_redraw = 0;
+            codein_publish(ed);
+            redraw();
+            uint64_t bytes = term_frame_end(frame_type);
+            frame_type = OUT_OTHER;
+            if (key_t0) {
+                hud_key_ns = prof_now_ns() - key_t0;
+                hud_frame_bytes = bytes;
             }
-        } else if (ch == KEY_BACKSPACE || ch == 127) {
-            backspace();
-        } else if (ch == 21) { // Ctrl-U (undo)
-            do_undo();
-        } else if (ch == 26) { // Ctrl-Z (redo)
-            do_redo();
-        } else if (ch == 6) { // Ctrl-F
-            prompt_search();
-        } else if (ch == 14) { // Ctrl-N (search again)
-            search_forward();
-        } else if (ch == 8) { // Ctrl-H
-            show_help();
-        } else if (ch == '\n' || ch == KEY_ENTER) {
-            newline();
-        } else if (ch >= 32 && ch < 127) {
-            insert_char(ch);
         }
-        draw_screen();
     }
 
-    endwin();
+    if (!replay) endwin();
+    if (trace_out) fclose(trace_out);
+    table_stop(&table);
+    hist_stop(&hist);
+    lsp_stop(lsp);
+    tags_free_matches(tag_matches, tag_count);
+    tags_close(tags);
+    grep_free(grep_job);
+    if (grep_ed) codein_free(grep_ed);
+    finder_free(finder);
+    picker_free(&picker);
+    if (json_tok) cancel_token_cancel(json_tok);
+    if (log_tok) cancel_token_cancel(log_tok);
+    pool_shutdown();
+    json_index_free(json_ix);
+    log_index_free(log_ix);
+    if (trace_path && prof_trace_write(trace_path) < 0) perror(trace_path);
+    if (stats) {
+        mem_report(ed, stderr);
+        fprintf(stderr, "\n");
+        term_report(stderr);
+    }
+    codein_free(ed);
     return 0;
-}
\ No newline at end of file
+}
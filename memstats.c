@@ -0,0 +1,63 @@
+/*
+ * Memory accounting report
+ */
+
+#include "memstats.h"
+
+#include <malloc.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+static void row(FILE *out, const char *name, const CodeinMemUse *u)
+{
+    fprintf(out, "%-20s %14zu %14zu\n", name, u->requested, u->allocated);
+}
+
+// resident set size in bytes from /proc, 0 if unavailable
+static size_t current_rss(void)
+{
+    FILE *f = fopen("/proc/self/statm", "r");
+    unsigned long size, resident = 0;
+    if (!f) return 0;
+    if (fscanf(f, "%lu %lu", &size, &resident) != 2) resident = 0;
+    fclose(f);
+    return resident * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+void mem_report(Codein *ed, FILE *out)
+{
+    CodeinMem m;
+    codein_mem(ed, &m);
+    CodeinMemUse total = { 0, 0 };
+    const CodeinMemUse *cats[] = { &m.line_text, &m.line_index, &m.undo, &m.redo, &m.snapshots };
+    for (int i = 0; i < 5; ++i) {
+        total.requested += cats[i]->requested;
+        total.allocated += cats[i]->allocated;
+    }
+
+    fprintf(out, "%-20s %14s %14s\n", "category", "requested", "allocated");
+    row(out, "line text", &m.line_text);
+    row(out, "line index", &m.line_index);
+    row(out, "undo stack", &m.undo);
+    row(out, "redo stack", &m.redo);
+    row(out, "snapshot cache", &m.snapshots);
+    row(out, "total", &total);
+
+    // whole-process heap as glibc sees it
+    struct mallinfo2 mi = mallinfo2();
+    size_t heap_used = mi.uordblks + mi.hblkhd;
+    fprintf(out, "\n%-20s %14zu\n", "allocator overhead", total.allocated - total.requested);
+    fprintf(out, "%-20s %14zu\n", "heap in use", heap_used);
+    fprintf(out, "%-20s %14zu\n", "heap untracked",
+            heap_used > total.allocated ? heap_used - total.allocated : 0);
+    fprintf(out, "%-20s %14zu  (%.1f%% of arena)\n", "heap free (frag)", mi.fordblks,
+            mi.arena ? 100.0 * mi.fordblks / mi.arena : 0.0);
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    // the kernel updates its high-water mark lazily
+    size_t rss = current_rss(), peak = (size_t)ru.ru_maxrss * 1024;
+    fprintf(out, "\n%-20s %14zu\n", "rss", rss);
+    fprintf(out, "%-20s %14zu\n", "peak rss", peak > rss ? peak : rss);
+}
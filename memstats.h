@@ -0,0 +1,17 @@
+/*
+ * Memory accounting report
+ * - Bytes per category of the editing core, allocator overhead and
+ *   fragmentation, current and peak RSS
+ * - Shown by Ctrl+T and printed to stderr on exit with --stats
+ */
+
+#ifndef CODEIN_MEMSTATS_H
+#define CODEIN_MEMSTATS_H
+
+#include "codein.h"
+
+#include <stdio.h>
+
+void mem_report(Codein *ed, FILE *out); // owning thread only: walks the live buffer
+
+#endif
@@ -0,0 +1,297 @@
+/*
+ * Shared background task pool
+ *
+ * Every worker owns one deque per priority. A worker pops its own deques
+ * from the bottom (newest first, cache-warm) and, when they are empty,
+ * steals from the top of other workers' deques. Interactive deques are
+ * always drained before any bulk deque is looked at, and a running bulk
+ * task can hand the CPU to waiting interactive work with pool_yield().
+ */
+
+#define _GNU_SOURCE
+#include "pool.h"
+#include "prof.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define POOL_MAX_THREADS 64
+#define POOL_PRIORITIES 2
+
+struct CancelToken {
+    atomic_int refs;
+    atomic_int cancelled;
+};
+
+typedef struct {
+    pool_fn fn;
+    void *arg;
+    CancelToken *tok;
+} Task;
+
+typedef struct {
+    pthread_mutex_t lock;
+    Task *tasks;
+    int cap;
+    int head; // steal end
+    atomic_int count; // written under lock, peeked without it
+} Deque;
+
+typedef struct {
+    pthread_t thread;
+    Deque queues[POOL_PRIORITIES];
+} Worker;
+
+static Worker *workers = NULL;
+static int nworkers = 0;
+static atomic_int next_victim = 0;
+static atomic_int pending = 0;
+static atomic_int interactive_pending = 0;
+static atomic_int stopping = 0;
+static pthread_mutex_t sleep_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sleep_cond = PTHREAD_COND_INITIALIZER;
+
+static __thread int worker_id = -1;
+
+CancelToken *cancel_token_new(void)
+{
+    CancelToken *tok = malloc(sizeof(*tok));
+    if (!tok) return NULL;
+    atomic_init(&tok->refs, 1);
+    atomic_init(&tok->cancelled, 0);
+    return tok;
+}
+
+CancelToken *cancel_token_ref(CancelToken *tok)
+{
+    if (tok) atomic_fetch_add(&tok->refs, 1);
+    return tok;
+}
+
+void cancel_token_unref(CancelToken *tok)
+{
+    if (tok && atomic_fetch_sub(&tok->refs, 1) == 1) free(tok);
+}
+
+void cancel_token_cancel(CancelToken *tok)
+{
+    if (tok) atomic_store(&tok->cancelled, 1);
+}
+
+int task_cancelled(const CancelToken *tok)
+{
+    if (atomic_load(&stopping)) return 1;
+    return tok && atomic_load(&((CancelToken *)tok)->cancelled);
+}
+
+static int deque_push(Deque *d, Task t)
+{
+    pthread_mutex_lock(&d->lock);
+    if (d->count == d->cap) {
+        int ncap = d->cap ? d->cap * 2 : 64;
+        Task *nt = malloc(sizeof(Task) * ncap);
+        if (!nt) {
+            pthread_mutex_unlock(&d->lock);
+            return -1;
+        }
+        // unwrap the ring into the new array
+        for (int i = 0; i < d->count; ++i) nt[i] = d->tasks[(d->head + i) % d->cap];
+        free(d->tasks);
+        d->tasks = nt;
+        d->cap = ncap;
+        d->head = 0;
+    }
+    d->tasks[(d->head + d->count) % d->cap] = t;
+    d->count++;
+    pthread_mutex_unlock(&d->lock);
+    return 0;
+}
+
+// owner end: newest task first
+static int deque_pop(Deque *d, Task *out)
+{
+    int ok = 0;
+    pthread_mutex_lock(&d->lock);
+    if (d->count > 0) {
+        d->count--;
+        *out = d->tasks[(d->head + d->count) % d->cap];
+        ok = 1;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return ok;
+}
+
+// thief end: oldest task first
+static int deque_steal(Deque *d, Task *out)
+{
+    int ok = 0;
+    // cheap unlocked peek so idle thieves do not hammer busy locks
+    if (atomic_load_explicit(&d->count, memory_order_relaxed) == 0) return 0;
+    pthread_mutex_lock(&d->lock);
+    if (d->count > 0) {
+        *out = d->tasks[d->head];
+        d->head = (d->head + 1) % d->cap;
+        d->count--;
+        ok = 1;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return ok;
+}
+
+static int take_from(int prio, int self, Task *out)
+{
+    if (self >= 0 && deque_pop(&workers[self].queues[prio], out)) return 1;
+    int start = self >= 0 ? self + 1 : 0;
+    for (int i = 0; i < nworkers; ++i) {
+        int v = (start + i) % nworkers;
+        if (v == self) continue;
+        if (deque_steal(&workers[v].queues[prio], out)) return 1;
+    }
+    return 0;
+}
+
+static void run_task(int prio, Task *t)
+{
+    atomic_fetch_sub(&pending, 1);
+    if (prio == POOL_INTERACTIVE) atomic_fetch_sub(&interactive_pending, 1);
+    PROF_SCOPE(PROF_TASK);
+    t->fn(t->arg, t->tok);
+    cancel_token_unref(t->tok);
+}
+
+static int take_task(int self, int max_prio, Task *out, int *prio)
+{
+    for (int p = POOL_INTERACTIVE; p <= max_prio; ++p) {
+        if (take_from(p, self, out)) {
+            *prio = p;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void *worker_main(void *arg)
+{
+    worker_id = (int)(intptr_t)arg;
+    if (prof_tracing) {
+        char name[32];
+        snprintf(name, sizeof(name), "worker-%d", worker_id);
+        prof_trace_thread(name);
+    }
+    for (;;) {
+        Task t;
+        int prio;
+        if (take_task(worker_id, POOL_BULK, &t, &prio)) {
+            run_task(prio, &t);
+            continue;
+        }
+        pthread_mutex_lock(&sleep_lock);
+        while (!atomic_load(&stopping) && atomic_load(&pending) == 0)
+            pthread_cond_wait(&sleep_cond, &sleep_lock);
+        int done = atomic_load(&stopping) && atomic_load(&pending) == 0;
+        pthread_mutex_unlock(&sleep_lock);
+        if (done) break;
+    }
+    return NULL;
+}
+
+static int available_cores(void)
+{
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) return CPU_COUNT(&set);
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+int pool_init(int nthreads)
+{
+    if (workers) return 0;
+    if (nthreads <= 0) nthreads = available_cores();
+    if (nthreads > POOL_MAX_THREADS) nthreads = POOL_MAX_THREADS;
+    workers = calloc(nthreads, sizeof(Worker));
+    if (!workers) return -1;
+    atomic_store(&stopping, 0);
+    for (int i = 0; i < nthreads; ++i)
+        for (int p = 0; p < POOL_PRIORITIES; ++p)
+            pthread_mutex_init(&workers[i].queues[p].lock, NULL);
+    // workers must see a complete table before the first steal
+    nworkers = nthreads;
+    for (int i = 0; i < nthreads; ++i) {
+        if (pthread_create(&workers[i].thread, NULL, worker_main, (void *)(intptr_t)i) != 0) {
+            nworkers = i;
+            break;
+        }
+    }
+    return nworkers > 0 ? 0 : -1;
+}
+
+/*
+ * Stop the pool: tasks still queued are run with task_cancelled() true so
+ * they can release their arguments, then the workers are joined.
+ */
+void pool_shutdown(void)
+{
+    if (!workers) return;
+    pthread_mutex_lock(&sleep_lock);
+    atomic_store(&stopping, 1);
+    pthread_cond_broadcast(&sleep_cond);
+    pthread_mutex_unlock(&sleep_lock);
+    for (int i = 0; i < nworkers; ++i) pthread_join(workers[i].thread, NULL);
+    for (int i = 0; i < nworkers; ++i)
+        for (int p = 0; p < POOL_PRIORITIES; ++p) {
+            free(workers[i].queues[p].tasks);
+            pthread_mutex_destroy(&workers[i].queues[p].lock);
+        }
+    free(workers);
+    workers = NULL;
+    nworkers = 0;
+}
+
+int pool_size(void)
+{
+    return nworkers;
+}
+
+int pool_submit(PoolPriority prio, CancelToken *tok, pool_fn fn, void *arg)
+{
+    Task t = { fn, arg, cancel_token_ref(tok) };
+    if (!workers || atomic_load(&stopping)) {
+        // no pool (headless tools, shutdown): run inline
+        PROF_SCOPE(PROF_TASK);
+        fn(arg, tok);
+        cancel_token_unref(tok);
+        return 0;
+    }
+    // workers feed their own deque; other threads spread round-robin
+    int target = worker_id >= 0 ? worker_id
+                                : (int)((unsigned)atomic_fetch_add(&next_victim, 1) % nworkers);
+    atomic_fetch_add(&pending, 1);
+    if (prio == POOL_INTERACTIVE) atomic_fetch_add(&interactive_pending, 1);
+    if (deque_push(&workers[target].queues[prio], t) < 0) {
+        atomic_fetch_sub(&pending, 1);
+        if (prio == POOL_INTERACTIVE) atomic_fetch_sub(&interactive_pending, 1);
+        cancel_token_unref(tok);
+        return -1;
+    }
+    pthread_mutex_lock(&sleep_lock);
+    pthread_cond_signal(&sleep_cond);
+    pthread_mutex_unlock(&sleep_lock);
+    return 0;
+}
+
+// called from inside a bulk task: run any queued interactive work first
+void pool_yield(void)
+{
+    if (worker_id < 0) return;
+    Task t;
+    int prio;
+    while (atomic_load(&interactive_pending) > 0 &&
+           take_task(worker_id, POOL_INTERACTIVE, &t, &prio))
+        run_task(prio, &t);
+}
@@ -0,0 +1,38 @@
+/*
+ * Shared background task pool
+ * - One set of worker threads for every background subsystem
+ * - Per-worker deques with work stealing, two priority levels
+ * - Cancellation through reference-counted tokens
+ */
+
+#ifndef CODEIN_POOL_H
+#define CODEIN_POOL_H
+
+typedef enum {
+    POOL_INTERACTIVE = 0, // results the user is waiting for
+    POOL_BULK = 1,        // indexing, statistics and other long scans
+} PoolPriority;
+
+typedef struct CancelToken CancelToken;
+
+/*
+ * A task receives its argument and its token (may be NULL). Tasks are
+ * always called, even when cancelled before they started, so they can
+ * release `arg`; long tasks should poll task_cancelled() and call
+ * pool_yield() between chunks of work.
+ */
+typedef void (*pool_fn)(void *arg, CancelToken *tok);
+
+int pool_init(int nthreads); // nthreads <= 0: one per available core
+void pool_shutdown(void);
+int pool_size(void);
+int pool_submit(PoolPriority prio, CancelToken *tok, pool_fn fn, void *arg);
+void pool_yield(void);
+
+CancelToken *cancel_token_new(void);
+CancelToken *cancel_token_ref(CancelToken *tok);
+void cancel_token_unref(CancelToken *tok);
+void cancel_token_cancel(CancelToken *tok);
+int task_cancelled(const CancelToken *tok);
+
+#endif
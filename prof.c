@@ -0,0 +1,158 @@
+/*
+ * Lightweight cost counters for the editing hot paths
+ *
+ * Trace events go into a power-of-two ring. A writer claims a slot with
+ * one fetch-add and stamps it with a sequence number after filling it,
+ * so the dump can run while other threads keep recording and skips
+ * slots that are being overwritten.
+ */
+
+#define _GNU_SOURCE
+#include "prof.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TRACE_MAX_THREADS 80
+
+int prof_enabled = 0;
+int prof_tracing = 0;
+ProfCounter prof_counters[PROF_COUNT];
+
+static const char *prof_names[PROF_COUNT] = {
+    "key", "insert_char", "backspace", "newline", "delete_char", "push_undo",
+    "undo", "redo", "search_forward", "publish_version", "draw_screen", "task",
+};
+
+typedef struct {
+    atomic_ulong seq; // claim number + 1 once complete, 0 while written
+    atomic_int id, tid;
+    _Atomic uint64_t start, ns;
+} TraceEvent;
+
+static TraceEvent *trace_ring = NULL;
+static unsigned long trace_mask = 0;
+static atomic_ulong trace_head = 0;
+static uint64_t trace_epoch = 0;
+
+static struct {
+    int tid;
+    char name[32];
+} trace_threads[TRACE_MAX_THREADS];
+static int trace_nthreads = 0;
+static pthread_mutex_t trace_threads_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread int cached_tid = 0;
+
+static int current_tid(void)
+{
+    if (!cached_tid) cached_tid = (int)syscall(SYS_gettid);
+    return cached_tid;
+}
+
+uint64_t prof_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void prof_add(int id, uint64_t ns)
+{
+    // pool tasks report from worker threads
+    ProfCounter *c = &prof_counters[id];
+    __atomic_fetch_add(&c->calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&c->total_ns, ns, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&c->max_ns, __ATOMIC_RELAXED);
+    while (ns > max && !__atomic_compare_exchange_n(&c->max_ns, &max, ns, 1,
+                                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+void prof_report(FILE *out)
+{
+    fprintf(out, "%-16s %10s %12s %10s %10s\n", "function", "calls", "total_ms", "mean_us", "max_us");
+    for (int i = 0; i < PROF_COUNT; ++i) {
+        ProfCounter *c = &prof_counters[i];
+        if (!c->calls) continue;
+        fprintf(out, "%-16s %10llu %12.3f %10.2f %10.2f\n", prof_names[i],
+                (unsigned long long)c->calls, c->total_ns / 1e6,
+                c->total_ns / 1e3 / c->calls, c->max_ns / 1e3);
+    }
+}
+
+int prof_trace_start(size_t events)
+{
+    size_t cap = 1;
+    while (cap < events) cap <<= 1;
+    trace_ring = calloc(cap, sizeof(TraceEvent));
+    if (!trace_ring) return -1;
+    trace_mask = cap - 1;
+    trace_epoch = prof_now_ns();
+    prof_tracing = 1;
+    return 0;
+}
+
+void prof_trace_add(int id, uint64_t start, uint64_t ns)
+{
+    unsigned long n = atomic_fetch_add_explicit(&trace_head, 1, memory_order_relaxed);
+    TraceEvent *e = &trace_ring[n & trace_mask];
+    atomic_store_explicit(&e->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&e->id, id, memory_order_relaxed);
+    atomic_store_explicit(&e->tid, current_tid(), memory_order_relaxed);
+    atomic_store_explicit(&e->start, start, memory_order_relaxed);
+    atomic_store_explicit(&e->ns, ns, memory_order_relaxed);
+    atomic_store_explicit(&e->seq, n + 1, memory_order_release);
+}
+
+void prof_trace_thread(const char *name)
+{
+    pthread_mutex_lock(&trace_threads_lock);
+    if (trace_nthreads < TRACE_MAX_THREADS) {
+        trace_threads[trace_nthreads].tid = current_tid();
+        snprintf(trace_threads[trace_nthreads].name, sizeof(trace_threads[0].name), "%s", name);
+        trace_nthreads++;
+    }
+    pthread_mutex_unlock(&trace_threads_lock);
+}
+
+int prof_trace_write(const char *path)
+{
+    if (!trace_ring) return -1;
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    int pid = (int)getpid();
+    fprintf(f, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    fprintf(f, "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, "
+            "\"args\": {\"name\": \"codein\"}}", pid);
+    pthread_mutex_lock(&trace_threads_lock);
+    for (int i = 0; i < trace_nthreads; ++i)
+        fprintf(f, ",\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, "
+                "\"args\": {\"name\": \"%s\"}}", pid, trace_threads[i].tid, trace_threads[i].name);
+    pthread_mutex_unlock(&trace_threads_lock);
+
+    unsigned long head = atomic_load(&trace_head);
+    unsigned long first = head > trace_mask + 1 ? head - (trace_mask + 1) : 0;
+    for (unsigned long n = first; n < head; ++n) {
+        TraceEvent *e = &trace_ring[n & trace_mask];
+        if (atomic_load_explicit(&e->seq, memory_order_acquire) != n + 1) continue;
+        int id = atomic_load_explicit(&e->id, memory_order_relaxed);
+        int tid = atomic_load_explicit(&e->tid, memory_order_relaxed);
+        uint64_t start = atomic_load_explicit(&e->start, memory_order_relaxed);
+        uint64_t ns = atomic_load_explicit(&e->ns, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        // skip a slot that was reclaimed while we copied it
+        if (atomic_load_explicit(&e->seq, memory_order_relaxed) != n + 1) continue;
+        if (id < 0 || id >= PROF_COUNT) continue;
+        fprintf(f, ",\n  {\"name\": \"%s\", \"ph\": \"X\", \"pid\": %d, \"tid\": %d, "
+                "\"ts\": %.3f, \"dur\": %.3f}", prof_names[id], pid, tid,
+                start > trace_epoch ? (start - trace_epoch) / 1e3 : 0.0, ns / 1e3);
+    }
+    fprintf(f, "\n]}\n");
+    return fclose(f) == 0 ? 0 : -1;
+}
@@ -0,0 +1,76 @@
+/*
+ * Lightweight cost counters for the editing hot paths
+ * - PROF_SCOPE(id) at the top of a function charges its wall time,
+ *   early returns included, to counter `id`
+ * - Costs nothing beyond a flag test unless prof_enabled or prof_tracing
+ *   is set
+ * - With tracing on, every scope is also recorded as an event with its
+ *   thread id in a lock-free ring and can be written as Chrome trace JSON
+ *   (chrome://tracing, ui.perfetto.dev)
+ */
+
+#ifndef CODEIN_PROF_H
+#define CODEIN_PROF_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+enum {
+    PROF_KEY,         // one key, handling through redraw
+    PROF_INSERT_CHAR,
+    PROF_BACKSPACE,
+    PROF_NEWLINE,
+    PROF_DELETE_CHAR,
+    PROF_PUSH_UNDO,
+    PROF_UNDO,
+    PROF_REDO,
+    PROF_SEARCH,
+    PROF_PUBLISH,
+    PROF_DRAW,
+    PROF_TASK,        // one background pool task
+    PROF_COUNT
+};
+
+typedef struct {
+    uint64_t calls;
+    uint64_t total_ns;
+    uint64_t max_ns;
+} ProfCounter;
+
+extern int prof_enabled;
+extern int prof_tracing;
+extern ProfCounter prof_counters[PROF_COUNT];
+
+uint64_t prof_now_ns(void);
+void prof_add(int id, uint64_t ns); // any thread
+void prof_report(FILE *out);
+
+// allocate the event ring (oldest events are overwritten) and start tracing
+int prof_trace_start(size_t events);
+void prof_trace_add(int id, uint64_t start, uint64_t ns);
+void prof_trace_thread(const char *name); // label the calling thread
+int prof_trace_write(const char *path);   // snapshot of the ring; any time
+
+typedef struct {
+    int id;
+    uint64_t start;
+} ProfScope;
+
+static inline ProfScope prof_scope_begin(int id)
+{
+    ProfScope s = { id, (prof_enabled | prof_tracing) ? prof_now_ns() : 0 };
+    return s;
+}
+
+static inline void prof_scope_end(ProfScope *s)
+{
+    if (!s->start) return;
+    uint64_t ns = prof_now_ns() - s->start;
+    if (prof_enabled) prof_add(s->id, ns);
+    if (prof_tracing) prof_trace_add(s->id, s->start, ns);
+}
+
+#define PROF_SCOPE(id) \
+    ProfScope prof_scope_ __attribute__((cleanup(prof_scope_end))) = prof_scope_begin(id)
+
+#endif
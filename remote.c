@@ -0,0 +1,66 @@
+/*
+ * Wire format shared by the server and attached clients
+ */
+
+#include "remote.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+int remote_flush(int fd, RemoteBuf *b)
+{
+    size_t off = 0;
+    while (off < b->len) {
+        // a client that went away must not kill the server with SIGPIPE
+        ssize_t n = send(fd, b->data + off, b->len - off, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break; // the rest waits for POLLOUT
+        if (n <= 0) return -1;
+        off += n;
+    }
+    memmove(b->data, b->data + off, b->len - off);
+    b->len -= off;
+    return 0;
+}
+
+int remote_put(int fd, RemoteBuf *b, uint32_t type, uint32_t a, uint32_t b_,
+               const void *data, uint32_t len)
+{
+    RemoteMsg m = { type, a, b_, len };
+    if (len > REMOTE_MAX_PAYLOAD) return -1;
+    size_t need = sizeof(m) + len;
+    if (b->len + need > sizeof(b->data) && (remote_flush(fd, b) < 0 || b->len + need > sizeof(b->data)))
+        return -1;
+    memcpy(b->data + b->len, &m, sizeof(m));
+    if (len) memcpy(b->data + b->len + sizeof(m), data, len);
+    b->len += sizeof(m) + len;
+    return 0;
+}
+
+int remote_fill(int fd, RemoteBuf *b)
+{
+    if (b->pos > 0) {
+        memmove(b->data, b->data + b->pos, b->len - b->pos);
+        b->len -= b->pos;
+        b->pos = 0;
+    }
+    ssize_t n;
+    do n = read(fd, b->data + b->len, sizeof(b->data) - b->len);
+    while (n < 0 && errno == EINTR);
+    if (n > 0) b->len += n;
+    return (int)n;
+}
+
+int remote_next(RemoteBuf *b, RemoteMsg *m, const char **payload)
+{
+    size_t avail = b->len - b->pos;
+    if (avail < sizeof(*m)) return 0;
+    memcpy(m, b->data + b->pos, sizeof(*m));
+    if (m->len > REMOTE_MAX_PAYLOAD) return -1;
+    if (avail < sizeof(*m) + m->len) return 0;
+    *payload = (const char *)b->data + b->pos + sizeof(*m);
+    b->pos += sizeof(*m) + m->len;
+    return 1;
+}
@@ -0,0 +1,62 @@
+/*
+ * Client/server mode: one process owns the buffer, terminals attach to it
+ * - `codein --server SOCK [file]` loads the file once and listens on a
+ *   Unix domain socket; `codein --attach SOCK` is a thin ncurses client
+ * - Each client has its own cursor and viewport; the server renders every
+ *   client's screen and sends only the rows that changed
+ * - Messages are a RemoteMsg header followed by `len` payload bytes, in
+ *   host byte order since both ends run on the same machine
+ */
+
+#ifndef CODEIN_REMOTE_H
+#define CODEIN_REMOTE_H
+
+#include "codein.h"
+
+#include <stdint.h>
+
+#define REMOTE_MAX_PAYLOAD 4096
+#define REMOTE_BUF 65536
+
+enum {
+    // client to server
+    MSG_HELLO,      // a = rows, b = cols
+    MSG_RESIZE,     // a = rows, b = cols
+    MSG_KEY,        // a = curses key code
+    MSG_SEARCH,     // payload: query
+    // server to client
+    MSG_ROW,        // a = screen row, b = REMOTE_ATTR_*, payload: text
+    MSG_CURSOR,     // a = row, b = column
+    MSG_FLUSH,      // end of an update: show it
+    MSG_BELL,
+    MSG_BYE,        // payload: reason
+};
+
+enum { REMOTE_ATTR_NORMAL, REMOTE_ATTR_BOLD, REMOTE_ATTR_REVERSE };
+
+typedef struct {
+    uint32_t type, a, b, len;
+} RemoteMsg;
+
+// buffered messages in either direction
+typedef struct {
+    unsigned char data[REMOTE_BUF];
+    size_t len, pos;
+} RemoteBuf;
+
+// append a message; flushes to fd first if it does not fit, and fails if
+// it still does not (a non-blocking peer that stopped reading)
+int remote_put(int fd, RemoteBuf *b, uint32_t type, uint32_t a, uint32_t b_,
+               const void *data, uint32_t len);
+// send what fd takes; on a non-blocking fd the rest stays in b
+int remote_flush(int fd, RemoteBuf *b);
+// read what is available: bytes read, 0 at end of stream, -1 on error
+int remote_fill(int fd, RemoteBuf *b);
+// take the next complete message: 1 if one was taken, 0 if more input is
+// needed, -1 on a malformed stream; payload points into the buffer
+int remote_next(RemoteBuf *b, RemoteMsg *m, const char **payload);
+
+int run_server(Codein *ed, const char *sock_path);
+int run_client(const char *sock_path);
+
+#endif
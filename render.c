@@ -0,0 +1,168 @@
+/*
+ * Screen rendering for the ncurses front end
+ */
+
+#define _GNU_SOURCE
+#include "render.h"
+#include "encoding.h"
+#include "prof.h"
+
+#include <ncurses.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+void format_status(Codein *ed, const char *hint, char *buf, size_t size)
+{
+    // the file format is shown only when it is not plain UTF-8 with LF
+    const CodeinFormat *f = codein_format(ed);
+    const char *name = codein_filename(ed);
+    char enc[48] = "";
+    int noeol = !f->final_newline && (codein_num_lines(ed) > 1 || codein_line(ed, 0)[0]);
+    int y, x;
+    codein_cursor(ed, &y, &x);
+    if (f->encoding != ENC_UTF8 || f->bom || f->crlf || noeol)
+        snprintf(enc, sizeof(enc), " [%s%s%s%s]", enc_name(f->encoding), f->bom ? " BOM" : "",
+                 f->crlf ? " CRLF" : "", noeol ? " noeol" : "");
+    if (name[0])
+        snprintf(buf, size, "File: %s%s%s  Ln %d Col %d  %s", name, enc,
+                 codein_modified(ed) ? " [+]" : "", y+1, x+1, hint);
+    else
+        snprintf(buf, size, "[No Name]%s  Ln %d Col %d  %s",
+                 codein_modified(ed) ? " [+]" : "", y+1, x+1, hint);
+}
+
+// screen cells from byte column `left` to byte x (negative if x < left)
+static int cells(const char *s, int left, int x)
+{
+    int from = left < x ? left : x, to = left < x ? x : left, n = 0;
+    mbstate_t st;
+    memset(&st, 0, sizeof(st));
+    for (int i = from; i < to;) {
+        wchar_t wc;
+        size_t len = mbrtowc(&wc, s + i, to - i, &st);
+        if (len == 0 || len > (size_t)(to - i)) {
+            // a stray byte takes a cell
+            memset(&st, 0, sizeof(st));
+            len = 1;
+            wc = 0;
+        }
+        int w = wc ? wcwidth(wc) : 1;
+        n += w > 0 ? w : 0;
+        i += len;
+    }
+    return x < left ? -n : n;
+}
+
+// bytes of s that fit in `width` screen cells, whole characters only
+static int fit_cells(const char *s, int width)
+{
+    int i = 0, n = 0;
+    mbstate_t st;
+    memset(&st, 0, sizeof(st));
+    while (s[i]) {
+        wchar_t wc;
+        size_t len = mbrtowc(&wc, s + i, MB_CUR_MAX, &st);
+        if (len == 0 || len == (size_t)-1 || len == (size_t)-2) {
+            memset(&st, 0, sizeof(st));
+            len = 1;
+            wc = 0;
+        }
+        int w = wc ? wcwidth(wc) : 1;
+        if (w < 0) w = 0;
+        if (n + w > width) break;
+        n += w;
+        i += len;
+    }
+    return i;
+}
+
+// restyle the visible part of each mark; an empty span marks one cell.
+// `left` is the horizontal scroll in screen cells.
+static void draw_marks(Codein *ed, const RenderMark *marks, int nmarks, int visible, int left, int cols)
+{
+    int top = codein_top_line(ed), n = codein_num_lines(ed), cur_y;
+    codein_cursor(ed, &cur_y, NULL);
+    for (int m = 0; m < nmarks; ++m) {
+        const RenderMark *k = &marks[m];
+        int from = k->y0 > top ? k->y0 : top;
+        int to = k->y1 < top + visible - 1 ? k->y1 : top + visible - 1;
+        for (int y = from; y <= to && y < n; ++y) {
+            const char *s = codein_line(ed, y);
+            int len = strlen(s);
+            int x0 = y == k->y0 ? k->x0 : 0, x1 = y == k->y1 ? k->x1 : len;
+            if (x0 > len) x0 = len;
+            if (x1 > len) x1 = len;
+            // byte columns to screen cells
+            x1 = (x1 > x0 ? cells(s, 0, x1) : cells(s, 0, x0) + 1) - left;
+            x0 = cells(s, 0, x0) - left;
+            if (x0 < 0) x0 = 0;
+            if (x1 > cols) x1 = cols;
+            if (x0 >= x1) continue;
+            int attr = k->attr | (y == cur_y ? A_BOLD : 0);
+            mvchgat(y - top, x0, x1 - x0, attr, 0, NULL);
+        }
+    }
+}
+
+void draw_screen(Codein *ed, const char *hint)
+{
+    draw_screen_marked(ed, hint, NULL, 0);
+}
+
+void draw_screen_marked(Codein *ed, const char *hint, const RenderMark *marks, int nmarks)
+{
+    PROF_SCOPE(PROF_DRAW);
+    int rows, cols;
+    getmaxyx(stdscr, rows, cols);
+    int visible = rows - 1; // reserve last line for status
+    // scroll first so the frame shows the cursor's line
+    codein_scroll_to_cursor(ed, visible);
+    int top = codein_top_line(ed), n_lines = codein_num_lines(ed), cur_y, cur_x;
+    codein_cursor(ed, &cur_y, &cur_x);
+    // past the right edge, shift every line to keep the cursor in view;
+    // counted in cells, as a multibyte character takes one or two
+    int cur_cell = cells(codein_line(ed, cur_y), 0, cur_x);
+    int left = cur_cell < cols ? 0 : cur_cell - cols / 2;
+    erase();
+    for (int i = 0; i < visible; ++i) {
+        int idx = top + i;
+        if (idx >= n_lines) break;
+        // highlight current line with underline
+        if (idx == cur_y) {
+            attron(A_BOLD);
+        }
+        // only draw up to screen width
+        const char *s = codein_line(ed, idx);
+        int from = left ? fit_cells(s, left) : 0;
+        if (s[from]) {
+            int n = fit_cells(s + from, cols);
+            // a CR kept in a file with mixed line endings shows as ^M
+            if (n > 0 && !s[from + n] && s[from + n - 1] == '\r' && cells(s + from, 0, n) < cols) {
+                mvaddnstr(i, 0, s + from, n - 1);
+                addstr("^M");
+            } else {
+                mvaddnstr(i, 0, s + from, n);
+            }
+        }
+        if (idx == cur_y) {
+            attroff(A_BOLD);
+        }
+    }
+    draw_marks(ed, marks, nmarks, visible, left, cols);
+    // status (truncate if necessary)
+    move(rows - 1, 0);
+    clrtoeol();
+    char status[4096];
+    format_status(ed, hint, status, sizeof(status));
+    attron(A_REVERSE);
+    mvaddnstr(rows - 1, 0, status, cols);
+    attroff(A_REVERSE);
+
+    int disp_y = cur_y - top;
+    int disp_x = cur_cell - left;
+    if (disp_x >= cols) disp_x = cols - 1;
+    move(disp_y, disp_x);
+    refresh();
+}
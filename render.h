@@ -0,0 +1,23 @@
+/*
+ * Screen rendering for the ncurses front end
+ * - Repaints the visible lines and the status line on stdscr
+ * - Kept apart from main.c so benchmarks can time it on a null terminal
+ */
+
+#ifndef CODEIN_RENDER_H
+#define CODEIN_RENDER_H
+
+#include "codein.h"
+
+// a span of the buffer drawn with extra attributes, in byte columns
+typedef struct {
+    int y0, x0, y1, x1;
+    int attr;
+} RenderMark;
+
+void draw_screen(Codein *ed, const char *hint); // hint: right-hand part of the status line
+void draw_screen_marked(Codein *ed, const char *hint, const RenderMark *marks, int nmarks);
+// the status line text, also used for attached clients
+void format_status(Codein *ed, const char *hint, char *buf, size_t size);
+
+#endif
@@ -0,0 +1,132 @@
+/*
+ * Headless command scripts
+ *
+ * One command per line, `#` starts a comment:
+ *   goto LINE [COL]     move the cursor (1-based)
+ *   search TEXT         move to the next occurrence of TEXT
+ *   replace /FROM/TO/   replace every occurrence; any delimiter works
+ *   insert TEXT         type TEXT at the cursor (\n, \t and \\ escapes)
+ *   newline [N]         split the line at the cursor
+ *   backspace [N]       delete before the cursor
+ *   delete [N]          delete at the cursor
+ *   undo [N], redo [N]
+ *   save [PATH]         write the buffer (default: the loaded file)
+ *   print               write the buffer to stdout
+ * Each command is one undo step. The first failing command stops the
+ * script with a non-zero exit status.
+ */
+
+#include "script.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+static int count_arg(const char *arg)
+{
+    int n = arg[0] ? atoi(arg) : 1;
+    return n > 0 ? n : 1;
+}
+
+static void insert_text(Codein *ed, const char *s)
+{
+    for (; *s; ++s) {
+        int c = (unsigned char)*s;
+        if (c == '\\' && s[1]) {
+            ++s;
+            if (*s == 'n') {
+                codein_newline(ed);
+                continue;
+            }
+            c = *s == 't' ? '\t' : (unsigned char)*s;
+        }
+        codein_insert_char(ed, c);
+    }
+}
+
+// parse /from/to/ into the two strings, in place; returns -1 if malformed
+static int split_replace(char *arg, char **from, char **to)
+{
+    char delim = arg[0];
+    if (!delim) return -1;
+    char *mid = strchr(arg + 1, delim);
+    if (!mid) return -1;
+    char *end = strchr(mid + 1, delim);
+    if (end) *end = '\0';
+    *mid = '\0';
+    *from = arg + 1;
+    *to = mid + 1;
+    return 0;
+}
+
+// returns NULL on success or an error message
+static const char *run_command(Codein *ed, char *cmd, char *arg)
+{
+    if (strcmp(cmd, "goto") == 0) {
+        int y, x = 1;
+        if (sscanf(arg, "%d %d", &y, &x) < 1) return "usage: goto LINE [COL]";
+        codein_goto(ed, y - 1, x - 1);
+    } else if (strcmp(cmd, "search") == 0) {
+        if (!arg[0]) return "usage: search TEXT";
+        if (!codein_search(ed, arg)) return "not found";
+    } else if (strcmp(cmd, "replace") == 0) {
+        char *from, *to;
+        if (split_replace(arg, &from, &to) < 0 || !from[0]) return "usage: replace /FROM/TO/";
+        codein_replace_all(ed, from, to);
+    } else if (strcmp(cmd, "insert") == 0) {
+        insert_text(ed, arg);
+    } else if (strcmp(cmd, "newline") == 0) {
+        for (int n = count_arg(arg); n > 0; --n) codein_newline(ed);
+    } else if (strcmp(cmd, "backspace") == 0) {
+        for (int n = count_arg(arg); n > 0; --n) codein_backspace(ed);
+    } else if (strcmp(cmd, "delete") == 0) {
+        for (int n = count_arg(arg); n > 0; --n) codein_delete_char(ed);
+    } else if (strcmp(cmd, "undo") == 0) {
+        for (int n = count_arg(arg); n > 0; --n) codein_undo(ed);
+    } else if (strcmp(cmd, "redo") == 0) {
+        for (int n = count_arg(arg); n > 0; --n) codein_redo(ed);
+    } else if (strcmp(cmd, "save") == 0) {
+        if (arg[0] == '\0' && codein_filename(ed)[0] == '\0') return "no file name";
+        if (codein_save(ed, arg[0] ? arg : NULL) < 0) return "save failed";
+    } else if (strcmp(cmd, "print") == 0) {
+        for (int i = 0, n = codein_num_lines(ed); i < n; ++i) printf("%s\n", codein_line(ed, i));
+    } else {
+        return "unknown command";
+    }
+    return NULL;
+}
+
+int run_script(Codein *ed, const char *path)
+{
+    FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+    char *buf = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    int lineno = 0, status = 0;
+    while ((len = getline(&buf, &cap, f)) != -1) {
+        lineno++;
+        while (len > 0 && (buf[len-1] == '\n' || buf[len-1] == '\r')) buf[--len] = '\0';
+        char *cmd = buf;
+        while (*cmd == ' ' || *cmd == '\t') cmd++;
+        if (*cmd == '\0' || *cmd == '#') continue;
+        char *arg = cmd + strcspn(cmd, " \t");
+        if (*arg) *arg++ = '\0';
+        // a single separator: the rest of the line is the argument verbatim
+        codein_begin_batch(ed);
+        const char *err = run_command(ed, cmd, arg);
+        codein_end_batch(ed);
+        if (err) {
+            fprintf(stderr, "codein: %s:%d: %s: %s\n", path, lineno, cmd, err);
+            status = 1;
+            break;
+        }
+    }
+    free(buf);
+    if (f != stdin) fclose(f);
+    return status;
+}
@@ -0,0 +1,14 @@
+/*
+ * Headless command scripts
+ * - `codein --script cmds.txt [filename]` runs editing commands on the
+ *   buffer without a terminal, for bulk edits and reproducible benchmarks
+ */
+
+#ifndef CODEIN_SCRIPT_H
+#define CODEIN_SCRIPT_H
+
+#include "codein.h"
+
+int run_script(Codein *ed, const char *path); // returns the process exit status
+
+#endif
@@ -0,0 +1,367 @@
+/*
+ * Buffer server: one loaded file shared by every attached terminal
+ *
+ * The server is single-threaded. Each client's cursor and viewport are
+ * swapped into the context while its keys are applied, so the core needs
+ * no changes; after a batch of input every client's screen is rendered
+ * into a row cache and only rows that differ are sent. Client sockets do
+ * not block: a client that stops reading keeps its unsent output and gets
+ * no further updates until it drains, so it cannot stall the others.
+ */
+
+#define _GNU_SOURCE
+#include "remote.h"
+#include "render.h"
+
+#include <errno.h>
+#include <ncurses.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define MAX_CLIENTS 64
+
+typedef struct {
+    int fd;
+    int rows, cols;             // terminal size; 0 until the client says hello
+    int cur_x, cur_y, top_line;
+    char msg[128];              // status message for this client only
+    int bell;
+    // what the client's terminal shows: rows * cols text, length and attribute per row
+    char *screen;
+    int *row_len;               // -1: unknown, repaint
+    unsigned char *row_attr;
+    int shown_y, shown_x;       // cursor position last sent
+    RemoteBuf in, out;
+} Client;
+
+static Client *clients[MAX_CLIENTS];
+static int nclients = 0;
+static Client *acting = NULL; // client whose key is being applied
+static int export_fd = -1;    // latest shared-memory export
+
+static void server_bell(void *arg)
+{
+    (void)arg;
+    if (acting) acting->bell = 1;
+}
+
+static void client_msg(Client *c, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(c->msg, sizeof(c->msg), fmt, ap);
+    va_end(ap);
+}
+
+// swap a client's view into the context and back
+static void use_view(Codein *ed, Client *c)
+{
+    codein_goto(ed, c->cur_y, c->cur_x);
+    codein_set_top_line(ed, c->top_line);
+    codein_set_view(ed, c->rows - 1, c->cols); // last row is the status line
+}
+
+static void keep_view(Codein *ed, Client *c)
+{
+    codein_scroll_to_cursor(ed, c->rows - 1);
+    codein_cursor(ed, &c->cur_y, &c->cur_x);
+    c->top_line = codein_top_line(ed);
+}
+
+static int resize_client(Client *c, int rows, int cols)
+{
+    if (rows < 2 || cols < 1 || cols > REMOTE_MAX_PAYLOAD || rows > 4096) return -1;
+    char *screen = realloc(c->screen, (size_t)rows * cols);
+    int *row_len = realloc(c->row_len, sizeof(int) * rows);
+    unsigned char *row_attr = realloc(c->row_attr, rows);
+    if (screen) c->screen = screen;
+    if (row_len) c->row_len = row_len;
+    if (row_attr) c->row_attr = row_attr;
+    if (!screen || !row_len || !row_attr) return -1;
+    c->rows = rows;
+    c->cols = cols;
+    for (int r = 0; r < rows; ++r) c->row_len[r] = -1;
+    c->shown_y = c->shown_x = -1;
+    return 0;
+}
+
+// send the rows that changed since the last update, then the cursor
+static int update_client(Codein *ed, Client *c)
+{
+    // while the last update is still going out, changes add up in the row cache
+    if (!c->rows || c->out.len) return 0;
+    use_view(ed, c);
+    keep_view(ed, c);
+    int text_rows = c->rows - 1, sent = 0;
+    char hint[64], status[4096];
+    snprintf(hint, sizeof(hint), "%d attached  Ctrl-Q detach", nclients);
+    format_status(ed, c->msg[0] ? c->msg : hint, status, sizeof(status));
+    for (int r = 0; r < c->rows; ++r) {
+        const char *s = "";
+        int attr = REMOTE_ATTR_NORMAL, idx = c->top_line + r;
+        if (r == text_rows) {
+            s = status;
+            attr = REMOTE_ATTR_REVERSE;
+        } else if (idx < codein_num_lines(ed)) {
+            s = codein_line(ed, idx);
+            if (idx == c->cur_y) attr = REMOTE_ATTR_BOLD;
+        }
+        int n = strnlen(s, c->cols);
+        char *row = c->screen + (size_t)r * c->cols;
+        if (c->row_len[r] == n && c->row_attr[r] == attr && memcmp(row, s, n) == 0) continue;
+        memcpy(row, s, n);
+        c->row_len[r] = n;
+        c->row_attr[r] = attr;
+        if (remote_put(c->fd, &c->out, MSG_ROW, r, attr, s, n) < 0) return -1;
+        sent++;
+    }
+    int y = c->cur_y - c->top_line, x = c->cur_x < c->cols ? c->cur_x : c->cols - 1;
+    if (sent || y != c->shown_y || x != c->shown_x) {
+        c->shown_y = y;
+        c->shown_x = x;
+        if (remote_put(c->fd, &c->out, MSG_CURSOR, y, x, NULL, 0) < 0) return -1;
+        if (remote_put(c->fd, &c->out, MSG_FLUSH, 0, 0, NULL, 0) < 0) return -1;
+    }
+    if (c->bell) {
+        c->bell = 0;
+        if (remote_put(c->fd, &c->out, MSG_BELL, 0, 0, NULL, 0) < 0) return -1;
+    }
+    return remote_flush(c->fd, &c->out);
+}
+
+static void save_buffer(Codein *ed, Client *c)
+{
+    const char *name = codein_filename(ed);
+    if (!name[0]) client_msg(c, "No file name: start the server with one");
+    else if (codein_save(ed, NULL) < 0) client_msg(c, "Cannot save %s: %s", name, strerror(errno));
+    else client_msg(c, "Saved %s", name);
+}
+
+static void export_buffer(Codein *ed, Client *c)
+{
+    codein_publish(ed);
+    CodeinSnapshot *s = codein_snapshot_acquire(ed);
+    int fd = s ? codein_snapshot_export(s, "codein") : -1;
+    if (fd >= 0) {
+        if (export_fd >= 0) close(export_fd);
+        export_fd = fd;
+        client_msg(c, "Exported %d lines: /proc/%d/fd/%d", codein_snapshot_num_lines(s),
+                   (int)getpid(), fd);
+    } else {
+        client_msg(c, "Export failed");
+    }
+    codein_snapshot_release(s);
+}
+
+static void apply_key(Codein *ed, Client *c, int ch)
+{
+    if (ch == 19) { // Ctrl-S
+        save_buffer(ed, c);
+    } else if (ch == 24) { // Ctrl-X
+        export_buffer(ed, c);
+    } else if (ch == KEY_UP) {
+        codein_move_up(ed);
+    } else if (ch == KEY_DOWN) {
+        codein_move_down(ed);
+    } else if (ch == KEY_PPAGE) {
+        codein_page_up(ed);
+    } else if (ch == KEY_NPAGE) {
+        codein_page_down(ed);
+    } else if (ch == KEY_LEFT) {
+        codein_move_left(ed);
+    } else if (ch == KEY_RIGHT) {
+        codein_move_right(ed);
+    } else if (ch == KEY_BACKSPACE || ch == 127) {
+        codein_backspace(ed);
+    } else if (ch == 21) { // Ctrl-U (undo)
+        codein_undo(ed);
+    } else if (ch == 26) { // Ctrl-Z (redo)
+        codein_redo(ed);
+    } else if (ch == 14) { // Ctrl-N (search again)
+        codein_search(ed, NULL);
+    } else if (ch == '\n' || ch == KEY_ENTER) {
+        codein_newline(ed);
+    } else if (ch >= 32 && ch < 127) {
+        codein_insert_char(ed, ch);
+    }
+}
+
+// apply one request from a client; -1 drops the client
+static int handle_msg(Codein *ed, Client *c, const RemoteMsg *m, const char *payload)
+{
+    if (m->type == MSG_HELLO || m->type == MSG_RESIZE)
+        return resize_client(c, m->a, m->b);
+    if (!c->rows) return -1; // nothing before hello
+    if (m->type != MSG_KEY && m->type != MSG_SEARCH) return 0;
+
+    c->msg[0] = '\0';
+    use_view(ed, c);
+    int lines_before = codein_num_lines(ed), y, x;
+    codein_cursor(ed, &y, &x);
+    acting = c;
+    if (m->type == MSG_KEY) {
+        apply_key(ed, c, (int)m->a);
+    } else {
+        char query[CODEIN_MAX_SEARCH];
+        int n = m->len < sizeof(query) - 1 ? m->len : sizeof(query) - 1;
+        memcpy(query, payload, n);
+        query[n] = '\0';
+        if (query[0] && !codein_search(ed, query)) client_msg(c, "Not found: %s", query);
+    }
+    acting = NULL;
+    keep_view(ed, c);
+
+    // keep other clients on their text when lines come or go above them;
+    // a deletion also moves line y itself (a backspace joins it to y - 1)
+    int n = codein_num_lines(ed), delta = n - lines_before, from = delta < 0 ? y : y + 1;
+    if (delta == 0) return 0;
+    int cur_y, cur_x;
+    codein_cursor(ed, &cur_y, &cur_x);
+    for (int i = 0; i < nclients; ++i) {
+        Client *o = clients[i];
+        if (o == c) continue;
+        if (delta == -1 && o->cur_y == y && cur_y == y - 1) o->cur_x += cur_x; // after the joined text
+        if (o->cur_y >= from) o->cur_y += delta;
+        if (o->top_line >= from) o->top_line += delta;
+        if (o->cur_y > n - 1) o->cur_y = n - 1;
+        if (o->cur_y < 0) o->cur_y = 0;
+        if (o->top_line > o->cur_y) o->top_line = o->cur_y;
+        if (o->top_line < 0) o->top_line = 0;
+        int len = strlen(codein_line(ed, o->cur_y));
+        if (o->cur_x > len) o->cur_x = len;
+    }
+    return 0;
+}
+
+static void drop_client(int i)
+{
+    Client *c = clients[i];
+    close(c->fd);
+    free(c->screen);
+    free(c->row_len);
+    free(c->row_attr);
+    free(c);
+    clients[i] = clients[--nclients];
+}
+
+static void accept_client(int listen_fd)
+{
+    int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (fd < 0) return;
+    Client *c = nclients < MAX_CLIENTS ? calloc(1, sizeof(*c)) : NULL;
+    if (!c) {
+        RemoteBuf *b = malloc(sizeof(*b));
+        if (b) {
+            b->len = 0;
+            remote_put(fd, b, MSG_BYE, 0, 0, "server full", 11);
+            remote_flush(fd, b);
+            free(b);
+        }
+        close(fd);
+        return;
+    }
+    c->fd = fd;
+    clients[nclients++] = c;
+}
+
+static int listen_on(const char *sock_path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(sock_path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, sock_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    // a socket left by a server that died is replaced; a live one is not
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        close(fd);
+        errno = EADDRINUSE;
+        return -1;
+    }
+    unlink(sock_path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int run_server(Codein *ed, const char *sock_path)
+{
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGHUP);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0) return -1;
+    int sig_fd = signalfd(-1, &mask, SFD_CLOEXEC);
+    int listen_fd = listen_on(sock_path);
+    if (sig_fd < 0 || listen_fd < 0) {
+        perror(sock_path);
+        return 1;
+    }
+    codein_set_bell(ed, server_bell, NULL);
+    fprintf(stderr, "codein: serving %s (%d lines) on %s\n",
+            codein_filename(ed)[0] ? codein_filename(ed) : "[No Name]",
+            codein_num_lines(ed), sock_path);
+
+    struct pollfd fds[MAX_CLIENTS + 2];
+    for (;;) {
+        fds[0] = (struct pollfd){ listen_fd, POLLIN, 0 };
+        fds[1] = (struct pollfd){ sig_fd, POLLIN, 0 };
+        int n = nclients;
+        for (int i = 0; i < n; ++i)
+            fds[i + 2] = (struct pollfd){ clients[i]->fd, POLLIN | (clients[i]->out.len ? POLLOUT : 0), 0 };
+        if (poll(fds, n + 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[1].revents & POLLIN) break;
+
+        // walk down so dropping a client does not skip the next one
+        for (int i = n - 1; i >= 0; --i) {
+            Client *c = clients[i];
+            short ev = fds[i + 2].revents;
+            int ok = !(ev & POLLOUT) || remote_flush(c->fd, &c->out) == 0;
+            if (ok && (ev & (POLLIN | POLLHUP | POLLERR))) {
+                int got = remote_fill(c->fd, &c->in);
+                RemoteMsg m;
+                const char *payload;
+                int r;
+                ok = got > 0 || (got < 0 && errno == EAGAIN);
+                while (ok && (r = remote_next(&c->in, &m, &payload)) != 0)
+                    ok = r > 0 && handle_msg(ed, c, &m, payload) == 0;
+            }
+            if (!ok) drop_client(i);
+        }
+        if (fds[0].revents & POLLIN) accept_client(listen_fd);
+
+        codein_publish(ed);
+        for (int i = nclients - 1; i >= 0; --i) {
+            if (update_client(ed, clients[i]) < 0) drop_client(i);
+        }
+    }
+
+    for (int i = nclients - 1; i >= 0; --i) {
+        Client *c = clients[i];
+        c->out.len = 0;
+        remote_put(c->fd, &c->out, MSG_BYE, 0, 0, "server stopped", 14);
+        remote_flush(c->fd, &c->out);
+        drop_client(i);
+    }
+    if (export_fd >= 0) close(export_fd);
+    close(listen_fd);
+    close(sig_fd);
+    unlink(sock_path);
+    return 0;
+}
@@ -0,0 +1,301 @@
+/*
+ * Columnar view for CSV/TSV files
+ *
+ * Width analysis splits the snapshot into chunks, one pool task each.
+ * A task measures an evenly spaced sample of its chunk and folds the
+ * result into the shared widths with an atomic max, so the first chunks
+ * to finish already improve the view. Quoted fields may contain the
+ * delimiter; a quoted newline is not joined, the line shows as is.
+ */
+
+#include "table.h"
+#include "render.h"
+
+#include <ncurses.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define SAMPLE_LINES 512      // lines measured per chunk
+#define CHUNKS_PER_THREAD 4
+#define SYNC_LINES 256        // measured before the first frame
+#define COL_SEP " | "
+#define COL_SEP_LEN 3
+
+typedef struct {
+    Table *t;
+    CodeinSnapshot *snap;
+    CancelToken *tok;
+    void (*notify)(void);
+    atomic_int pending;       // chunks still running
+} TableJob;
+
+typedef struct {
+    TableJob *job;
+    int first, last;
+} TableChunk;
+
+static const char *field_end(const char *s, char delim)
+{
+    int quoted = 0;
+    for (; *s; ++s) {
+        if (*s == '"') quoted = !quoted; // "" inside quotes toggles twice
+        else if (*s == delim && !quoted) break;
+    }
+    return s;
+}
+
+// widths of the fields of one line, folded into w; returns the field count
+static int measure_line(const char *s, char delim, int *w)
+{
+    int col = 0;
+    for (;;) {
+        const char *e = field_end(s, delim);
+        int len = e - s, c = col < TABLE_MAX_COLS ? col : TABLE_MAX_COLS - 1;
+        if (len > TABLE_MAX_WIDTH) len = TABLE_MAX_WIDTH;
+        if (len > w[c]) w[c] = len;
+        col++;
+        if (!*e) return col;
+        s = e + 1;
+    }
+}
+
+static void merge_widths(Table *t, const int *w, int ncols)
+{
+    for (int c = 0; c < ncols && c < TABLE_MAX_COLS; ++c) {
+        int cur = __atomic_load_n(&t->width[c], __ATOMIC_RELAXED);
+        while (w[c] > cur && !__atomic_compare_exchange_n(&t->width[c], &cur, w[c], 1,
+                                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            ;
+    }
+    int cur = __atomic_load_n(&t->ncols, __ATOMIC_RELAXED);
+    if (ncols > TABLE_MAX_COLS) ncols = TABLE_MAX_COLS;
+    while (ncols > cur && !__atomic_compare_exchange_n(&t->ncols, &cur, ncols, 1,
+                                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+static int col_width(Table *t, int c)
+{
+    int w = __atomic_load_n(&t->width[c < TABLE_MAX_COLS ? c : TABLE_MAX_COLS - 1], __ATOMIC_RELAXED);
+    return w > 0 ? w : 1;
+}
+
+char table_detect(Codein *ed, int by_name_only)
+{
+    const char *name = codein_filename(ed), *dot = strrchr(name, '.');
+    if (dot && strcasecmp(dot, ".csv") == 0) return ',';
+    if (dot && (strcasecmp(dot, ".tsv") == 0 || strcasecmp(dot, ".tab") == 0)) return '\t';
+    if (by_name_only) return 0;
+    // the delimiter that splits the first lines into the same number of fields
+    static const char candidates[] = { '\t', ',', ';', '|' };
+    int n = codein_num_lines(ed) < 20 ? codein_num_lines(ed) : 20;
+    if (n > 1 && !codein_line(ed, n - 1)[0]) n--; // empty line after the final newline
+    if (n < 2) return 0;
+    for (int i = 0; i < (int)sizeof(candidates); ++i) {
+        int w[TABLE_MAX_COLS] = {0}, fields = measure_line(codein_line(ed, 0), candidates[i], w), y;
+        for (y = 1; y < n && fields >= 2; ++y)
+            if (measure_line(codein_line(ed, y), candidates[i], w) != fields) break;
+        if (fields >= 2 && y == n) return candidates[i];
+    }
+    return 0;
+}
+
+void table_init(Table *t, char delim)
+{
+    table_stop(t);
+    memset(t, 0, sizeof(*t));
+    t->delim = delim;
+}
+
+static void finish_chunk(TableJob *job)
+{
+    if (atomic_fetch_sub(&job->pending, 1) != 1) return;
+    codein_snapshot_release(job->snap);
+    cancel_token_unref(job->tok);
+    free(job);
+}
+
+static void sample_task(void *arg, CancelToken *tok)
+{
+    TableChunk *ch = arg;
+    TableJob *job = ch->job;
+    if (!task_cancelled(tok)) {
+        int w[TABLE_MAX_COLS] = {0}, ncols = 0;
+        int n = ch->last - ch->first;
+        int step = n > SAMPLE_LINES ? n / SAMPLE_LINES : 1;
+        for (int y = ch->first; y < ch->last; y += step) {
+            int f = measure_line(codein_snapshot_line(job->snap, y), job->t->delim, w);
+            if (f > ncols) ncols = f;
+        }
+        if (!task_cancelled(tok)) {
+            merge_widths(job->t, w, ncols);
+            if (job->notify) job->notify();
+        }
+    }
+    free(ch);
+    finish_chunk(job);
+}
+
+void table_analyze(Table *t, Codein *ed, void (*notify)(void))
+{
+    table_stop(t);
+    // the rows near the top are measured now so the first frame is aligned
+    int w[TABLE_MAX_COLS] = {0}, ncols = 0;
+    for (int y = 0; y < codein_num_lines(ed) && y < SYNC_LINES; ++y) {
+        int f = measure_line(codein_line(ed, y), t->delim, w);
+        if (f > ncols) ncols = f;
+    }
+    merge_widths(t, w, ncols);
+    if (codein_num_lines(ed) <= SYNC_LINES) return;
+
+    TableJob *job = calloc(1, sizeof(*job));
+    if (!job) return;
+    codein_publish(ed);
+    job->t = t;
+    job->snap = codein_snapshot_acquire(ed);
+    job->notify = notify;
+    t->tok = cancel_token_new();
+    job->tok = cancel_token_ref(t->tok);
+    int n = codein_snapshot_num_lines(job->snap);
+    int nchunks = pool_size() * CHUNKS_PER_THREAD;
+    if (nchunks < 1) nchunks = 1;
+    atomic_init(&job->pending, nchunks + 1); // held until every chunk is queued
+    for (int i = 0; i < nchunks; ++i) {
+        TableChunk *ch = malloc(sizeof(*ch));
+        if (!ch) {
+            finish_chunk(job);
+            continue;
+        }
+        ch->job = job;
+        ch->first = (long long)n * i / nchunks;
+        ch->last = (long long)n * (i + 1) / nchunks;
+        if (pool_submit(POOL_BULK, job->tok, sample_task, ch) < 0) {
+            free(ch);
+            finish_chunk(job);
+        }
+    }
+    finish_chunk(job);
+}
+
+void table_stop(Table *t)
+{
+    if (!t->tok) return;
+    cancel_token_cancel(t->tok);
+    cancel_token_unref(t->tok);
+    t->tok = NULL;
+}
+
+// field index and byte offset within it for column x of a line
+static int field_at(Table *t, const char *s, int x, int *off)
+{
+    int col = 0;
+    const char *p = s;
+    for (;;) {
+        const char *e = field_end(p, t->delim);
+        if (x <= e - s || !*e) {
+            *off = x - (p - s);
+            return col;
+        }
+        col++;
+        p = e + 1;
+    }
+}
+
+// keep the cursor's column on screen, scrolling a whole column at a time
+static void scroll_columns(Table *t, int cur_col, int cols)
+{
+    if (cur_col < t->first_col) t->first_col = cur_col;
+    for (;;) {
+        int used = 0;
+        for (int c = t->first_col; c <= cur_col; ++c) used += col_width(t, c) + COL_SEP_LEN;
+        if (used - COL_SEP_LEN <= cols || t->first_col == cur_col) break;
+        t->first_col++;
+    }
+}
+
+// draw one line as aligned fields starting at column first_col
+static void draw_row(Table *t, int row, const char *s, int cols)
+{
+    int col = 0, x = 0;
+    for (;;) {
+        const char *e = field_end(s, t->delim);
+        if (col >= t->first_col) {
+            if (x >= cols) break;
+            int w = col_width(t, col), len = e - s;
+            if (len > w) len = w;
+            if (x + len > cols) len = cols - x;
+            mvaddnstr(row, x, s, len);
+            x += w;
+            if (!*e) break;
+            if (x < cols) mvaddnstr(row, x, COL_SEP, cols - x);
+            x += COL_SEP_LEN;
+        }
+        if (!*e) break;
+        s = e + 1;
+        col++;
+    }
+}
+
+void draw_table(Codein *ed, Table *t, const char *hint)
+{
+    int rows, cols;
+    getmaxyx(stdscr, rows, cols);
+    int visible = rows - 2; // header row and status line
+    if (visible < 1) visible = 1;
+    // line 0 is frozen on the first screen row; the rest scroll below it
+    codein_scroll_to_cursor(ed, visible);
+    if (codein_top_line(ed) < 1) codein_set_top_line(ed, 1);
+    int top = codein_top_line(ed) > 1 ? codein_top_line(ed) : 1, n = codein_num_lines(ed), cur_y, cur_x;
+    codein_cursor(ed, &cur_y, &cur_x);
+
+    int off, cur_col = field_at(t, codein_line(ed, cur_y), cur_x, &off);
+    scroll_columns(t, cur_col, cols);
+
+    erase();
+    attron(A_UNDERLINE | (cur_y == 0 ? A_BOLD : 0));
+    draw_row(t, 0, codein_line(ed, 0), cols);
+    attroff(A_UNDERLINE | A_BOLD);
+    for (int i = 0; i < visible; ++i) {
+        int idx = top + i;
+        if (idx >= n) break;
+        if (idx == cur_y) attron(A_BOLD);
+        draw_row(t, i + 1, codein_line(ed, idx), cols);
+        if (idx == cur_y) attroff(A_BOLD);
+    }
+
+    char info[320], status[4096];
+    snprintf(info, sizeof(info), "[col %d/%d] %s", cur_col + 1,
+             __atomic_load_n(&t->ncols, __ATOMIC_RELAXED), hint);
+    format_status(ed, info, status, sizeof(status));
+    attron(A_REVERSE);
+    mvaddnstr(rows - 1, 0, status, cols);
+    attroff(A_REVERSE);
+
+    int x = 0;
+    for (int c = t->first_col; c < cur_col; ++c) x += col_width(t, c) + COL_SEP_LEN;
+    int w = col_width(t, cur_col);
+    x += off < w ? off : w;
+    if (x >= cols) x = cols - 1;
+    move(cur_y == 0 ? 0 : cur_y - top + 1, x);
+    refresh();
+}
+
+void table_next_field(Codein *ed, Table *t, int dir)
+{
+    int y, x;
+    codein_cursor(ed, &y, &x);
+    const char *s = codein_line(ed, y);
+    int off, col = field_at(t, s, x, &off);
+    int target = dir > 0 ? col + 1 : (off > 0 ? col : col - 1);
+    if (target < 0) return;
+    const char *p = s;
+    for (int c = 0; c < target; ++c) {
+        const char *e = field_end(p, t->delim);
+        if (!*e) return; // already in the last field
+        p = e + 1;
+    }
+    codein_goto(ed, y, p - s);
+}
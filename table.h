@@ -0,0 +1,37 @@
+/*
+ * Columnar view for CSV/TSV files
+ * - Fields are aligned into columns under a frozen header row, and the
+ *   view scrolls horizontally a column at a time to follow the cursor
+ * - Column widths come from sampling lines on the pool and only grow as
+ *   results arrive; fields are split only for the rows on screen
+ */
+
+#ifndef CODEIN_TABLE_H
+#define CODEIN_TABLE_H
+
+#include "codein.h"
+#include "pool.h"
+
+#define TABLE_MAX_COLS 256    // columns past this share the last width
+#define TABLE_MAX_WIDTH 40    // longer fields are cut on screen
+
+typedef struct {
+    char delim;
+    int ncols;                // widest row seen so far, capped at TABLE_MAX_COLS
+    int width[TABLE_MAX_COLS]; // updated by sampling tasks, read by the UI
+    int first_col;            // leftmost column on screen
+    CancelToken *tok;         // running analysis
+} Table;
+
+// delimiter for a .csv/.tsv name, else a guess from the first lines; 0 if none
+char table_detect(Codein *ed, int by_name_only);
+void table_init(Table *t, char delim);
+// sample the published snapshot in the background; `notify` runs on a
+// worker thread each time widths may have changed
+void table_analyze(Table *t, Codein *ed, void (*notify)(void));
+void table_stop(Table *t);
+void draw_table(Codein *ed, Table *t, const char *hint);
+// move the cursor to the start of the next (dir > 0) or previous field
+void table_next_field(Codein *ed, Table *t, int dir);
+
+#endif
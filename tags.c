@@ -0,0 +1,378 @@
+/*
+ * Tag files
+ *
+ * The sorted search works on byte offsets: take the middle of the range
+ * left, back up to the start of its line and compare that line's name,
+ * so no table of lines is ever built and a lookup reads about log2(n)
+ * lines. A TAGS file has one section per source file; the sections are
+ * listed when the file is mapped, lookups then find the name with memmem
+ * and its section by binary search.
+ */
+
+#define _GNU_SOURCE
+#include "tags.h"
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// how the file is laid out: !_TAG_FILE_SORTED 0, 1 or 2, or Emacs TAGS
+enum { TAGS_UNSORTED, TAGS_SORTED, TAGS_FOLDED, TAGS_EMACS };
+
+typedef struct {
+    size_t start;               // first entry of the section
+    char *file;
+} Section;
+
+struct Tags {
+    char path[PATH_MAX];
+    char dir[PATH_MAX];         // entries name files relative to it
+    const char *data;           // NULL for an empty file
+    size_t size;
+    struct stat st;             // of the file as mapped
+    int format;
+    Section *sections;          // TAGS only
+    int nsections;
+};
+
+static const char *line_end(const Tags *t, const char *p)
+{
+    const char *nl = memchr(p, '\n', t->data + t->size - p);
+    return nl ? nl : t->data + t->size;
+}
+
+static void unmap(Tags *t)
+{
+    if (t->data) munmap((void *)t->data, t->size);
+    for (int i = 0; i < t->nsections; ++i) free(t->sections[i].file);
+    free(t->sections);
+    t->data = NULL;
+    t->size = 0;
+    t->sections = NULL;
+    t->nsections = 0;
+}
+
+// one section per "\f\n<file>,<size>\n" header
+static int list_sections(Tags *t)
+{
+    int cap = 0;
+    for (const char *p = t->data; p && p < t->data + t->size;) {
+        const char *ff = memmem(p, t->data + t->size - p, "\f\n", 2);
+        if (!ff) break;
+        const char *head = ff + 2, *end = line_end(t, head);
+        const char *comma = memrchr(head, ',', end - head);
+        if (t->nsections == cap) {
+            cap = cap ? cap * 2 : 64;
+            Section *ns = realloc(t->sections, sizeof(Section) * cap);
+            if (!ns) return -1;
+            t->sections = ns;
+        }
+        Section *s = &t->sections[t->nsections];
+        s->file = strndup(head, (comma ? comma : end) - head);
+        if (!s->file) return -1;
+        s->start = end - t->data + 1;
+        t->nsections++;
+        p = end;
+    }
+    return 0;
+}
+
+static int map(Tags *t)
+{
+    int fd = open(t->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    if (fstat(fd, &t->st) < 0) {
+        close(fd);
+        return -1;
+    }
+    t->size = t->st.st_size;
+    void *p = t->size ? mmap(NULL, t->size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (p == MAP_FAILED) {
+        t->size = 0;
+        return -1;
+    }
+    t->data = p;
+    t->format = TAGS_SORTED; // what ctags writes unless told otherwise
+    if (t->size && t->data[0] == '\f') {
+        t->format = TAGS_EMACS;
+        return list_sections(t);
+    }
+    static const char sorted[] = "!_TAG_FILE_SORTED\t";
+    for (const char *l = t->data; l < t->data + t->size && *l == '!'; l = line_end(t, l) + 1) {
+        if ((size_t)(t->data + t->size - l) > sizeof(sorted) && memcmp(l, sorted, sizeof(sorted) - 1) == 0) {
+            char c = l[sizeof(sorted) - 1];
+            t->format = c == '0' ? TAGS_UNSORTED : c == '2' ? TAGS_FOLDED : TAGS_SORTED;
+        }
+    }
+    // binary search jumps around: readahead would only waste the cache
+    if (t->format != TAGS_UNSORTED) madvise(p, t->size, MADV_RANDOM);
+    return 0;
+}
+
+Tags *tags_find(const char *dir)
+{
+    char d[PATH_MAX];
+    if (!realpath(dir && dir[0] ? dir : ".", d)) return NULL;
+    for (;;) {
+        static const char *const names[] = { "tags", "TAGS" };
+        for (int i = 0; i < 2; ++i) {
+            Tags *t = calloc(1, sizeof(*t));
+            if (!t) return NULL;
+            snprintf(t->dir, sizeof(t->dir), "%s", d[1] ? d : "");
+            if (snprintf(t->path, sizeof(t->path), "%s/%s", t->dir, names[i]) < (int)sizeof(t->path) &&
+                map(t) == 0)
+                return t;
+            unmap(t);
+            free(t);
+        }
+        char *slash = strrchr(d, '/');
+        if (!slash || slash == d) {
+            if (!d[1]) return NULL;
+            d[1] = '\0'; // try the root last
+        } else {
+            *slash = '\0';
+        }
+    }
+}
+
+const char *tags_path(const Tags *t)
+{
+    return t->path;
+}
+
+void tags_close(Tags *t)
+{
+    if (!t) return;
+    unmap(t);
+    free(t);
+}
+
+// map the file again if it was replaced or rewritten since it was mapped
+static int refresh(Tags *t)
+{
+    struct stat st;
+    if (stat(t->path, &st) < 0) return -1;
+    if (st.st_ino == t->st.st_ino && st.st_dev == t->st.st_dev && st.st_size == t->st.st_size &&
+        st.st_mtim.tv_sec == t->st.st_mtim.tv_sec && st.st_mtim.tv_nsec == t->st.st_mtim.tv_nsec)
+        return 0;
+    unmap(t);
+    return map(t);
+}
+
+static int fold_cmp(const char *a, const char *b, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        int x = toupper((unsigned char)a[i]), y = toupper((unsigned char)b[i]);
+        if (x != y) return x - y;
+    }
+    return 0;
+}
+
+// the name of the entry at p against key, in the file's sort order
+static int cmp_name(const char *p, const char *end, const char *key, size_t klen, int fold)
+{
+    const char *tab = memchr(p, '\t', end - p);
+    size_t n = (tab ? tab : end) - p, m = n < klen ? n : klen;
+    int c = fold ? fold_cmp(p, key, m) : memcmp(p, key, m);
+    if (c) return c;
+    return (n > klen) - (n < klen);
+}
+
+// offset of the first entry whose name is not below key
+static size_t lower_bound(const Tags *t, const char *key, size_t klen, int fold)
+{
+    size_t lo = 0, hi = t->size;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const char *nl = memrchr(t->data + lo, '\n', mid - lo);
+        const char *start = nl ? nl + 1 : t->data + lo, *end = line_end(t, start);
+        if (cmp_name(start, end, key, klen, fold) < 0) {
+            lo = end - t->data + 1;
+            if (lo > t->size) lo = t->size;
+        } else {
+            hi = start - t->data;
+        }
+    }
+    return lo;
+}
+
+static char *resolve(const Tags *t, const char *file, size_t n)
+{
+    char *path = malloc(strlen(t->dir) + n + 2);
+    if (!path) return NULL;
+    if (file[0] == '/') sprintf(path, "%.*s", (int)n, file);
+    else sprintf(path, "%s/%.*s", t->dir, (int)n, file);
+    return path;
+}
+
+// the mapping has no terminating NUL, so atoi() could read past the last line
+static int parse_number(const char *p, const char *end)
+{
+    int n = 0;
+    for (; p < end && isdigit((unsigned char)*p) && n < INT_MAX / 10; ++p) n = n * 10 + (*p - '0');
+    return n;
+}
+
+// a /pattern/ or ?pattern? address: escapes dropped, anchors noted
+static char *parse_pattern(const char *p, const char *end, int *anchored_end)
+{
+    char delim = *p++, *out = malloc(end - p + 1), *o = out;
+    if (!out) return NULL;
+    if (p < end && *p == '^') p++;
+    *anchored_end = 0;
+    for (; p < end && *p != delim; ++p) {
+        if (*p == '\\' && p + 1 < end && (p[1] == '\\' || p[1] == delim)) p++;
+        else if (*p == '$' && p + 1 < end && p[1] == delim) {
+            *anchored_end = 1;
+            break;
+        }
+        *o++ = *p;
+    }
+    *o = '\0';
+    return out;
+}
+
+// name<TAB>file<TAB>address[;"<TAB>fields]
+static int parse_ctags(const Tags *t, const char *line, const char *end, TagMatch *m)
+{
+    memset(m, 0, sizeof(*m));
+    const char *file = memchr(line, '\t', end - line);
+    const char *addr = file ? memchr(file + 1, '\t', end - file - 1) : NULL;
+    if (!addr) return -1;
+    file++;
+    m->path = resolve(t, file, addr - file);
+    addr++;
+    if (addr < end && isdigit((unsigned char)*addr)) m->line = parse_number(addr, end);
+    else if (addr < end && (*addr == '/' || *addr == '?')) m->pattern = parse_pattern(addr, end, &m->anchored_end);
+    const char *ext = memmem(addr, end - addr, ";\"\t", 3);
+    for (const char *f = ext ? ext + 3 : end; f < end;) {
+        const char *fe = memchr(f, '\t', end - f);
+        if (!fe) fe = end;
+        if (fe - f == 1) m->kind = *f;
+        else if (fe - f == 6 && memcmp(f, "kind:", 5) == 0) m->kind = f[5];
+        f = fe + 1;
+    }
+    return m->path ? 0 : -1;
+}
+
+static int add_match(TagMatch **ms, int *n, int *cap, const TagMatch *m)
+{
+    if (*n == *cap) {
+        int ncap = *cap ? *cap * 2 : 8;
+        TagMatch *nm = realloc(*ms, sizeof(TagMatch) * ncap);
+        if (!nm) return -1;
+        *ms = nm;
+        *cap = ncap;
+    }
+    (*ms)[(*n)++] = *m;
+    return 0;
+}
+
+static void clear_match(TagMatch *m)
+{
+    free(m->path);
+    free(m->pattern);
+}
+
+static void add_ctags(const Tags *t, const char *line, const char *end, TagMatch **ms, int *n, int *cap)
+{
+    TagMatch m;
+    if (parse_ctags(t, line, end, &m) == 0 && add_match(ms, n, cap, &m) == 0) return;
+    clear_match(&m);
+}
+
+static void lookup_sorted(const Tags *t, const char *key, size_t klen, TagMatch **ms, int *n, int *cap)
+{
+    int fold = t->format == TAGS_FOLDED;
+    for (const char *l = t->data + lower_bound(t, key, klen, fold); l < t->data + t->size;) {
+        const char *end = line_end(t, l);
+        if (cmp_name(l, end, key, klen, fold) != 0) break;
+        // a case-folded file groups Foo with foo; only exact names count
+        if (!fold || cmp_name(l, end, key, klen, 0) == 0) add_ctags(t, l, end, ms, n, cap);
+        l = end + 1;
+    }
+}
+
+static void lookup_unsorted(const Tags *t, const char *key, size_t klen, TagMatch **ms, int *n, int *cap)
+{
+    const char *d = t->data, *stop = d + t->size;
+    for (const char *p = d; p < stop && (p = memmem(p, stop - p, key, klen));) {
+        const char *end = line_end(t, p);
+        if ((p == d || p[-1] == '\n') && p + klen < stop && p[klen] == '\t') add_ctags(t, p, end, ms, n, cap);
+        p = end;
+    }
+}
+
+// an Emacs entry: pattern DEL [name SOH] line,offset
+static void lookup_emacs(const Tags *t, const char *key, size_t klen, TagMatch **ms, int *n, int *cap)
+{
+    static const char *const stop_chars = " \f\t\n\r()=,;";
+    const char *d = t->data, *stop = d + t->size;
+    for (const char *p = d; p < stop && (p = memmem(p, stop - p, key, klen));) {
+        const char *nl = memrchr(d, '\n', p - d);
+        const char *line = nl ? nl + 1 : d, *end = line_end(t, p);
+        const char *del = memchr(line, 0x7f, end - line);
+        p = end;
+        if (!del) continue;
+        const char *soh = memchr(del, 0x01, end - del);
+        const char *name, *name_end, *num;
+        if (soh) {
+            name = del + 1;
+            name_end = soh;
+            num = soh + 1;
+        } else {
+            // no explicit name: the last word of the pattern is the tag
+            name_end = del;
+            while (name_end > line && strchr(stop_chars, name_end[-1])) name_end--;
+            name = name_end;
+            while (name > line && !strchr(stop_chars, name[-1])) name--;
+            num = del + 1;
+        }
+        if ((size_t)(name_end - name) != klen || memcmp(name, key, klen) != 0) continue;
+        // the last section starting before this line
+        int lo = 0, hi = t->nsections;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (t->sections[mid].start <= (size_t)(line - d)) lo = mid + 1;
+            else hi = mid;
+        }
+        if (lo == 0) continue;
+        const char *file = t->sections[lo - 1].file;
+        TagMatch m = { .line = parse_number(num, end), .pattern = strndup(line, del - line) };
+        m.path = resolve(t, file, strlen(file));
+        if (!m.path || !m.pattern || add_match(ms, n, cap, &m) < 0) clear_match(&m);
+    }
+}
+
+int tags_lookup(Tags *t, const char *name, TagMatch **matches)
+{
+    *matches = NULL;
+    if (refresh(t) < 0) return -1;
+    size_t klen = strlen(name);
+    int n = 0, cap = 0;
+    if (!t->data || !klen) return 0;
+    if (t->format == TAGS_EMACS) lookup_emacs(t, name, klen, matches, &n, &cap);
+    else if (t->format == TAGS_UNSORTED) lookup_unsorted(t, name, klen, matches, &n, &cap);
+    else lookup_sorted(t, name, klen, matches, &n, &cap);
+    return n;
+}
+
+void tags_free_matches(TagMatch *m, int n)
+{
+    for (int i = 0; i < n; ++i) clear_match(&m[i]);
+    free(m);
+}
+
+int tag_matches_line(const TagMatch *m, const char *line)
+{
+    if (!m->pattern) return 0;
+    if (m->anchored_end) return strcmp(line, m->pattern) == 0;
+    return strncmp(line, m->pattern, strlen(m->pattern)) == 0;
+}
@@ -0,0 +1,34 @@
+/*
+ * Tag files for jumping to definitions
+ * - A ctags `tags` file is mapped, not read: when sorted it is binary
+ *   searched in place, so a lookup touches a handful of pages however
+ *   many entries the file holds
+ * - Unsorted tags files and Emacs `TAGS` files are scanned instead
+ * - Every lookup stats the file and maps it again if it was rewritten
+ */
+
+#ifndef CODEIN_TAGS_H
+#define CODEIN_TAGS_H
+
+typedef struct Tags Tags;
+
+typedef struct {
+    char *path;                 // target file, resolved against the tags file's directory
+    int line;                   // 1-based line from the entry, 0 if it gives none
+    char *pattern;              // text of the line to look for, NULL if none
+    int anchored_end;           // the pattern is the whole line, not its start
+    char kind;                  // ctags kind letter ('f' function...), 0 if none
+} TagMatch;
+
+// nearest `tags` or `TAGS` in dir or its parents; NULL if there is none
+Tags *tags_find(const char *dir);
+const char *tags_path(const Tags *t);
+void tags_close(Tags *t);
+
+// entries for name; -1 if the file became unreadable
+int tags_lookup(Tags *t, const char *name, TagMatch **matches);
+void tags_free_matches(TagMatch *m, int n);
+// whether `line` is the one the entry's pattern describes
+int tag_matches_line(const TagMatch *m, const char *line);
+
+#endif
@@ -0,0 +1,75 @@
+/*
+ * Terminal output accounting
+ *
+ * ncurses buffers its output itself and flushes it with write(2) on the
+ * terminal descriptor, bypassing stdio, so a custom FILE would not see a
+ * byte. Instead the executable defines write(): shared libraries resolve
+ * their write() calls to it, while glibc's own stdio goes straight to the
+ * system call. Only bytes on term_out_fd are counted.
+ */
+
+#define _GNU_SOURCE
+#include "termout.h"
+
+#include <stdatomic.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+typedef struct {
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t max_bytes;
+} OutCounter;
+
+int term_out_fd = -1;
+
+static atomic_ullong out_bytes = 0;
+static uint64_t frame_mark = 0;
+static OutCounter out_counters[OUT_TYPES];
+
+static const char *out_names[OUT_TYPES] = {
+    "insert", "delete", "move", "scroll", "undo", "search", "prompt", "resize", "other",
+};
+
+ssize_t write(int fd, const void *buf, size_t n)
+{
+    ssize_t r = syscall(SYS_write, fd, buf, n);
+    if (r > 0 && fd == term_out_fd) atomic_fetch_add_explicit(&out_bytes, r, memory_order_relaxed);
+    return r;
+}
+
+uint64_t term_out_bytes(void)
+{
+    return atomic_load_explicit(&out_bytes, memory_order_relaxed);
+}
+
+uint64_t term_frame_end(int type)
+{
+    uint64_t now = term_out_bytes(), n = now - frame_mark;
+    OutCounter *c = &out_counters[type];
+    frame_mark = now;
+    c->frames++;
+    c->bytes += n;
+    if (n > c->max_bytes) c->max_bytes = n;
+    return n;
+}
+
+void term_report(FILE *out)
+{
+    OutCounter total = { 0, 0, 0 };
+    fprintf(out, "%-16s %10s %12s %12s %12s\n", "terminal output", "frames", "bytes", "mean_bytes", "max_bytes");
+    for (int i = 0; i < OUT_TYPES; ++i) {
+        OutCounter *c = &out_counters[i];
+        if (!c->frames) continue;
+        fprintf(out, "%-16s %10llu %12llu %12.1f %12llu\n", out_names[i],
+                (unsigned long long)c->frames, (unsigned long long)c->bytes,
+                (double)c->bytes / c->frames, (unsigned long long)c->max_bytes);
+        total.frames += c->frames;
+        total.bytes += c->bytes;
+        if (c->max_bytes > total.max_bytes) total.max_bytes = c->max_bytes;
+    }
+    fprintf(out, "%-16s %10llu %12llu %12.1f %12llu\n", "total",
+            (unsigned long long)total.frames, (unsigned long long)total.bytes,
+            total.frames ? (double)total.bytes / total.frames : 0.0,
+            (unsigned long long)total.max_bytes);
+}
@@ -0,0 +1,34 @@
+/*
+ * Terminal output accounting
+ * - Counts the bytes sent to the terminal, per frame and per kind of
+ *   operation that caused the frame
+ * - Shown in the latency HUD (Ctrl+P), on the Ctrl+T screen, after a
+ *   replay and in the --stats dump
+ */
+
+#ifndef CODEIN_TERMOUT_H
+#define CODEIN_TERMOUT_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+enum {
+    OUT_INSERT,  // typing, Enter
+    OUT_DELETE,
+    OUT_MOVE,    // cursor keys
+    OUT_SCROLL,  // page up/down
+    OUT_UNDO,    // undo, redo
+    OUT_SEARCH,
+    OUT_PROMPT,  // prompts and full-screen overlays
+    OUT_RESIZE,
+    OUT_OTHER,   // status timers, background completions
+    OUT_TYPES
+};
+
+extern int term_out_fd; // descriptor ncurses writes to; -1 disables counting
+
+uint64_t term_out_bytes(void);
+uint64_t term_frame_end(int type); // closes a frame, returns its byte count
+void term_report(FILE *out);
+
+#endif
@@ -0,0 +1,11 @@
+# a Latin-1 file: é and ï are one character each and stay Latin-1 on save
+goto 1 6
+backspace
+insert e
+goto 2 3
+delete
+insert ï
+# column 4 is inside the two bytes of ï in memory
+goto 2 4
+insert -
+save /dev/stdout
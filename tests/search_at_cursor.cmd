@@ -0,0 +1,8 @@
+# the only match is under the cursor of a freshly loaded file
+search foo
+insert >
+# wrapping reaches the start line before the cursor
+goto 1 4
+search foo
+insert <
+print
@@ -0,0 +1,5 @@
+# the search starts with the cursor past the last character
+goto 1 4
+search x
+insert >
+print